@@ -0,0 +1,145 @@
+#ifndef ___ASYNC_LOOKUP_HPP
+#define ___ASYNC_LOOKUP_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define SKIPLIST_COROUTINES 1
+#endif
+
+/**
+ * @brief A round-robin scheduler for SkipList::Search, for callers without
+ * an event loop of their own.
+ *
+ * submit() queues a search together with what to do once it finishes.
+ * run() keeps up to `width` searches in flight and steps each of them in
+ * turn, so their memory stalls overlap: every step prefetches the node its
+ * search reads next, and the other searches take their steps while that
+ * node arrives. A search that finishes hands its slot to the next one in
+ * the queue and then has its callback run, which may submit more.
+ *
+ * An executor belongs to one thread. It only reads the lists, which must
+ * not change while it runs.
+ */
+template <typename List> class LookupExecutor {
+public:
+  using Search = typename List::Search;
+  using Callback = std::function<void(const Search &)>;
+
+  explicit LookupExecutor(std::size_t width = List::BATCH_LANES)
+      : lanes(width == 0 ? 1 : width) {}
+  LookupExecutor(const LookupExecutor &) = delete;
+  LookupExecutor &operator=(const LookupExecutor &) = delete;
+
+  // Queues `search`; run() calls done(search) once it finishes.
+  void submit(const Search &search, Callback done);
+
+  // Steps the queued searches until every one has finished, including the
+  // ones their callbacks submit.
+  void run();
+
+  // The searches submitted but not finished yet.
+  std::size_t pending() const noexcept {
+    return waiting.size() + running.size();
+  }
+
+private:
+  struct Task {
+    Search search;
+    Callback done;
+  };
+
+  std::size_t lanes;
+  std::deque<Task> waiting;
+  std::vector<Task> running;
+};
+
+template <typename List>
+void LookupExecutor<List>::submit(const Search &search, Callback done) {
+  waiting.push_back(Task{search, std::move(done)});
+}
+
+template <typename List> void LookupExecutor<List>::run() {
+  while (!waiting.empty() || !running.empty()) {
+    while (running.size() < lanes && !waiting.empty()) {
+      running.push_back(std::move(waiting.front()));
+      waiting.pop_front();
+    }
+    for (std::size_t lane = 0; lane < running.size();) {
+      if (!running[lane].search.step()) {
+        lane++;
+        continue;
+      }
+      // The callback may submit, so it runs once the task is out of the
+      // way.
+      Task task = std::move(running[lane]);
+      running[lane] = std::move(running.back());
+      running.pop_back();
+      task.done(task.search);
+    }
+  }
+}
+
+#ifdef SKIPLIST_COROUTINES
+/**
+ * @brief What co_find and co_lower_bound return: awaiting one suspends the
+ * coroutine, hands the search to the executor, and resumes the coroutine
+ * from LookupExecutor::run() once the search is done. Each step of the
+ * search is then one turn among all the executor's searches, without a
+ * resume of the coroutine per step.
+ */
+template <typename List, typename Result> class LookupAwaiter {
+public:
+  using Search = typename List::Search;
+
+  LookupAwaiter(LookupExecutor<List> &e, const Search &s,
+                Result (*r)(const Search &)) noexcept
+      : executor(e), search(s), result(r) {}
+
+  bool await_ready() const noexcept { return search.done(); }
+
+  void await_suspend(std::coroutine_handle<> waiter) {
+    executor.submit(search, [this, waiter](const Search &finished) {
+      search = finished;
+      waiter.resume();
+    });
+  }
+
+  Result await_resume() const { return result(search); }
+
+private:
+  LookupExecutor<List> &executor;
+  Search search;
+  Result (*result)(const Search &);
+};
+
+// co_await co_find(list, k, executor): the value of k, or nullptr. As with
+// the Search it runs, k and the list must outlive the await.
+template <typename List, typename Key>
+auto co_find(const List &list, const Key &k, LookupExecutor<List> &executor) {
+  using Search = typename List::Search;
+  using Result = decltype(std::declval<const Search &>().value());
+  return LookupAwaiter<List, Result>(
+      executor, list.search(k),
+      [](const Search &s) -> Result { return s.value(); });
+}
+
+// co_await co_lower_bound(list, k, executor): the first key >= k, as a
+// const_iterator.
+template <typename List, typename Key>
+auto co_lower_bound(const List &list, const Key &k,
+                    LookupExecutor<List> &executor) {
+  using Search = typename List::Search;
+  using Result = typename List::const_iterator;
+  return LookupAwaiter<List, Result>(
+      executor, list.search(k),
+      [](const Search &s) -> Result { return s.position(); });
+}
+#endif
+
+#endif
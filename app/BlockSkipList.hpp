@@ -0,0 +1,443 @@
+#ifndef ___BLOCK_SKIP_LIST_HPP
+#define ___BLOCK_SKIP_LIST_HPP
+
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief A skip list of sorted blocks, for small arithmetic keys.
+ *
+ * SkipList gives every key a tower of its own, so a lookup chases one
+ * pointer per step and every step is a likely cache miss. Here the keys
+ * live in blocks whose key array fills one 64-byte cache line (16 keys for
+ * a 32-bit Key). The blocks form an ordinary skip list ordered by their
+ * smallest key. A search walks down the towers of blocks, then searches
+ * within one block with a single scan of its cache line. That scan uses
+ * SSE2 compares for 32-bit integer keys where they are available. There
+ * are BLOCK_KEYS times fewer towers, so a search takes about that many
+ * fewer pointer steps.
+ *
+ * A full block is split in two when a key is added to it, and a block is
+ * unlinked when its last key is erased. Blocks left part-full by erase are
+ * not merged. Block heights come from `Levels`, called with the key whose
+ * insert created the block; see the level generators in SkipList.hpp.
+ *
+ * Keys are ordered by `<` and must not be NaN. Values must be trivially
+ * copyable, since splits and inserts move them around with memmove.
+ *
+ * This covers the core operations only. Use SkipList when you need
+ * iterators, fingers, order statistics or snapshots.
+ */
+template <typename Key, typename Value, typename Levels = RandomLevels>
+class BlockSkipList {
+  static_assert(std::is_arithmetic<Key>::value,
+                "block skip lists need arithmetic keys");
+  static_assert(std::is_trivially_copyable<Value>::value,
+                "block skip lists need trivially copyable values");
+
+public:
+  static constexpr std::size_t BLOCK_BYTES = 64;
+
+  // How many keys fit in one block.
+  static constexpr unsigned BLOCK_KEYS = BLOCK_BYTES / sizeof(Key);
+
+  // Upper bound on numLayers(), as in SkipList.
+  static constexpr unsigned MAX_LAYERS = 3 * 64 + 1;
+
+  BlockSkipList();
+  explicit BlockSkipList(const Levels &generator);
+  BlockSkipList(const BlockSkipList &) = delete;
+  BlockSkipList &operator=(const BlockSkipList &) = delete;
+  ~BlockSkipList();
+
+  // These behave like the SkipList functions of the same name.
+  std::size_t size() const noexcept;
+  bool isEmpty() const noexcept;
+  unsigned numLayers() const noexcept;
+  bool contains(const Key &k) const;
+  Value *tryFind(const Key &k);
+  const Value *tryFind(const Key &k) const;
+  Value &find(const Key &k);
+  const Value &find(const Key &k) const;
+  bool insert(const Key &k, const Value &v);
+  bool erase(const Key &k);
+  void clear() noexcept;
+  std::vector<Key> allKeysInOrder() const;
+
+  // How many blocks hold the keys.
+  std::size_t numBlocks() const noexcept;
+
+private:
+  // keys[i] < keys[i + 1] for i + 1 < count. The slots from count on hold
+  // the largest Key, so a scan of the whole line needs no bounds check.
+  struct Block {
+    alignas(BLOCK_BYTES) Key keys[BLOCK_KEYS];
+    unsigned count;
+    unsigned levels;
+    Value values[BLOCK_KEYS];
+    Block *next[1];
+
+    static std::size_t bytes(unsigned levels) noexcept {
+      return sizeof(Block) + (levels - 1) * sizeof(Block *);
+    }
+  };
+
+  // Allocates an empty block that occupies `levels` layers.
+  static Block *createBlock(unsigned levels);
+  static void destroyBlock(Block *block) noexcept;
+
+  // The number of keys in `block` smaller than k, i.e. where k is or would
+  // go.
+  static unsigned lowerBound(const Block *block, const Key &k) noexcept;
+
+  // Returns the last block whose smallest key is <= k (or head), and if
+  // `update` is non-null, also stores the same on every layer in it.
+  Block *locate(const Key &k, Block **update) const;
+
+  // Sets update[i] to the last block in S_i whose smallest key is < k.
+  void locateBefore(const Key &k, Block **update) const;
+
+  // Splices `block` in after update[i] on every layer it occupies, adding
+  // layers at the top when needed.
+  void linkBlock(Block **update, Block *block);
+
+  // Moves the upper half of a full `block` into a new block linked in
+  // after it. update[i] must be `block` on every layer it occupies.
+  Block *split(Block **update, Block *block);
+
+  unsigned num_layers;
+  std::size_t num_keys;
+  std::size_t num_blocks;
+  // head holds no keys and has a forward pointer for every possible layer;
+  // nullptr marks the end of a layer.
+  Block *head;
+  Levels level_generator;
+};
+
+template <typename Key, typename Value, typename Levels>
+BlockSkipList<Key, Value, Levels>::BlockSkipList()
+    : BlockSkipList(Levels()) {}
+
+template <typename Key, typename Value, typename Levels>
+BlockSkipList<Key, Value, Levels>::BlockSkipList(const Levels &generator)
+    : num_layers(2), num_keys(0), num_blocks(0), level_generator(generator) {
+  head = createBlock(MAX_LAYERS);
+}
+
+template <typename Key, typename Value, typename Levels>
+BlockSkipList<Key, Value, Levels>::~BlockSkipList() {
+  clear();
+  destroyBlock(head);
+}
+
+template <typename Key, typename Value, typename Levels>
+typename BlockSkipList<Key, Value, Levels>::Block *
+BlockSkipList<Key, Value, Levels>::createBlock(unsigned levels) {
+  void *memory =
+      ::operator new(Block::bytes(levels), std::align_val_t(alignof(Block)));
+  Block *block = static_cast<Block *>(memory);
+  for (unsigned i = 0; i < BLOCK_KEYS; i++) {
+    block->keys[i] = std::numeric_limits<Key>::max();
+  }
+  block->count = 0;
+  block->levels = levels;
+  for (unsigned i = 0; i < levels; i++) {
+    block->next[i] = nullptr;
+  }
+  return block;
+}
+
+template <typename Key, typename Value, typename Levels>
+void BlockSkipList<Key, Value, Levels>::destroyBlock(Block *block) noexcept {
+  ::operator delete(block, std::align_val_t(alignof(Block)));
+}
+
+template <typename Key, typename Value, typename Levels>
+unsigned
+BlockSkipList<Key, Value, Levels>::lowerBound(const Block *block,
+                                              const Key &k) noexcept {
+#if defined(__SSE2__)
+  if constexpr (std::is_integral<Key>::value && sizeof(Key) == 4) {
+    // SSE2 only compares signed lanes, so unsigned keys are shifted into
+    // signed order by flipping their top bit. Each lane that compares less
+    // is all ones, i.e. -1, and subtracting them counts them.
+    const __m128i flip =
+        _mm_set1_epi32(std::is_signed<Key>::value ? 0 : INT32_MIN);
+    const __m128i key = _mm_xor_si128(
+        _mm_set1_epi32(static_cast<std::int32_t>(k)), flip);
+    __m128i less = _mm_setzero_si128();
+    for (unsigned i = 0; i < BLOCK_KEYS; i += 4) {
+      __m128i lanes = _mm_xor_si128(
+          _mm_load_si128(reinterpret_cast<const __m128i *>(block->keys + i)),
+          flip);
+      less = _mm_sub_epi32(less, _mm_cmplt_epi32(lanes, key));
+    }
+    less = _mm_add_epi32(less, _mm_shuffle_epi32(less, 0x4E));
+    less = _mm_add_epi32(less, _mm_shuffle_epi32(less, 0xB1));
+    return static_cast<unsigned>(_mm_cvtsi128_si32(less));
+  }
+#endif
+  // Counting over the whole line instead of stopping at the first larger
+  // key keeps the loop free of branches, so compilers vectorize it.
+  unsigned less = 0;
+  for (unsigned i = 0; i < BLOCK_KEYS; i++) {
+    less += block->keys[i] < k;
+  }
+  return less;
+}
+
+template <typename Key, typename Value, typename Levels>
+typename BlockSkipList<Key, Value, Levels>::Block *
+BlockSkipList<Key, Value, Levels>::locate(const Key &k, Block **update) const {
+  Block *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (temp->next[level] && !(k < temp->next[level]->keys[0])) {
+      temp = temp->next[level];
+    }
+    if (update) {
+      update[level] = temp;
+    }
+  }
+  return temp;
+}
+
+template <typename Key, typename Value, typename Levels>
+void BlockSkipList<Key, Value, Levels>::locateBefore(const Key &k,
+                                                     Block **update) const {
+  Block *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (temp->next[level] && temp->next[level]->keys[0] < k) {
+      temp = temp->next[level];
+    }
+    update[level] = temp;
+  }
+}
+
+template <typename Key, typename Value, typename Levels>
+void BlockSkipList<Key, Value, Levels>::linkBlock(Block **update,
+                                                  Block *block) {
+  // There should always be an empty layer at the top.
+  while (block->levels + 1 > num_layers) {
+    update[num_layers] = head;
+    num_layers++;
+  }
+  for (unsigned level = 0; level < block->levels; level++) {
+    block->next[level] = update[level]->next[level];
+    update[level]->next[level] = block;
+  }
+  num_blocks++;
+}
+
+template <typename Key, typename Value, typename Levels>
+typename BlockSkipList<Key, Value, Levels>::Block *
+BlockSkipList<Key, Value, Levels>::split(Block **update, Block *block) {
+  const unsigned half = BLOCK_KEYS / 2;
+  Block *upper = createBlock(
+      level_generator(block->keys[half], maxFlipsFor(num_blocks + 1)));
+
+  upper->count = BLOCK_KEYS - half;
+  std::memcpy(upper->keys, block->keys + half, upper->count * sizeof(Key));
+  std::memcpy(upper->values, block->values + half,
+              upper->count * sizeof(Value));
+  for (unsigned i = half; i < BLOCK_KEYS; i++) {
+    block->keys[i] = std::numeric_limits<Key>::max();
+  }
+  block->count = half;
+
+  // Every block between update[i] and `block` on S_0 starts below the
+  // keys moved to `upper`, so update[] is still right for it.
+  linkBlock(update, upper);
+  return upper;
+}
+
+template <typename Key, typename Value, typename Levels>
+std::size_t BlockSkipList<Key, Value, Levels>::size() const noexcept {
+  return num_keys;
+}
+
+template <typename Key, typename Value, typename Levels>
+bool BlockSkipList<Key, Value, Levels>::isEmpty() const noexcept {
+  return num_keys == 0;
+}
+
+template <typename Key, typename Value, typename Levels>
+unsigned BlockSkipList<Key, Value, Levels>::numLayers() const noexcept {
+  return num_layers;
+}
+
+template <typename Key, typename Value, typename Levels>
+std::size_t BlockSkipList<Key, Value, Levels>::numBlocks() const noexcept {
+  return num_blocks;
+}
+
+template <typename Key, typename Value, typename Levels>
+bool BlockSkipList<Key, Value, Levels>::contains(const Key &k) const {
+  return tryFind(k) != nullptr;
+}
+
+template <typename Key, typename Value, typename Levels>
+const Value *BlockSkipList<Key, Value, Levels>::tryFind(const Key &k) const {
+  const Block *block = locate(k, nullptr);
+  if (block == head) {
+    return nullptr;
+  }
+  unsigned i = lowerBound(block, k);
+  return i < block->count && block->keys[i] == k ? &block->values[i]
+                                                 : nullptr;
+}
+
+template <typename Key, typename Value, typename Levels>
+Value *BlockSkipList<Key, Value, Levels>::tryFind(const Key &k) {
+  const BlockSkipList *self = this;
+  return const_cast<Value *>(self->tryFind(k));
+}
+
+template <typename Key, typename Value, typename Levels>
+const Value &BlockSkipList<Key, Value, Levels>::find(const Key &k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Levels>
+Value &BlockSkipList<Key, Value, Levels>::find(const Key &k) {
+  Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Levels>
+bool BlockSkipList<Key, Value, Levels>::insert(const Key &k, const Value &v) {
+  Block *update[MAX_LAYERS];
+  Block *block = locate(k, update);
+
+  if (block == head) {
+    block = head->next[0];
+    if (!block) {
+      block = createBlock(level_generator(k, maxFlipsFor(1)));
+      linkBlock(update, block);
+    } else {
+      // k goes in front of the first block, which becomes the block on
+      // every layer it occupies.
+      for (unsigned level = 0; level < block->levels; level++) {
+        update[level] = block;
+      }
+    }
+  }
+
+  unsigned i = lowerBound(block, k);
+  if (i < block->count && block->keys[i] == k) {
+    return false;
+  }
+
+  if (block->count == BLOCK_KEYS) {
+    Block *upper = split(update, block);
+    if (i > block->count) {
+      i -= block->count;
+      block = upper;
+    }
+  }
+
+  std::memmove(block->keys + i + 1, block->keys + i,
+               (block->count - i) * sizeof(Key));
+  std::memmove(block->values + i + 1, block->values + i,
+               (block->count - i) * sizeof(Value));
+  block->keys[i] = k;
+  block->values[i] = v;
+  block->count++;
+  num_keys++;
+  return true;
+}
+
+template <typename Key, typename Value, typename Levels>
+bool BlockSkipList<Key, Value, Levels>::erase(const Key &k) {
+  Block *update[MAX_LAYERS];
+  locateBefore(k, update);
+
+  // k is either past the smallest key of update[0] or the smallest key of
+  // the block after it.
+  Block *block = update[0];
+  Block *after = block->next[0];
+  if (after && after->keys[0] == k) {
+    block = after;
+  } else if (block == head) {
+    return false;
+  }
+
+  unsigned i = lowerBound(block, k);
+  if (i == block->count || block->keys[i] != k) {
+    return false;
+  }
+
+  block->count--;
+  std::memmove(block->keys + i, block->keys + i + 1,
+               (block->count - i) * sizeof(Key));
+  std::memmove(block->values + i, block->values + i + 1,
+               (block->count - i) * sizeof(Value));
+  block->keys[block->count] = std::numeric_limits<Key>::max();
+  num_keys--;
+
+  if (block->count == 0) {
+    // Only a block whose smallest key was k can run empty, and update[]
+    // holds its predecessors.
+    for (unsigned level = 0; level < block->levels; level++) {
+      update[level]->next[level] = block->next[level];
+    }
+    destroyBlock(block);
+    num_blocks--;
+
+    // Keep exactly one empty layer at the top.
+    while (num_layers > 2 && !head->next[num_layers - 2]) {
+      num_layers--;
+    }
+  }
+  return true;
+}
+
+template <typename Key, typename Value, typename Levels>
+void BlockSkipList<Key, Value, Levels>::clear() noexcept {
+  Block *temp = head->next[0];
+  while (temp) {
+    Block *temp2 = temp;
+    temp = temp->next[0];
+    destroyBlock(temp2);
+  }
+
+  for (unsigned level = 0; level < num_layers; level++) {
+    head->next[level] = nullptr;
+  }
+  num_layers = 2;
+  num_keys = 0;
+  num_blocks = 0;
+}
+
+template <typename Key, typename Value, typename Levels>
+std::vector<Key> BlockSkipList<Key, Value, Levels>::allKeysInOrder() const {
+  std::vector<Key> keys;
+  keys.reserve(num_keys);
+  for (const Block *temp = head->next[0]; temp; temp = temp->next[0]) {
+    keys.insert(keys.end(), temp->keys, temp->keys + temp->count);
+  }
+  return keys;
+}
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef ___CACHE_SKIP_LIST_HPP
+#define ___CACHE_SKIP_LIST_HPP
+
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/**
+ * @brief How much a CacheSkipList may hold. 0 means no limit.
+ *
+ * max_bytes counts the memory of the towers, which is what the list's
+ * allocator hands out: SkipNode<Key, Entry>::bytes(height) for each key.
+ * Memory that keys and values own themselves, such as the heap buffer of a
+ * long std::string, is not counted.
+ */
+struct CacheLimits {
+  std::size_t max_entries = 0;
+  std::size_t max_bytes = 0;
+};
+
+/**
+ * @brief A SkipList index for an in-memory cache, with a bounded size and
+ * optional expiry times.
+ *
+ * Every entry carries the time it expires, if it has a TTL, and a place in
+ * a least-recently-used list threaded through the towers. Inserting past
+ * the limits evicts the least recently used entries, as many as it takes
+ * and usually one. Expired entries count as missing as soon as they
+ * expire. A lookup that finds one erases it, and every insert also checks
+ * the next SWEEP_STEPS entries of a cursor that walks around the list in
+ * key order and erases those that expired. The cache never stops to scan
+ * everything. Evicted and expired towers are erased from the SkipList, so
+ * their memory goes back to its NodeArena and is reused by later inserts.
+ *
+ * A lookup through find or tryFind makes the entry the most recently used
+ * one; contains does not. Clock supplies now() (std::chrono::steady_clock
+ * by default, or a fake clock for tests).
+ */
+template <typename Key, typename Value,
+          typename Clock = std::chrono::steady_clock>
+class CacheSkipList {
+public:
+  using duration = typename Clock::duration;
+  using time_point = typename Clock::time_point;
+
+  // How many entries each insert checks for expiry.
+  static constexpr unsigned SWEEP_STEPS = 4;
+
+  // Always counted, since they are what a cache is sized by.
+  struct Stats {
+    // Lookups through find and tryFind that found a live entry or not.
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    // Entries removed because their TTL passed, by a lookup, an insert of
+    // the same key or the sweep.
+    std::uint64_t expirations = 0;
+    // Entries removed to make room under the limits.
+    std::uint64_t evictions = 0;
+  };
+
+  explicit CacheSkipList(const CacheLimits &limits = CacheLimits());
+  CacheSkipList(const CacheSkipList &) = delete;
+  CacheSkipList &operator=(const CacheSkipList &) = delete;
+
+  // The entries held, including any that expired but were not removed yet,
+  // and the bytes their towers take up.
+  std::size_t size() const noexcept { return list.size(); }
+  bool isEmpty() const noexcept { return list.isEmpty(); }
+  std::size_t bytes() const noexcept { return tower_bytes; }
+  const CacheLimits &limits() const noexcept { return cache_limits; }
+
+  // Inserts (k, v), expiring after `ttl` unless it is zero. Returns false,
+  // changing nothing, if k is already present and has not expired.
+  bool insert(const Key &k, const Value &v, duration ttl = duration::zero());
+
+  // Inserts (k, v) or replaces the value and TTL already stored under k,
+  // which becomes the most recently used entry. Returns true if k was not
+  // present.
+  bool insert_or_assign(const Key &k, const Value &v,
+                        duration ttl = duration::zero());
+
+  // The value of k, or nullptr if k is missing or expired.
+  Value *tryFind(const Key &k);
+
+  // The same, throwing a RuntimeException instead of returning nullptr.
+  Value &find(const Key &k);
+
+  // Is k present and not expired?
+  bool contains(const Key &k) const;
+
+  // Removes k. Returns false if k was not present.
+  bool erase(const Key &k);
+
+  // Checks up to `steps` more entries of the sweep and removes those that
+  // expired, for callers that want to expire entries while idle. Returns
+  // how many were removed.
+  std::size_t evictExpired(std::size_t steps);
+
+  // Removes every entry.
+  void clear() noexcept;
+
+  const Stats &stats() const noexcept { return counters; }
+  void resetStats() noexcept { counters = Stats(); }
+
+private:
+  struct Entry;
+  using Index = SkipList<Key, Entry>;
+  using Iterator = typename Index::iterator;
+
+  struct Entry {
+    // The list's head and tail hold default-constructed entries.
+    Entry() = default;
+    Entry(const Value &v, time_point e) : value(v), expires(e) {}
+
+    Value value{};
+    time_point expires{};
+    // The tower holding this entry, and the entries used right before and
+    // after it.
+    Iterator self;
+    Entry *newer = nullptr;
+    Entry *older = nullptr;
+    std::size_t bytes = 0;
+  };
+
+  static time_point expiry(duration ttl);
+  static bool expired(const Entry &e, time_point now) noexcept {
+    return e.expires <= now;
+  }
+
+  // Moves e to the front of the LRU list, or puts it there.
+  void touch(Entry &e) noexcept;
+  void unlinkLru(Entry &e) noexcept;
+
+  // Erases e and returns the iterator after it.
+  Iterator remove(Entry &e);
+
+  // insert and insert_or_assign; `assign` says whether to replace an entry
+  // that has not expired.
+  bool put(const Key &k, const Value &v, duration ttl, bool assign);
+
+  // Inserts (k, v) with the given expiry, then makes room for it.
+  void add(const Key &k, const Value &v, time_point expires);
+
+  // Evicts least recently used entries other than `keep` while the cache
+  // is over its limits.
+  void shrink(const Entry *keep);
+
+  Index list;
+  CacheLimits cache_limits;
+  std::size_t tower_bytes = 0;
+  Entry *newest = nullptr;
+  Entry *oldest = nullptr;
+  // The sweep resumes at the first key >= sweep_from, or at the smallest
+  // key when it has wrapped around.
+  Key sweep_from{};
+  bool sweep_wrapped = true;
+  Stats counters;
+};
+
+template <typename Key, typename Value, typename Clock>
+CacheSkipList<Key, Value, Clock>::CacheSkipList(const CacheLimits &limits)
+    : cache_limits(limits) {}
+
+template <typename Key, typename Value, typename Clock>
+typename CacheSkipList<Key, Value, Clock>::time_point
+CacheSkipList<Key, Value, Clock>::expiry(duration ttl) {
+  return ttl == duration::zero() ? time_point::max() : Clock::now() + ttl;
+}
+
+template <typename Key, typename Value, typename Clock>
+void CacheSkipList<Key, Value, Clock>::unlinkLru(Entry &e) noexcept {
+  (e.newer ? e.newer->older : newest) = e.older;
+  (e.older ? e.older->newer : oldest) = e.newer;
+  e.newer = e.older = nullptr;
+}
+
+template <typename Key, typename Value, typename Clock>
+void CacheSkipList<Key, Value, Clock>::touch(Entry &e) noexcept {
+  if (newest == &e) {
+    return;
+  }
+  if (e.newer || e.older || oldest == &e) {
+    unlinkLru(e);
+  }
+  e.older = newest;
+  (newest ? newest->newer : oldest) = &e;
+  newest = &e;
+}
+
+template <typename Key, typename Value, typename Clock>
+typename CacheSkipList<Key, Value, Clock>::Iterator
+CacheSkipList<Key, Value, Clock>::remove(Entry &e) {
+  unlinkLru(e);
+  tower_bytes -= e.bytes;
+  return list.erase(e.self);
+}
+
+template <typename Key, typename Value, typename Clock>
+void CacheSkipList<Key, Value, Clock>::add(const Key &k, const Value &v,
+                                           time_point expires) {
+  Iterator it = list.try_emplace(k, v, expires).first;
+  Entry &e = it.value();
+  e.self = it;
+  e.bytes = SkipNode<Key, Entry>::bytes(it.height());
+  tower_bytes += e.bytes;
+  touch(e);
+  shrink(&e);
+}
+
+template <typename Key, typename Value, typename Clock>
+void CacheSkipList<Key, Value, Clock>::shrink(const Entry *keep) {
+  while (oldest && oldest != keep &&
+         ((cache_limits.max_entries && size() > cache_limits.max_entries) ||
+          (cache_limits.max_bytes && tower_bytes > cache_limits.max_bytes))) {
+    remove(*oldest);
+    counters.evictions++;
+  }
+}
+
+template <typename Key, typename Value, typename Clock>
+bool CacheSkipList<Key, Value, Clock>::insert(const Key &k, const Value &v,
+                                              duration ttl) {
+  return put(k, v, ttl, false);
+}
+
+template <typename Key, typename Value, typename Clock>
+bool CacheSkipList<Key, Value, Clock>::insert_or_assign(const Key &k,
+                                                        const Value &v,
+                                                        duration ttl) {
+  return put(k, v, ttl, true);
+}
+
+template <typename Key, typename Value, typename Clock>
+bool CacheSkipList<Key, Value, Clock>::put(const Key &k, const Value &v,
+                                           duration ttl, bool assign) {
+  evictExpired(SWEEP_STEPS);
+
+  Iterator it = list.lower_bound(k);
+  if (it == list.end() || k < it.key()) {
+    add(k, v, expiry(ttl));
+    return true;
+  }
+
+  // An expired entry is replaced in place, as if it had been removed.
+  Entry &e = it.value();
+  bool was_expired = expired(e, Clock::now());
+  if (!was_expired && !assign) {
+    return false;
+  }
+  if (was_expired) {
+    counters.expirations++;
+  }
+  e.value = v;
+  e.expires = expiry(ttl);
+  touch(e);
+  return was_expired;
+}
+
+template <typename Key, typename Value, typename Clock>
+Value *CacheSkipList<Key, Value, Clock>::tryFind(const Key &k) {
+  Entry *e = list.tryFind(k);
+  if (!e) {
+    counters.misses++;
+    return nullptr;
+  }
+  if (expired(*e, Clock::now())) {
+    remove(*e);
+    counters.expirations++;
+    counters.misses++;
+    return nullptr;
+  }
+  touch(*e);
+  counters.hits++;
+  return &e->value;
+}
+
+template <typename Key, typename Value, typename Clock>
+Value &CacheSkipList<Key, Value, Clock>::find(const Key &k) {
+  Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Clock>
+bool CacheSkipList<Key, Value, Clock>::contains(const Key &k) const {
+  const Entry *e = list.tryFind(k);
+  return e && !expired(*e, Clock::now());
+}
+
+template <typename Key, typename Value, typename Clock>
+bool CacheSkipList<Key, Value, Clock>::erase(const Key &k) {
+  Entry *e = list.tryFind(k);
+  if (!e) {
+    return false;
+  }
+  remove(*e);
+  return true;
+}
+
+template <typename Key, typename Value, typename Clock>
+std::size_t CacheSkipList<Key, Value, Clock>::evictExpired(std::size_t steps) {
+  if (list.isEmpty()) {
+    return 0;
+  }
+
+  time_point now = Clock::now();
+  Iterator it = sweep_wrapped ? list.begin() : list.lower_bound(sweep_from);
+  std::size_t removed = 0;
+  for (std::size_t step = 0; step < steps && !list.isEmpty(); step++) {
+    if (it == list.end()) {
+      it = list.begin();
+    }
+    if (expired(it.value(), now)) {
+      it = remove(it.value());
+      removed++;
+    } else {
+      ++it;
+    }
+  }
+
+  sweep_wrapped = it == list.end();
+  if (!sweep_wrapped) {
+    sweep_from = it.key();
+  }
+  counters.expirations += removed;
+  return removed;
+}
+
+template <typename Key, typename Value, typename Clock>
+void CacheSkipList<Key, Value, Clock>::clear() noexcept {
+  list.clear();
+  tower_bytes = 0;
+  newest = oldest = nullptr;
+  sweep_wrapped = true;
+}
+
+#endif
@@ -0,0 +1,732 @@
+#ifndef ___CONCURRENT_SKIP_LIST_HPP
+#define ___CONCURRENT_SKIP_LIST_HPP
+
+#include "EpochReclaimer.hpp"
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A tower of the concurrent skip list.
+ *
+ * Like SkipNode, a key occupies a single allocation whose `next` array is
+ * sized to the tower. Each forward pointer is a word holding the successor's
+ * address with a "deleted" mark in its low bit: once next[i] is marked, the
+ * node is logically gone from S_i and nobody may link anything after it on
+ * that layer. Once next[0] is marked the node is on its way out of S_0.
+ *
+ * `born` and `died` are the versions at which the key entered and left the
+ * list, for snapshots. PENDING means the stamp is being written; a node
+ * whose `died` is still 0 holds a live key.
+ */
+template <typename Key, typename Value> struct ConcurrentSkipNode {
+  Key key;
+  Value value;
+  unsigned levels;
+  // Both the inserting and the erasing thread release the node when they
+  // are finished with it; whoever releases it last retires it. See
+  // ConcurrentSkipList::release.
+  std::atomic<unsigned> owners{2};
+  std::atomic<std::uint64_t> born{PENDING};
+  std::atomic<std::uint64_t> died{0};
+  std::atomic<std::uintptr_t> next[1];
+
+  static constexpr std::uint64_t PENDING = UINT64_MAX;
+
+  static std::size_t bytes(unsigned levels) noexcept {
+    return sizeof(ConcurrentSkipNode<Key, Value>) +
+           (levels - 1) * sizeof(std::atomic<std::uintptr_t>);
+  }
+
+  static ConcurrentSkipNode<Key, Value> *create(unsigned levels, const Key &k,
+                                                const Value &v) {
+    void *memory = ::operator new(bytes(levels));
+    ConcurrentSkipNode<Key, Value> *node;
+    try {
+      node = new (memory) ConcurrentSkipNode<Key, Value>(k, v, levels);
+    } catch (...) {
+      ::operator delete(memory);
+      throw;
+    }
+    return node;
+  }
+
+  static void destroy(void *p) noexcept {
+    ConcurrentSkipNode<Key, Value> *node =
+        static_cast<ConcurrentSkipNode<Key, Value> *>(p);
+    node->~ConcurrentSkipNode<Key, Value>();
+    ::operator delete(node);
+  }
+
+private:
+  ConcurrentSkipNode<Key, Value>(const Key &k, const Value &v, unsigned l)
+      : key(k), value(v), levels(l) {
+    next[0].store(0, std::memory_order_relaxed);
+    for (unsigned i = 1; i < levels; i++) {
+      new (&next[i]) std::atomic<std::uintptr_t>(0);
+    }
+  }
+  ~ConcurrentSkipNode<Key, Value>() = default;
+};
+
+/**
+ * @brief A lock-free skip list for many concurrent readers and writers.
+ *
+ * insert, erase and find are lock-free, following Herlihy & Shavit's
+ * LockFreeSkipList (after Fraser): a tower is published by a single
+ * compare-and-swap into S_0 and then linked into the upper layers one at a
+ * time, and erase marks the tower's forward pointers top-down, the mark on
+ * next[0] being the moment the key leaves the list. Searches that run into
+ * marked towers unlink them as they go.
+ *
+ * Unlinked towers are freed through an EpochReclaimer, so a thread that is
+ * still reading a tower never sees it freed underneath it.
+ *
+ * Tower heights follow the same flipCoin / maxFlipsFor rule as SkipList,
+ * based on the number of keys at the time of the insert. A sequence of
+ * inserts made from one thread therefore produces exactly the same heights
+ * and numLayers() as SkipList; with concurrent inserts the key count each
+ * insert sees depends on the interleaving.
+ *
+ * Values are copied out by find and never change after insert, so no
+ * reference into the list outlives the call that produced it.
+ *
+ * snapshot() gives a read-only view of the list as it was at that moment,
+ * built on version stamps rather than a copy. Every insert and erase takes
+ * the next version from a shared clock when it finishes, and a snapshot
+ * sees exactly the towers born at or before its version that had not died
+ * by then. Towers erased while an older snapshot is open keep their place
+ * in S_0, only marked as dead for the live list, until no open snapshot
+ * needs them; the last snapshot to close sweeps them out. Writers never
+ * wait for snapshots. A snapshot read that meets a stamp still being
+ * written waits for it, which is the few instructions after a
+ * compare-and-swap.
+ */
+template <typename Key, typename Value> class ConcurrentSkipList {
+public:
+  static constexpr unsigned MAX_LAYERS =
+      SkipList<Key, Value, NewDeleteAllocator>::MAX_LAYERS;
+
+  ConcurrentSkipList();
+  ConcurrentSkipList(const ConcurrentSkipList &) = delete;
+  ConcurrentSkipList &operator=(const ConcurrentSkipList &) = delete;
+
+  // No other thread may be using the list while it is destroyed.
+  ~ConcurrentSkipList();
+
+  // The number of keys. Exact when no insert or erase is in progress.
+  std::size_t size() const noexcept;
+  bool isEmpty() const noexcept;
+
+  // One more than the tallest tower ever inserted, as in SkipList.
+  unsigned numLayers() const noexcept;
+
+  // Inserts (k, v) if k is not already present. Returns false if it was.
+  bool insert(const Key &k, const Value &v);
+
+  // Removes k. Returns false if k was not present.
+  bool erase(const Key &k);
+
+  bool contains(const Key &k) const;
+
+  // Copies the value of k into `out`. Returns false if k is not present.
+  bool find(const Key &k, Value &out) const;
+
+  // Throws a RuntimeException if k is not present, like SkipList::find.
+  Value find(const Key &k) const;
+
+  // The height of k. Throws a RuntimeException if k is not present.
+  unsigned height(const Key &k) const;
+
+  // The keys present during the walk, in increasing order. Keys inserted or
+  // erased concurrently may or may not be included.
+  std::vector<Key> allKeysInOrder() const;
+
+  // A consistent, read-only view of the list at one point in time. It
+  // includes every insert and erase that returned before snapshot() was
+  // called and none that started after it returned, no matter what the
+  // writers do in the meantime. Any number of threads may read one
+  // snapshot at once. A snapshot must be destroyed before its list.
+  class Snapshot {
+  public:
+    Snapshot(Snapshot &&other) noexcept
+        : list(other.list), at(other.at) {
+      other.list = nullptr;
+    }
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    Snapshot &operator=(Snapshot &&) = delete;
+    ~Snapshot();
+
+    // The version of the list this snapshot shows.
+    std::uint64_t version() const noexcept { return at; }
+
+    // These behave like the ConcurrentSkipList functions of the same name,
+    // on the list as it was.
+    bool contains(const Key &k) const;
+    bool find(const Key &k, Value &out) const;
+    Value find(const Key &k) const;
+    std::vector<Key> allKeysInOrder() const;
+
+    // Calls fn(key, value) for every key, in increasing order.
+    template <typename Fn> void forEach(Fn fn) const;
+
+  private:
+    friend class ConcurrentSkipList;
+    Snapshot(const ConcurrentSkipList *l, std::uint64_t version)
+        : list(l), at(version) {}
+
+    const ConcurrentSkipList *list;
+    std::uint64_t at;
+  };
+
+  Snapshot snapshot() const;
+
+private:
+  using Node = ConcurrentSkipNode<Key, Value>;
+
+  // No snapshot is open.
+  static constexpr std::uint64_t NO_SNAPSHOT = UINT64_MAX;
+
+  static Node *pointer(std::uintptr_t word) noexcept {
+    return reinterpret_cast<Node *>(word & ~std::uintptr_t(1));
+  }
+  static bool marked(std::uintptr_t word) noexcept { return word & 1; }
+  static std::uintptr_t word(Node *node) noexcept {
+    return reinterpret_cast<std::uintptr_t>(node);
+  }
+
+  // Fills preds[i] / succs[i] for every layer with adjacent nodes such
+  // that preds[i] < k <= succs[i] (succs[i] may be nullptr), unlinking
+  // marked towers along the way. With `past_equal`, nodes equal to k are
+  // passed over as well, which guarantees that no marked tower with key k
+  // is left reachable. Returns true if a live node with key k was found in
+  // S_0 (only without past_equal).
+  bool search(const Key &k, bool past_equal, Node **preds,
+              Node **succs) const;
+  bool trySearch(const Key &k, bool past_equal, Node **preds,
+                 Node **succs) const;
+
+  // Read-only search: the first unmarked node in S_0 with key >= k.
+  Node *lookup(const Key &k) const;
+
+  // Marks next[level] of node; returns false if it was already marked.
+  static bool mark(Node *node, unsigned level);
+
+  // After linking a tower in front of succ on `level`, makes sure succ is
+  // not left reachable if it was erased in the meantime.
+  void unlinkIfMarked(Node *succ, unsigned level) const;
+
+  // Links the already published `node` into S_level between preds[level]
+  // and succs[level], searching again as often as needed. Returns false if
+  // the tower was erased first and must not be linked any higher.
+  bool linkLayer(Node *node, unsigned level, Node **preds, Node **succs);
+
+  void release(Node *node, EpochReclaimer::Guard &guard) const;
+
+  // The next version, for an insert or erase that just took effect.
+  std::uint64_t stamp() const noexcept;
+
+  // Is `node` part of the list at `version`? Waits for stamps that are
+  // still being written.
+  static bool visibleAt(Node *node, std::uint64_t version) noexcept;
+
+  // The node holding k at `version`, or nullptr.
+  Node *lookupAt(const Key &k, std::uint64_t version) const;
+
+  // Takes the dead `node` out of every layer and releases it, unless
+  // another thread is already doing so. No open snapshot may need it.
+  void reclaim(Node *node, EpochReclaimer::Guard &guard) const;
+
+  // Reclaims every dead tower that no open snapshot needs any more.
+  void sweep() const;
+
+  // Forgets the snapshot at `version`, then sweeps if it held anything.
+  void closeSnapshot(std::uint64_t version) const;
+
+  Node *head;
+  std::atomic<std::size_t> num_keys{0};
+  // Layers that hold at least one tower, plus one. Only ever grows.
+  std::atomic<unsigned> num_layers{2};
+  mutable EpochReclaimer epochs;
+
+  mutable std::atomic<std::uint64_t> clock{1};
+  // The versions of the open snapshots, and the smallest of them (or
+  // NO_SNAPSHOT). A tower that died at version d can go once d <= oldest.
+  mutable std::mutex snapshot_mutex;
+  mutable std::multiset<std::uint64_t> open_snapshots;
+  mutable std::atomic<std::uint64_t> oldest_snapshot{NO_SNAPSHOT};
+  // Dead towers not reclaimed yet.
+  mutable std::atomic<std::size_t> dead_towers{0};
+};
+
+template <typename Key, typename Value>
+ConcurrentSkipList<Key, Value>::ConcurrentSkipList() {
+  head = Node::create(MAX_LAYERS, Key(), Value());
+}
+
+template <typename Key, typename Value>
+ConcurrentSkipList<Key, Value>::~ConcurrentSkipList() {
+  // Erased towers are no longer reachable from S_0; those that have not
+  // been freed yet belong to `epochs`, which frees them after this.
+  Node *temp = head;
+  while (temp) {
+    Node *next = pointer(temp->next[0].load(std::memory_order_relaxed));
+    Node::destroy(temp);
+    temp = next;
+  }
+}
+
+template <typename Key, typename Value>
+std::size_t ConcurrentSkipList<Key, Value>::size() const noexcept {
+  return num_keys.load(std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::isEmpty() const noexcept {
+  return size() == 0;
+}
+
+template <typename Key, typename Value>
+unsigned ConcurrentSkipList<Key, Value>::numLayers() const noexcept {
+  return num_layers.load(std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::trySearch(const Key &k, bool past_equal,
+                                               Node **preds,
+                                               Node **succs) const {
+  Node *pred = head;
+  for (unsigned level = num_layers.load(); level-- > 0;) {
+    std::uintptr_t pred_next = pred->next[level].load();
+    if (marked(pred_next)) {
+      // pred was erased after we stepped onto it; its pointers are stale.
+      return false;
+    }
+    Node *curr = pointer(pred_next);
+
+    while (curr) {
+      std::uintptr_t curr_next = curr->next[level].load();
+      if (marked(curr_next)) {
+        std::uintptr_t expected = word(curr);
+        if (!pred->next[level].compare_exchange_strong(
+                expected, word(pointer(curr_next)))) {
+          return false;
+        }
+        curr = pointer(curr_next);
+        continue;
+      }
+
+      if (curr->key < k || (past_equal && !(k < curr->key))) {
+        pred = curr;
+        curr = pointer(curr_next);
+      } else {
+        break;
+      }
+    }
+
+    preds[level] = pred;
+    succs[level] = curr;
+  }
+  return true;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::search(const Key &k, bool past_equal,
+                                            Node **preds,
+                                            Node **succs) const {
+  while (!trySearch(k, past_equal, preds, succs)) {
+  }
+  // A live tower for k is always the first one, since an insert goes in
+  // front of the towers of k that died before it.
+  return !past_equal && succs[0] && !(k < succs[0]->key) &&
+         succs[0]->died.load() == 0;
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node *
+ConcurrentSkipList<Key, Value>::lookup(const Key &k) const {
+  Node *pred = head;
+  Node *curr = nullptr;
+  for (unsigned level = num_layers.load(); level-- > 0;) {
+    curr = pointer(pred->next[level].load());
+    while (curr) {
+      std::uintptr_t curr_next = curr->next[level].load();
+      if (marked(curr_next)) {
+        curr = pointer(curr_next);
+      } else if (curr->key < k) {
+        pred = curr;
+        curr = pointer(curr_next);
+      } else {
+        break;
+      }
+    }
+  }
+  return curr;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::mark(Node *node, unsigned level) {
+  std::uintptr_t next = node->next[level].load();
+  while (!marked(next)) {
+    if (node->next[level].compare_exchange_weak(next, next | 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::unlinkIfMarked(Node *succ,
+                                                    unsigned level) const {
+  if (succ && marked(succ->next[level].load())) {
+    Node *preds[MAX_LAYERS];
+    Node *succs[MAX_LAYERS];
+    search(succ->key, true, preds, succs);
+  }
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::linkLayer(Node *node, unsigned level,
+                                               Node **preds, Node **succs) {
+  for (;;) {
+    // Point the tower at its successor, unless an erase has already marked
+    // this layer, in which case the tower must not go any higher.
+    std::uintptr_t next = node->next[level].load();
+    if (marked(next)) {
+      return false;
+    }
+    if (pointer(next) != succs[level] &&
+        !node->next[level].compare_exchange_strong(next, word(succs[level]))) {
+      return false;
+    }
+
+    std::uintptr_t expected = word(succs[level]);
+    if (preds[level]->next[level].compare_exchange_strong(expected,
+                                                          word(node))) {
+      unlinkIfMarked(succs[level], level);
+      return true;
+    }
+
+    // The layer changed under us; find the new neighbours. If the tower is
+    // no longer in S_0 it has been erased.
+    search(node->key, false, preds, succs);
+    if (succs[0] != node) {
+      return false;
+    }
+  }
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::release(
+    Node *node, EpochReclaimer::Guard &guard) const {
+  if (node->owners.fetch_sub(1) == 1) {
+    guard.retire(node, &Node::destroy);
+  }
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::insert(const Key &k, const Value &v) {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *preds[MAX_LAYERS];
+  Node *succs[MAX_LAYERS];
+
+  unsigned levels = flipCoinLevels(k, maxFlipsFor(size() + 1));
+
+  // Make room first, so that the search below covers every layer the new
+  // tower will occupy. There should always be an empty layer at the top.
+  unsigned layers = num_layers.load();
+  while (layers < levels + 1 &&
+         !num_layers.compare_exchange_weak(layers, levels + 1)) {
+  }
+
+  Node *node = nullptr;
+  for (;;) {
+    if (search(k, false, preds, succs)) {
+      if (node) {
+        Node::destroy(node);
+      }
+      return false;
+    }
+
+    if (!node) {
+      node = Node::create(levels, k, v);
+    }
+    for (unsigned level = 0; level < levels; level++) {
+      node->next[level].store(word(succs[level]), std::memory_order_relaxed);
+    }
+
+    std::uintptr_t expected = word(succs[0]);
+    if (preds[0]->next[0].compare_exchange_strong(expected, word(node))) {
+      break;
+    }
+  }
+  node->born.store(stamp());
+  num_keys.fetch_add(1, std::memory_order_relaxed);
+  unlinkIfMarked(succs[0], 0);
+
+  for (unsigned level = 1; level < levels; level++) {
+    if (!linkLayer(node, level, preds, succs)) {
+      break;
+    }
+  }
+
+  if (marked(node->next[0].load())) {
+    // An erase raced with the upper layers; whatever we linked after its
+    // own clean-up search has to come out again.
+    search(k, true, preds, succs);
+  }
+  release(node, guard);
+  return true;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::erase(const Key &k) {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *preds[MAX_LAYERS];
+  Node *succs[MAX_LAYERS];
+
+  if (!search(k, false, preds, succs)) {
+    return false;
+  }
+
+  // The key leaves the live list when `died` leaves 0. The tower itself
+  // stays in place for as long as an open snapshot may still read it.
+  Node *victim = succs[0];
+  std::uint64_t alive = 0;
+  if (!victim->died.compare_exchange_strong(alive, Node::PENDING)) {
+    // Another erase got here first.
+    return false;
+  }
+  num_keys.fetch_sub(1, std::memory_order_relaxed);
+  dead_towers.fetch_add(1);
+  std::uint64_t died = stamp();
+  victim->died.store(died);
+
+  if (died <= oldest_snapshot.load()) {
+    reclaim(victim, guard);
+  }
+  return true;
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::reclaim(
+    Node *node, EpochReclaimer::Guard &guard) const {
+  for (unsigned level = node->levels; level-- > 1;) {
+    mark(node, level);
+  }
+  if (!mark(node, 0)) {
+    // Another thread is reclaiming it.
+    return;
+  }
+  dead_towers.fetch_sub(1);
+
+  Node *preds[MAX_LAYERS];
+  Node *succs[MAX_LAYERS];
+  search(node->key, true, preds, succs);
+  release(node, guard);
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::contains(const Key &k) const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *node = lookup(k);
+  return node && !(k < node->key) && node->died.load() == 0;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::find(const Key &k, Value &out) const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *node = lookup(k);
+  if (!node || k < node->key || node->died.load() != 0) {
+    return false;
+  }
+  out = node->value;
+  return true;
+}
+
+template <typename Key, typename Value>
+Value ConcurrentSkipList<Key, Value>::find(const Key &k) const {
+  Value value;
+  if (!find(k, value)) {
+    throw RuntimeException("Key not found");
+  }
+  return value;
+}
+
+template <typename Key, typename Value>
+unsigned ConcurrentSkipList<Key, Value>::height(const Key &k) const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *node = lookup(k);
+  if (!node || k < node->key || node->died.load() != 0) {
+    throw RuntimeException("Key not found");
+  }
+  return node->levels;
+}
+
+template <typename Key, typename Value>
+std::vector<Key> ConcurrentSkipList<Key, Value>::allKeysInOrder() const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  std::vector<Key> keys;
+  keys.reserve(size());
+  Node *temp = pointer(head->next[0].load());
+  while (temp) {
+    std::uintptr_t next = temp->next[0].load();
+    if (!marked(next) && temp->died.load() == 0) {
+      keys.push_back(temp->key);
+    }
+    temp = pointer(next);
+  }
+  return keys;
+}
+
+template <typename Key, typename Value>
+std::uint64_t ConcurrentSkipList<Key, Value>::stamp() const noexcept {
+  return clock.fetch_add(1) + 1;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::visibleAt(Node *node,
+                                               std::uint64_t version) noexcept {
+  std::uint64_t born;
+  while ((born = node->born.load()) == Node::PENDING) {
+    std::this_thread::yield();
+  }
+  if (born > version) {
+    return false;
+  }
+  std::uint64_t died;
+  while ((died = node->died.load()) == Node::PENDING) {
+    std::this_thread::yield();
+  }
+  return died == 0 || died > version;
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node *
+ConcurrentSkipList<Key, Value>::lookupAt(const Key &k,
+                                         std::uint64_t version) const {
+  // Towers an open snapshot can see are never marked, and the towers of k
+  // sit next to each other in S_0, newest first.
+  Node *node = lookup(k);
+  while (node && !(k < node->key)) {
+    std::uintptr_t next = node->next[0].load();
+    if (!marked(next) && visibleAt(node, version)) {
+      return node;
+    }
+    node = pointer(next);
+  }
+  return nullptr;
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Snapshot
+ConcurrentSkipList<Key, Value>::snapshot() const {
+  std::lock_guard<std::mutex> lock(snapshot_mutex);
+  // Hold on to every dead tower while the version is read, so that none
+  // this snapshot needs is reclaimed between the two.
+  auto placeholder = open_snapshots.insert(0);
+  oldest_snapshot.store(0);
+  std::uint64_t version = clock.load();
+  open_snapshots.erase(placeholder);
+  open_snapshots.insert(version);
+  oldest_snapshot.store(*open_snapshots.begin());
+  return Snapshot(this, version);
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::closeSnapshot(
+    std::uint64_t version) const {
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    open_snapshots.erase(open_snapshots.find(version));
+    oldest_snapshot.store(open_snapshots.empty() ? NO_SNAPSHOT
+                                                 : *open_snapshots.begin());
+  }
+  if (dead_towers.load() > 0) {
+    sweep();
+  }
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::sweep() const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Node *temp = pointer(head->next[0].load());
+  while (temp) {
+    std::uintptr_t next = temp->next[0].load();
+    std::uint64_t died = temp->died.load();
+    // Read the oldest snapshot after the stamp, as erase does: a snapshot
+    // opened since the walk began may need towers that died after it.
+    if (!marked(next) && died != 0 && died != Node::PENDING &&
+        died <= oldest_snapshot.load()) {
+      reclaim(temp, guard);
+    }
+    temp = pointer(next);
+  }
+}
+
+template <typename Key, typename Value>
+ConcurrentSkipList<Key, Value>::Snapshot::~Snapshot() {
+  if (list) {
+    list->closeSnapshot(at);
+  }
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::Snapshot::contains(const Key &k) const {
+  EpochReclaimer::Guard guard = list->epochs.pin();
+  return list->lookupAt(k, at) != nullptr;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::Snapshot::find(const Key &k,
+                                                    Value &out) const {
+  EpochReclaimer::Guard guard = list->epochs.pin();
+  Node *node = list->lookupAt(k, at);
+  if (!node) {
+    return false;
+  }
+  out = node->value;
+  return true;
+}
+
+template <typename Key, typename Value>
+Value ConcurrentSkipList<Key, Value>::Snapshot::find(const Key &k) const {
+  Value value;
+  if (!find(k, value)) {
+    throw RuntimeException("Key not found");
+  }
+  return value;
+}
+
+template <typename Key, typename Value>
+std::vector<Key>
+ConcurrentSkipList<Key, Value>::Snapshot::allKeysInOrder() const {
+  std::vector<Key> keys;
+  forEach([&keys](const Key &k, const Value &) { keys.push_back(k); });
+  return keys;
+}
+
+template <typename Key, typename Value>
+template <typename Fn>
+void ConcurrentSkipList<Key, Value>::Snapshot::forEach(Fn fn) const {
+  EpochReclaimer::Guard guard = list->epochs.pin();
+  Node *temp = pointer(list->head->next[0].load());
+  while (temp) {
+    std::uintptr_t next = temp->next[0].load();
+    if (!marked(next) && visibleAt(temp, at)) {
+      fn(static_cast<const Key &>(temp->key),
+         static_cast<const Value &>(temp->value));
+    }
+    temp = pointer(next);
+  }
+}
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef ___DURABLE_SKIP_LIST_HPP
+#define ___DURABLE_SKIP_LIST_HPP
+
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief When a DurableSkipList forces its log to disk.
+ *
+ * None      Batches are written to the operating system in the background
+ *           but never synced, so they survive a crash of the process but
+ *           not of the machine.
+ * Batched   The background thread syncs every batch it writes: an update
+ *           is durable at most batch_interval after it returns.
+ * EveryOp   insert and erase write and sync their own record before
+ *           returning.
+ */
+enum class SyncPolicy { None, Batched, EveryOp };
+
+struct DurabilityOptions {
+  SyncPolicy sync = SyncPolicy::Batched;
+  // How long the background thread lets records collect before writing
+  // them out, and how many it lets collect before writing them early.
+  std::chrono::milliseconds batch_interval{5};
+  std::size_t max_batch_records = 4096;
+};
+
+/**
+ * @brief The write-ahead log file: a WalHeader followed by fixed-size
+ * records, each a 32-bit checksum, an operation byte, the key and the value
+ * (unused for erases), all in host byte order.
+ *
+ * A crash can leave a partly written record at the end. Its checksum does
+ * not match, so recovery stops there and cuts it off.
+ */
+struct WalHeader {
+  char magic[8];
+  std::uint32_t key_bytes;
+  std::uint32_t value_bytes;
+};
+
+constexpr char WAL_MAGIC[8] = {'S', 'K', 'I', 'P', 'W', 'A', 'L', '1'};
+
+// FNV-1a, enough to tell a torn record from a whole one.
+inline std::uint32_t walChecksum(const unsigned char *bytes,
+                                 std::size_t n) noexcept {
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < n; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Writes all n bytes at p to fd, or throws.
+inline void walWrite(int fd, const void *p, std::size_t n) {
+  const char *bytes = static_cast<const char *>(p);
+  while (n > 0) {
+    ssize_t written = write(fd, bytes, n);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw RuntimeException(std::string("Cannot write the log: ") +
+                             std::strerror(errno));
+    }
+    bytes += written;
+    n -= static_cast<std::size_t>(written);
+  }
+}
+
+// Forces what was written to fd onto the disk, or throws.
+inline void walSync(int fd) {
+#if defined(__linux__)
+  int result = fdatasync(fd);
+#else
+  int result = fsync(fd);
+#endif
+  if (result != 0) {
+    throw RuntimeException(std::string("Cannot sync: ") +
+                           std::strerror(errno));
+  }
+}
+
+/**
+ * @brief A SkipList whose updates survive restarts.
+ *
+ * Every successful insert and erase appends a record to a write-ahead log
+ * at `path`.log. An insert builds its tower before logging it and takes
+ * the tower back out if logging throws, so an insert that runs out of
+ * memory is never replayed. An erase logs first, since unlinking a tower
+ * cannot fail. An update whose log write or sync fails, though, may
+ * already have reached the file, and then comes back when the list is
+ * opened again.
+ *
+ * checkpoint() saves the whole list as a binary snapshot at
+ * `path`.snapshot (see SkipList::save) and empties the log. Opening a
+ * DurableSkipList loads the snapshot, if there is one, and replays the log
+ * on top of it. Replaying is safe even if a crash came between writing a
+ * snapshot and emptying the log, because replaying a run of updates onto
+ * the state they led to changes nothing.
+ *
+ * With the None and Batched policies, updates only append their record to
+ * a buffer. A background thread writes the buffer out in batches, so a
+ * single sync covers a whole batch (group commit). sync() waits until
+ * everything logged so far is on disk. If the background thread fails to
+ * write, the next update, sync() or checkpoint() throws the error.
+ *
+ * Like SkipList, a DurableSkipList is for one thread at a time; the
+ * background thread only ever touches the log. Keys and values must be
+ * trivially copyable, as for snapshots.
+ */
+template <typename Key, typename Value> class DurableSkipList {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+                    std::is_trivially_copyable<Value>::value,
+                "durable lists need trivially copyable keys and values");
+
+public:
+  // Opens the list stored at `path`, creating it if it does not exist.
+  // Throws a RuntimeException if the files cannot be opened or were
+  // written for other key or value types.
+  explicit DurableSkipList(const std::string &path,
+                           const DurabilityOptions &options =
+                               DurabilityOptions());
+  DurableSkipList(const DurableSkipList &) = delete;
+  DurableSkipList &operator=(const DurableSkipList &) = delete;
+
+  // Writes out and syncs whatever is still buffered.
+  ~DurableSkipList();
+
+  // These behave like the SkipList functions of the same name.
+  bool insert(const Key &k, const Value &v);
+  bool erase(const Key &k);
+  std::size_t size() const noexcept { return sl.size(); }
+  bool isEmpty() const noexcept { return sl.isEmpty(); }
+  bool contains(const Key &k) const { return sl.contains(k); }
+  const Value &find(const Key &k) const { return sl.find(k); }
+  const Value *tryFind(const Key &k) const { return sl.tryFind(k); }
+
+  // The list itself, for every other read.
+  const SkipList<Key, Value> &list() const noexcept { return sl; }
+
+  // Returns once every update so far is written and synced, whatever the
+  // policy.
+  void sync();
+
+  // Saves a snapshot and empties the log.
+  void checkpoint();
+
+  // The records in the log since it was last emptied, including those not
+  // written out yet. Replaying them is what opening the list costs.
+  std::uint64_t logRecords() const noexcept { return log_records; }
+
+  const std::string &snapshotPath() const noexcept { return snapshot_path; }
+  const std::string &logPath() const noexcept { return log_path; }
+
+private:
+  enum Operation : unsigned char { INSERT = 1, ERASE = 2 };
+
+  static constexpr std::size_t RECORD_BYTES =
+      sizeof(std::uint32_t) + 1 + sizeof(Key) + sizeof(Value);
+
+  // Opens the log, replays it into sl and cuts off a torn tail.
+  void recover();
+
+  // Logs one update according to the policy.
+  void append(Operation op, const Key &k, const Value &v);
+
+  // The background thread: writes batches until told to stop.
+  void flushLoop();
+
+  // Writes `batch` to the log and syncs it if `durable`. io_mutex must be
+  // held.
+  void writeBatch(const std::vector<unsigned char> &batch, bool durable);
+
+  // Throws the background thread's error, if it had one. mutex must be
+  // held.
+  void checkFailure() const;
+
+  SkipList<Key, Value> sl;
+  const std::string snapshot_path;
+  const std::string log_path;
+  const DurabilityOptions options;
+  int log_fd = -1;
+  std::uint64_t log_records = 0;
+
+  // Guards everything below, which the background thread shares.
+  std::mutex mutex;
+  std::condition_variable wake_flusher;
+  std::condition_variable batch_done;
+  std::vector<unsigned char> pending;
+  std::size_t pending_records = 0;
+  // Records handed to the log so far, and how many of them are synced.
+  std::uint64_t appended = 0;
+  std::uint64_t synced = 0;
+  // Set by sync() for the next batch, which is then synced whatever the
+  // policy.
+  bool sync_wanted = false;
+  bool stopping = false;
+  std::string failure;
+
+  // Held while writing to the log file.
+  std::mutex io_mutex;
+  std::thread flusher;
+};
+
+template <typename Key, typename Value>
+DurableSkipList<Key, Value>::DurableSkipList(
+    const std::string &path, const DurabilityOptions &opts)
+    : snapshot_path(path + ".snapshot"), log_path(path + ".log"),
+      options(opts) {
+  struct stat info;
+  if (stat(snapshot_path.c_str(), &info) == 0) {
+    sl.load(snapshot_path);
+  }
+  recover();
+  if (options.sync != SyncPolicy::EveryOp) {
+    flusher = std::thread(&DurableSkipList::flushLoop, this);
+  }
+}
+
+template <typename Key, typename Value>
+DurableSkipList<Key, Value>::~DurableSkipList() {
+  if (flusher.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake_flusher.notify_one();
+    flusher.join();
+  }
+  close(log_fd);
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::recover() {
+  log_fd = open(log_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (log_fd < 0) {
+    throw RuntimeException("Cannot open " + log_path);
+  }
+
+  WalHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+  header.key_bytes = sizeof(Key);
+  header.value_bytes = sizeof(Value);
+
+  std::vector<unsigned char> contents;
+  unsigned char buffer[1 << 16];
+  ssize_t got;
+  while ((got = read(log_fd, buffer, sizeof(buffer))) > 0) {
+    contents.insert(contents.end(), buffer, buffer + got);
+  }
+
+  // A log too short for its header is one whose creation was cut short.
+  std::size_t good = sizeof(header);
+  if (contents.size() < sizeof(header)) {
+    if (ftruncate(log_fd, 0) != 0 || lseek(log_fd, 0, SEEK_SET) != 0) {
+      close(log_fd);
+      throw RuntimeException("Cannot reset " + log_path);
+    }
+    walWrite(log_fd, &header, sizeof(header));
+    walSync(log_fd);
+    return;
+  }
+  if (std::memcmp(contents.data(), &header, sizeof(header)) != 0) {
+    close(log_fd);
+    throw RuntimeException("Not a log of this key and value type: " +
+                           log_path);
+  }
+
+  for (; good + RECORD_BYTES <= contents.size(); good += RECORD_BYTES) {
+    const unsigned char *record = contents.data() + good;
+    std::uint32_t checksum;
+    std::memcpy(&checksum, record, sizeof(checksum));
+    const unsigned char *body = record + sizeof(checksum);
+    if (walChecksum(body, RECORD_BYTES - sizeof(checksum)) != checksum) {
+      break;
+    }
+
+    Key k;
+    Value v;
+    std::memcpy(&k, body + 1, sizeof(Key));
+    std::memcpy(&v, body + 1 + sizeof(Key), sizeof(Value));
+    if (body[0] == INSERT) {
+      sl.insert(k, v);
+    } else if (body[0] == ERASE) {
+      sl.erase(k);
+    } else {
+      break;
+    }
+    log_records++;
+  }
+
+  // New records go right after the last whole one.
+  if (good != contents.size() &&
+      (ftruncate(log_fd, static_cast<off_t>(good)) != 0 ||
+       fsync(log_fd) != 0)) {
+    close(log_fd);
+    throw RuntimeException("Cannot repair " + log_path);
+  }
+  lseek(log_fd, static_cast<off_t>(good), SEEK_SET);
+}
+
+template <typename Key, typename Value>
+bool DurableSkipList<Key, Value>::insert(const Key &k, const Value &v) {
+  if (!sl.insert(k, v)) {
+    return false;
+  }
+  try {
+    append(INSERT, k, v);
+  } catch (...) {
+    sl.erase(k);
+    throw;
+  }
+  return true;
+}
+
+template <typename Key, typename Value>
+bool DurableSkipList<Key, Value>::erase(const Key &k) {
+  if (!sl.contains(k)) {
+    return false;
+  }
+  append(ERASE, k, Value());
+  return sl.erase(k);
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::append(Operation op, const Key &k,
+                                         const Value &v) {
+  unsigned char record[RECORD_BYTES] = {};
+  unsigned char *body = record + sizeof(std::uint32_t);
+  body[0] = op;
+  std::memcpy(body + 1, &k, sizeof(Key));
+  std::memcpy(body + 1 + sizeof(Key), &v, sizeof(Value));
+  std::uint32_t checksum =
+      walChecksum(body, RECORD_BYTES - sizeof(std::uint32_t));
+  std::memcpy(record, &checksum, sizeof(checksum));
+
+  if (options.sync == SyncPolicy::EveryOp) {
+    std::lock_guard<std::mutex> io(io_mutex);
+    walWrite(log_fd, record, RECORD_BYTES);
+    walSync(log_fd);
+    log_records++;
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  checkFailure();
+  // Let the writer catch up rather than buffer without bound.
+  batch_done.wait(lock, [this]() {
+    return pending_records < 2 * options.max_batch_records ||
+           !failure.empty();
+  });
+  checkFailure();
+  pending.insert(pending.end(), record, record + RECORD_BYTES);
+  pending_records++;
+  appended++;
+  log_records++;
+  if (pending_records >= options.max_batch_records) {
+    wake_flusher.notify_one();
+  }
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::checkFailure() const {
+  if (!failure.empty()) {
+    throw RuntimeException(failure);
+  }
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::writeBatch(
+    const std::vector<unsigned char> &batch, bool durable) {
+  if (!batch.empty()) {
+    walWrite(log_fd, batch.data(), batch.size());
+  }
+  if (durable) {
+    walSync(log_fd);
+  }
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::flushLoop() {
+  std::vector<unsigned char> batch;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake_flusher.wait_for(lock, options.batch_interval, [this]() {
+      return stopping || sync_wanted ||
+             pending_records >= options.max_batch_records;
+    });
+    if (pending.empty() && !sync_wanted && !stopping) {
+      continue;
+    }
+
+    batch.swap(pending);
+    pending_records = 0;
+    std::uint64_t upto = appended;
+    bool durable =
+        options.sync == SyncPolicy::Batched || sync_wanted || stopping;
+    sync_wanted = false;
+    bool stop = stopping;
+    lock.unlock();
+
+    std::string error;
+    try {
+      std::lock_guard<std::mutex> io(io_mutex);
+      writeBatch(batch, durable);
+    } catch (const RuntimeException &e) {
+      error = e.getMessage();
+    }
+    batch.clear();
+
+    lock.lock();
+    if (error.empty() && durable) {
+      synced = upto;
+    } else if (!error.empty()) {
+      if (failure.empty()) {
+        failure = error;
+      }
+    }
+    batch_done.notify_all();
+    if (stop) {
+      return;
+    }
+  }
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::sync() {
+  if (options.sync == SyncPolicy::EveryOp) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  checkFailure();
+  std::uint64_t target = appended;
+  if (synced >= target) {
+    return;
+  }
+  sync_wanted = true;
+  wake_flusher.notify_one();
+  batch_done.wait(lock, [&]() {
+    return !failure.empty() || synced >= target;
+  });
+  checkFailure();
+}
+
+template <typename Key, typename Value>
+void DurableSkipList<Key, Value>::checkpoint() {
+  sync();
+
+  // Write the snapshot under another name and sync it before it replaces
+  // the old one, so that a crash leaves one whole snapshot or the other.
+  std::string temporary = snapshot_path + ".tmp";
+  sl.save(temporary);
+  int fd = open(temporary.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw RuntimeException("Cannot open " + temporary);
+  }
+  try {
+    walSync(fd);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  if (std::rename(temporary.c_str(), snapshot_path.c_str()) != 0) {
+    throw RuntimeException("Cannot replace " + snapshot_path);
+  }
+  std::string directory = ".";
+  std::size_t slash = snapshot_path.rfind('/');
+  if (slash != std::string::npos) {
+    directory = snapshot_path.substr(0, slash + 1);
+  }
+  int dir_fd = open(directory.c_str(), O_RDONLY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  // Everything in the log is in the snapshot now. Only this thread
+  // appends, so nothing new arrived since sync().
+  std::lock_guard<std::mutex> io(io_mutex);
+  if (ftruncate(log_fd, sizeof(WalHeader)) != 0 ||
+      lseek(log_fd, sizeof(WalHeader), SEEK_SET) < 0) {
+    throw RuntimeException("Cannot empty " + log_path);
+  }
+  walSync(log_fd);
+  log_records = 0;
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef ___EPOCH_RECLAIMER_HPP
+#define ___EPOCH_RECLAIMER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Epoch-based memory reclamation for lock-free data structures.
+ *
+ * Every operation on the data structure runs inside a Guard, which pins the
+ * calling thread to the current global epoch. Memory that has been unlinked
+ * is handed to Guard::retire instead of being freed. The global epoch only
+ * advances once every pinned thread has seen the current one, so anything
+ * retired in epoch e can be freed once the global epoch reaches e + 2: by
+ * then no thread can still hold a pointer it read before the retirement.
+ *
+ * Each thread works through a Record. Records are claimed for the duration
+ * of a Guard and released afterwards, and every thread remembers the last
+ * record it used, so in the common case pinning is one uncontended
+ * compare-and-swap. Records, and anything still waiting in them, are freed
+ * when the reclaimer is destroyed; no thread may be pinned at that point.
+ */
+class EpochReclaimer {
+private:
+  struct Retired {
+    void *p;
+    void (*deleter)(void *);
+  };
+
+  struct alignas(64) Record {
+    std::atomic<bool> in_use{true};
+    // The epoch this record is pinned to, or 0 when it is not pinned.
+    std::atomic<std::uint64_t> local{0};
+    Record *next = nullptr;
+    // limbo[i] holds memory retired in epoch limbo_epoch[i].
+    std::vector<Retired> limbo[3];
+    std::uint64_t limbo_epoch[3] = {0, 0, 0};
+    unsigned retired_since_advance = 0;
+  };
+
+public:
+  // How many retirements a record makes between attempts to advance the
+  // global epoch.
+  static constexpr unsigned ADVANCE_INTERVAL = 64;
+
+  class Guard {
+  public:
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+    Guard(Guard &&other) noexcept : owner(other.owner), record(other.record) {
+      other.record = nullptr;
+    }
+    ~Guard() {
+      if (record) {
+        owner->unpin(record);
+      }
+    }
+
+    // Frees p with deleter(p) once no pinned thread can still reach it.
+    // p must already be unreachable for threads that pin from now on.
+    void retire(void *p, void (*deleter)(void *)) {
+      owner->retire(record, p, deleter);
+    }
+
+  private:
+    friend class EpochReclaimer;
+    Guard(EpochReclaimer *o, Record *r) : owner(o), record(r) {}
+
+    EpochReclaimer *owner;
+    Record *record;
+  };
+
+  EpochReclaimer() : id(nextId()) {}
+  EpochReclaimer(const EpochReclaimer &) = delete;
+  EpochReclaimer &operator=(const EpochReclaimer &) = delete;
+  ~EpochReclaimer();
+
+  Guard pin();
+
+  std::uint64_t epoch() const noexcept { return global_epoch.load(); }
+
+private:
+  static std::uint64_t nextId() {
+    static std::atomic<std::uint64_t> ids{1};
+    return ids.fetch_add(1);
+  }
+
+  Record *acquire();
+  void unpin(Record *r) noexcept;
+  void retire(Record *r, void *p, void (*deleter)(void *));
+  // Frees the limbo lists of r that are at least two epochs old.
+  void reclaim(Record *r, std::uint64_t epoch) noexcept;
+  void tryAdvance(std::uint64_t epoch) noexcept;
+
+  static void drain(std::vector<Retired> &list) noexcept {
+    for (const Retired &item : list) {
+      item.deleter(item.p);
+    }
+    list.clear();
+  }
+
+  // Distinguishes this reclaimer from any other, including one that later
+  // reuses its address, in the per-thread record cache.
+  const std::uint64_t id;
+  std::atomic<std::uint64_t> global_epoch{1};
+  std::atomic<Record *> records{nullptr};
+};
+
+inline EpochReclaimer::~EpochReclaimer() {
+  Record *r = records.load();
+  while (r) {
+    Record *next = r->next;
+    for (std::vector<Retired> &list : r->limbo) {
+      drain(list);
+    }
+    delete r;
+    r = next;
+  }
+}
+
+inline EpochReclaimer::Record *EpochReclaimer::acquire() {
+  struct Cache {
+    std::uint64_t id = 0;
+    Record *record = nullptr;
+  };
+  static thread_local Cache cache;
+
+  bool expected = false;
+  if (cache.id == id && cache.record->in_use.compare_exchange_strong(
+                            expected, true, std::memory_order_acquire)) {
+    return cache.record;
+  }
+
+  Record *r = records.load(std::memory_order_acquire);
+  for (; r; r = r->next) {
+    expected = false;
+    if (r->in_use.compare_exchange_strong(expected, true,
+                                          std::memory_order_acquire)) {
+      break;
+    }
+  }
+
+  if (!r) {
+    r = new Record();
+    Record *head = records.load(std::memory_order_relaxed);
+    do {
+      r->next = head;
+    } while (!records.compare_exchange_weak(head, r,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+  }
+
+  cache.id = id;
+  cache.record = r;
+  return r;
+}
+
+inline EpochReclaimer::Guard EpochReclaimer::pin() {
+  Record *r = acquire();
+  std::uint64_t epoch = global_epoch.load();
+  r->local.store(epoch);
+  reclaim(r, epoch);
+  return Guard(this, r);
+}
+
+inline void EpochReclaimer::unpin(Record *r) noexcept {
+  r->local.store(0, std::memory_order_release);
+  r->in_use.store(false, std::memory_order_release);
+}
+
+inline void EpochReclaimer::reclaim(Record *r, std::uint64_t epoch) noexcept {
+  for (unsigned i = 0; i < 3; i++) {
+    if (!r->limbo[i].empty() && r->limbo_epoch[i] + 2 <= epoch) {
+      drain(r->limbo[i]);
+    }
+  }
+}
+
+inline void EpochReclaimer::retire(Record *r, void *p,
+                                   void (*deleter)(void *)) {
+  std::uint64_t epoch = global_epoch.load();
+  std::vector<Retired> &list = r->limbo[epoch % 3];
+  if (r->limbo_epoch[epoch % 3] != epoch) {
+    // Whatever is left in this slot was retired three or more epochs ago.
+    drain(list);
+    r->limbo_epoch[epoch % 3] = epoch;
+  }
+  list.push_back(Retired{p, deleter});
+
+  if (++r->retired_since_advance >= ADVANCE_INTERVAL) {
+    r->retired_since_advance = 0;
+    tryAdvance(epoch);
+    reclaim(r, global_epoch.load());
+  }
+}
+
+inline void EpochReclaimer::tryAdvance(std::uint64_t epoch) noexcept {
+  for (Record *r = records.load(); r; r = r->next) {
+    std::uint64_t local = r->local.load();
+    if (local != 0 && local != epoch) {
+      return;
+    }
+  }
+  global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+#endif
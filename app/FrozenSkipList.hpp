@@ -0,0 +1,317 @@
+#ifndef ___FROZEN_SKIP_LIST_HPP
+#define ___FROZEN_SKIP_LIST_HPP
+
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief An immutable copy of a SkipList in two flat arrays, for data that
+ * no longer changes once it is loaded.
+ *
+ * The keys are stored in Eytzinger order: the array is a complete binary
+ * search tree laid out breadth first, so the children of position i are
+ * at 2i and 2i + 1. A search goes down the tree one level per comparison,
+ * and the first few levels, which every search reads, pack into a handful
+ * of cache lines. Each step also prefetches the cache line that holds the
+ * node's descendants a few levels down. The values sit in a second array
+ * in the same order. Searches read only the keys, and finding a key costs
+ * one more access for its value.
+ *
+ * A key costs sizeof(Key) + sizeof(Value) bytes. There are no towers,
+ * pointers or spans. For unsigned keys and values that is about a seventh
+ * of a SkipList (see memoryUsage()).
+ *
+ * The lookups behave like the SkipList functions of the same name,
+ * throwing a RuntimeException wherever those do. The next and previous key
+ * of a position are its in-order neighbours in the tree, found with a few
+ * shifts.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class FrozenSkipList {
+public:
+  FrozenSkipList() : keys(1), values(1) {}
+
+  // Copies the keys and values of `sl`.
+  template <typename Allocator, typename Levels>
+  explicit FrozenSkipList(
+      const SkipList<Key, Value, Allocator, Levels, Compare> &sl);
+
+  std::size_t size() const noexcept { return keys.size() - 1; }
+  bool isEmpty() const noexcept { return size() == 0; }
+
+  bool contains(const Key &k) const;
+  const Value *tryFind(const Key &k) const;
+  const Value &find(const Key &k) const;
+  const Key *tryNextKey(const Key &k) const;
+  const Key *tryPreviousKey(const Key &k) const;
+  Key nextKey(const Key &k) const;
+  Key previousKey(const Key &k) const;
+  bool isSmallestKey(const Key &k) const;
+  bool isLargestKey(const Key &k) const;
+  const Key *smallestKey() const noexcept;
+  const Key *largestKey() const noexcept;
+  std::vector<Key> allKeysInOrder() const;
+
+  // Calls fn(key, value) for every key, in increasing order.
+  template <typename Fn> void forEach(Fn fn) const;
+
+  // The bytes this object and its arrays take up, counted the same way as
+  // SkipList::memoryUsage().
+  std::size_t memoryUsage() const noexcept;
+
+private:
+  template <typename K, typename V, typename A, typename L, typename C>
+  friend FrozenSkipList<K, V, C> freeze(SkipList<K, V, A, L, C> &&sl);
+
+  // Keys per cache line, which is how far ahead a search prefetches.
+  static constexpr std::size_t LINE_KEYS =
+      sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+
+  // Makes room for n keys, which `fill` then stores in increasing order.
+  void reserve(std::size_t n);
+  template <typename SkipListType, typename Take>
+  void fill(SkipListType &sl, Take take);
+
+  // Positions in the tree, 0 standing for "none".
+  std::size_t first() const noexcept;
+  std::size_t last() const noexcept;
+  std::size_t next(std::size_t i) const noexcept;
+  std::size_t previous(std::size_t i) const noexcept;
+  std::size_t lowerBound(const Key &k) const;
+  std::size_t position(const Key &k) const;
+
+  // Position 0 of both holds a default-constructed placeholder.
+  std::vector<Key> keys;
+  std::vector<Value> values;
+  Compare compare;
+};
+
+/**
+ * @brief Turns `sl` into a FrozenSkipList, moving the values out of it and
+ * leaving it empty.
+ */
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+FrozenSkipList<Key, Value, Compare>
+freeze(SkipList<Key, Value, Allocator, Levels, Compare> &&sl) {
+  FrozenSkipList<Key, Value, Compare> frozen;
+  frozen.reserve(sl.size());
+  frozen.fill(sl, [](Value &v) -> Value && { return std::move(v); });
+  sl.clear();
+  return frozen;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Allocator, typename Levels>
+FrozenSkipList<Key, Value, Compare>::FrozenSkipList(
+    const SkipList<Key, Value, Allocator, Levels, Compare> &sl) {
+  reserve(sl.size());
+  fill(sl, [](const Value &v) -> const Value & { return v; });
+}
+
+template <typename Key, typename Value, typename Compare>
+void FrozenSkipList<Key, Value, Compare>::reserve(std::size_t n) {
+  keys.assign(n + 1, Key());
+  values.assign(n + 1, Value());
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename SkipListType, typename Take>
+void FrozenSkipList<Key, Value, Compare>::fill(SkipListType &sl, Take take) {
+  // Visiting the positions in order places the keys in sorted order.
+  std::size_t i = first();
+  for (auto it = sl.begin(); it != sl.end(); ++it, i = next(i)) {
+    keys[i] = it.key();
+    values[i] = take(it.value());
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenSkipList<Key, Value, Compare>::first() const noexcept {
+  std::size_t i = 1;
+  while (2 * i <= size()) {
+    i = 2 * i;
+  }
+  return isEmpty() ? 0 : i;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenSkipList<Key, Value, Compare>::last() const noexcept {
+  std::size_t i = 1;
+  while (2 * i + 1 <= size()) {
+    i = 2 * i + 1;
+  }
+  return isEmpty() ? 0 : i;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t
+FrozenSkipList<Key, Value, Compare>::next(std::size_t i) const noexcept {
+  if (2 * i + 1 <= size()) {
+    // The leftmost position of the right subtree.
+    i = 2 * i + 1;
+    while (2 * i <= size()) {
+      i = 2 * i;
+    }
+    return i;
+  }
+  // Up past every right child, then up once more.
+  return i >> (trailingOnes(i) + 1);
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t
+FrozenSkipList<Key, Value, Compare>::previous(std::size_t i) const noexcept {
+  if (2 * i <= size()) {
+    i = 2 * i;
+    while (2 * i + 1 <= size()) {
+      i = 2 * i + 1;
+    }
+    return i;
+  }
+  return i >> (trailingOnes(~static_cast<std::uint64_t>(i)) + 1);
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t
+FrozenSkipList<Key, Value, Compare>::lowerBound(const Key &k) const {
+  // Go right past every key < k. The last time the walk went left was at
+  // the answer, and the trailing ones of i are the right turns after it.
+  const std::size_t n = size();
+  std::size_t i = 1;
+  while (i <= n) {
+    if (i * LINE_KEYS <= n) {
+      prefetchForRead(&keys[i * LINE_KEYS]);
+    }
+    i = 2 * i + (compare(keys[i], k) ? 1 : 0);
+  }
+  return i >> (trailingOnes(i) + 1);
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t
+FrozenSkipList<Key, Value, Compare>::position(const Key &k) const {
+  std::size_t i = lowerBound(k);
+  return i != 0 && !compare(k, keys[i]) ? i : 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenSkipList<Key, Value, Compare>::contains(const Key &k) const {
+  return position(k) != 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value *FrozenSkipList<Key, Value, Compare>::tryFind(const Key &k) const {
+  std::size_t i = position(k);
+  return i ? &values[i] : nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value &FrozenSkipList<Key, Value, Compare>::find(const Key &k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key *
+FrozenSkipList<Key, Value, Compare>::tryNextKey(const Key &k) const {
+  std::size_t i = position(k);
+  i = i ? next(i) : 0;
+  return i ? &keys[i] : nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key *
+FrozenSkipList<Key, Value, Compare>::tryPreviousKey(const Key &k) const {
+  std::size_t i = position(k);
+  i = i ? previous(i) : 0;
+  return i ? &keys[i] : nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+Key FrozenSkipList<Key, Value, Compare>::nextKey(const Key &k) const {
+  const Key *next_key = tryNextKey(k);
+
+  if (!next_key) {
+    throw RuntimeException("Key not found");
+  }
+
+  return *next_key;
+}
+
+template <typename Key, typename Value, typename Compare>
+Key FrozenSkipList<Key, Value, Compare>::previousKey(const Key &k) const {
+  const Key *previous_key = tryPreviousKey(k);
+
+  if (!previous_key) {
+    throw RuntimeException("Key not found");
+  }
+
+  return *previous_key;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenSkipList<Key, Value, Compare>::isSmallestKey(const Key &k) const {
+  std::size_t i = position(k);
+
+  if (i) {
+    return i == first();
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenSkipList<Key, Value, Compare>::isLargestKey(const Key &k) const {
+  std::size_t i = position(k);
+
+  if (i) {
+    return i == last();
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key *FrozenSkipList<Key, Value, Compare>::smallestKey() const noexcept {
+  return isEmpty() ? nullptr : &keys[first()];
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key *FrozenSkipList<Key, Value, Compare>::largestKey() const noexcept {
+  return isEmpty() ? nullptr : &keys[last()];
+}
+
+template <typename Key, typename Value, typename Compare>
+std::vector<Key> FrozenSkipList<Key, Value, Compare>::allKeysInOrder() const {
+  std::vector<Key> sorted;
+  sorted.reserve(size());
+  forEach([&sorted](const Key &k, const Value &) { sorted.push_back(k); });
+  return sorted;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Fn>
+void FrozenSkipList<Key, Value, Compare>::forEach(Fn fn) const {
+  for (std::size_t i = first(); i != 0; i = next(i)) {
+    fn(keys[i], values[i]);
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t
+FrozenSkipList<Key, Value, Compare>::memoryUsage() const noexcept {
+  return sizeof(*this) + keys.capacity() * sizeof(Key) +
+         values.capacity() * sizeof(Value);
+}
+
+#endif
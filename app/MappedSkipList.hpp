@@ -0,0 +1,171 @@
+#ifndef ___MAPPED_SKIP_LIST_HPP
+#define ___MAPPED_SKIP_LIST_HPP
+
+#include "SnapshotFormat.hpp"
+#include "runtimeexcept.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief A read-only view of a snapshot written by SkipList::save, served
+ * straight from the mapped file.
+ *
+ * Opening a view maps the file and checks its header; nothing is copied or
+ * rebuilt, so it is ready as soon as the constructor returns and the kernel
+ * only pages in what the lookups touch. Towers are made of pointers and are
+ * not part of the file, so lookups binary-search the mapped key array
+ * instead, which is O(log n) comparisons just like a search through the
+ * towers. The stored heights are still there for height(), and for
+ * SkipList::load to rebuild the same list later.
+ *
+ * A view must be opened with the same Compare that ordered the list when it
+ * was saved. It cannot be copied, and unmaps the file when destroyed.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class MappedSkipList {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+                    std::is_trivially_copyable<Value>::value,
+                "snapshots need trivially copyable keys and values");
+
+public:
+  // Maps the snapshot at `path`. Throws a RuntimeException if the file
+  // cannot be mapped or is not a snapshot of Key and Value.
+  explicit MappedSkipList(const std::string &path,
+                          const Compare &comparator = Compare());
+  MappedSkipList(const MappedSkipList &) = delete;
+  MappedSkipList &operator=(const MappedSkipList &) = delete;
+  ~MappedSkipList();
+
+  // These behave like the SkipList functions of the same name.
+  std::size_t size() const noexcept { return count; }
+  bool isEmpty() const noexcept { return count == 0; }
+  bool contains(const Key &k) const;
+  const Value *tryFind(const Key &k) const;
+  const Value &find(const Key &k) const;
+  unsigned height(const Key &k) const;
+  std::vector<Key> allKeysInOrder() const;
+
+  // The mapped arrays: keys()[i] is the i-th smallest key, values()[i] its
+  // value. Both hold size() elements and live as long as the view.
+  const Key *keys() const noexcept { return key_array; }
+  const Value *values() const noexcept { return value_array; }
+
+private:
+  // The index of k in key_array, or count if it is not there.
+  std::size_t indexOf(const Key &k) const;
+
+  void *mapping = nullptr;
+  std::size_t mapped_bytes = 0;
+  const Key *key_array = nullptr;
+  const Value *value_array = nullptr;
+  const unsigned char *heights = nullptr;
+  std::size_t count = 0;
+  Compare compare;
+};
+
+template <typename Key, typename Value, typename Compare>
+MappedSkipList<Key, Value, Compare>::MappedSkipList(const std::string &path,
+                                                    const Compare &comparator)
+    : compare(comparator) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw RuntimeException("Cannot open " + path);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      static_cast<std::uint64_t>(info.st_size) < sizeof(SnapshotHeader)) {
+    close(fd);
+    throw RuntimeException("Not a snapshot of this key and value type: " +
+                           path);
+  }
+
+  mapped_bytes = static_cast<std::size_t>(info.st_size);
+  mapping = mmap(nullptr, mapped_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    throw RuntimeException("Cannot map " + path);
+  }
+
+  const char *base = static_cast<const char *>(mapping);
+  const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(base);
+  if (!validSnapshotHeader(*header, sizeof(Key), sizeof(Value),
+                           mapped_bytes)) {
+    munmap(mapping, mapped_bytes);
+    throw RuntimeException("Not a snapshot of this key and value type: " +
+                           path);
+  }
+
+  count = static_cast<std::size_t>(header->count);
+  key_array = reinterpret_cast<const Key *>(base + header->keys_offset);
+  value_array = reinterpret_cast<const Value *>(base + header->values_offset);
+  heights =
+      reinterpret_cast<const unsigned char *>(base + header->heights_offset);
+}
+
+template <typename Key, typename Value, typename Compare>
+MappedSkipList<Key, Value, Compare>::~MappedSkipList() {
+  if (mapping) {
+    munmap(mapping, mapped_bytes);
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t MappedSkipList<Key, Value, Compare>::indexOf(const Key &k) const {
+  const Key *found = std::lower_bound(key_array, key_array + count, k, compare);
+  if (found == key_array + count || compare(k, *found)) {
+    return count;
+  }
+  return static_cast<std::size_t>(found - key_array);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedSkipList<Key, Value, Compare>::contains(const Key &k) const {
+  return indexOf(k) != count;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value *MappedSkipList<Key, Value, Compare>::tryFind(const Key &k) const {
+  std::size_t i = indexOf(k);
+  return i == count ? nullptr : &value_array[i];
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value &MappedSkipList<Key, Value, Compare>::find(const Key &k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+unsigned MappedSkipList<Key, Value, Compare>::height(const Key &k) const {
+  std::size_t i = indexOf(k);
+
+  if (i == count) {
+    throw RuntimeException("Key not found");
+  }
+
+  return heights[i];
+}
+
+template <typename Key, typename Value, typename Compare>
+std::vector<Key> MappedSkipList<Key, Value, Compare>::allKeysInOrder() const {
+  return std::vector<Key>(key_array, key_array + count);
+}
+
+#endif
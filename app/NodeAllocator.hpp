@@ -0,0 +1,284 @@
+#ifndef ___NODE_ALLOCATOR_HPP
+#define ___NODE_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * Node allocators for SkipList.
+ *
+ * A SkipList asks its allocator for raw memory, one block per tower, and
+ * constructs the node in place. Towers have different heights, so blocks
+ * have different sizes. Any type with the following members can be used as
+ * the `Allocator` parameter of SkipList:
+ *
+ *   void *allocate(std::size_t bytes);
+ *   void deallocate(void *p, std::size_t bytes) noexcept;
+ *   static constexpr bool releases_on_destruction;
+ *
+ * `deallocate` is always called with the same size that was passed to
+ * `allocate`. When `releases_on_destruction` is true the allocator frees
+ * everything it handed out when it is destroyed, so SkipList skips the
+ * per-node `deallocate` calls in its destructor (and skips walking the list
+ * entirely when the key and value types are trivially destructible).
+ *
+ * SkipList::merge and SkipList::split hand towers from one list to another
+ * without copying them, which needs one more member:
+ *
+ *   void share(Allocator &other);
+ *
+ * After a.share(b), every block a handed out so far stays valid as long as
+ * a or b lives, and may be deallocated through either. Only lists that are
+ * merged or split need it.
+ */
+
+/**
+ * @brief Hands every node to the global operator new / operator delete.
+ */
+class NewDeleteAllocator {
+public:
+  static constexpr bool releases_on_destruction = false;
+
+  void *allocate(std::size_t bytes) { return ::operator new(bytes); }
+
+  void deallocate(void *p, std::size_t) noexcept { ::operator delete(p); }
+
+  // Blocks do not belong to an allocator in the first place.
+  void share(NewDeleteAllocator &) noexcept {}
+};
+
+/**
+ * @brief Slab allocator that carves nodes out of large contiguous chunks.
+ *
+ * Allocation is a pointer bump in the current chunk. Chunks start at
+ * MIN_CHUNK_BYTES and double up to MAX_CHUNK_BYTES, so a list with millions
+ * of keys only performs a few thousand calls to operator new. Freed blocks
+ * go on a per-size free list and are handed out again before the chunk is
+ * bumped. Blocks larger than a quarter of MAX_CHUNK_BYTES get a chunk of
+ * their own and are returned to the system as soon as they are freed.
+ *
+ * Destroying the arena releases every chunk at once, except those it shares
+ * with another arena: share() moves its chunks into a reference-counted
+ * group that both arenas keep, so the towers one SkipList gives another
+ * outlive the list they came from. Blocks in those chunks still go on the
+ * free list of whichever arena they are deallocated to. A large block
+ * there stays reserved until the whole group is released.
+ */
+class NodeArena {
+public:
+  static constexpr bool releases_on_destruction = true;
+
+  static constexpr std::size_t ALIGNMENT = alignof(std::max_align_t);
+  static constexpr std::size_t MIN_CHUNK_BYTES = 16 * 1024;
+  static constexpr std::size_t MAX_CHUNK_BYTES = 2 * 1024 * 1024;
+  static constexpr std::size_t MAX_SMALL_BYTES = MAX_CHUNK_BYTES / 4;
+
+  NodeArena() = default;
+  NodeArena(const NodeArena &) = delete;
+  NodeArena &operator=(const NodeArena &) = delete;
+  ~NodeArena();
+
+  void *allocate(std::size_t bytes);
+  void deallocate(void *p, std::size_t bytes) noexcept;
+
+  // Keeps every block handed out so far alive for as long as this arena or
+  // `other` lives. If this throws, neither arena changes.
+  void share(NodeArena &other);
+
+  // Total bytes obtained from the system, including unused chunk space and
+  // the chunks shared with other arenas.
+  std::size_t reservedBytes() const noexcept;
+
+private:
+  // Every chunk starts with this header; the sizes of `large` chunks are
+  // stored so their neighbours can unlink them when they are freed.
+  struct Chunk {
+    Chunk *previous;
+    Chunk *next;
+    std::size_t bytes;
+    // Set once the chunk belongs to a SharedChunks group.
+    bool shared;
+  };
+
+  // Chunks that more than one arena hands blocks out of.
+  struct SharedChunks {
+    SharedChunks() = default;
+    SharedChunks(const SharedChunks &) = delete;
+    SharedChunks &operator=(const SharedChunks &) = delete;
+    ~SharedChunks();
+
+    Chunk *chunks = nullptr;
+    Chunk *large = nullptr;
+    std::size_t bytes = 0;
+  };
+
+  static void release(Chunk *list) noexcept;
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  static constexpr std::size_t HEADER_BYTES =
+      (sizeof(Chunk) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+  static std::size_t roundUp(std::size_t bytes) noexcept {
+    return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+  Chunk *newChunk(std::size_t bytes, Chunk *&list);
+
+  Chunk *chunks = nullptr;
+  Chunk *large = nullptr;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  std::size_t next_chunk_bytes = MIN_CHUNK_BYTES;
+  std::size_t reserved = 0;
+  // free_lists[i] holds freed blocks of exactly (i + 1) * ALIGNMENT bytes.
+  std::vector<FreeBlock *> free_lists;
+  std::vector<std::shared_ptr<SharedChunks>> shared;
+};
+
+inline void NodeArena::release(Chunk *list) noexcept {
+  while (list) {
+    Chunk *temp = list;
+    list = list->next;
+    ::operator delete(temp);
+  }
+}
+
+inline NodeArena::SharedChunks::~SharedChunks() {
+  release(chunks);
+  release(large);
+}
+
+inline NodeArena::~NodeArena() {
+  release(chunks);
+  release(large);
+}
+
+inline std::size_t NodeArena::reservedBytes() const noexcept {
+  std::size_t bytes = reserved;
+  for (const std::shared_ptr<SharedChunks> &group : shared) {
+    bytes += group->bytes;
+  }
+  return bytes;
+}
+
+inline void NodeArena::share(NodeArena &other) {
+  if (&other == this) {
+    return;
+  }
+
+  // Everything that can throw comes first.
+  std::shared_ptr<SharedChunks> group;
+  if (chunks || large) {
+    group = std::make_shared<SharedChunks>();
+    shared.reserve(shared.size() + 1);
+  }
+  other.shared.reserve(other.shared.size() + shared.size() + 1);
+
+  if (group) {
+    group->chunks = chunks;
+    group->large = large;
+    group->bytes = reserved;
+    for (Chunk *chunk = large; chunk; chunk = chunk->next) {
+      chunk->shared = true;
+    }
+    chunks = large = nullptr;
+    reserved = 0;
+    shared.push_back(std::move(group));
+  }
+
+  // The cursor still points into the last chunk, which only this arena
+  // goes on carving up.
+  other.shared.insert(other.shared.end(), shared.begin(), shared.end());
+  std::sort(other.shared.begin(), other.shared.end());
+  other.shared.erase(std::unique(other.shared.begin(), other.shared.end()),
+                     other.shared.end());
+}
+
+inline NodeArena::Chunk *NodeArena::newChunk(std::size_t bytes,
+                                             Chunk *&list) {
+  Chunk *chunk = static_cast<Chunk *>(::operator new(bytes));
+  chunk->previous = nullptr;
+  chunk->next = list;
+  chunk->bytes = bytes;
+  chunk->shared = false;
+  if (list) {
+    list->previous = chunk;
+  }
+  list = chunk;
+  reserved += bytes;
+  return chunk;
+}
+
+inline void *NodeArena::allocate(std::size_t bytes) {
+  bytes = roundUp(bytes);
+
+  if (bytes > MAX_SMALL_BYTES) {
+    Chunk *chunk = newChunk(HEADER_BYTES + bytes, large);
+    return reinterpret_cast<char *>(chunk) + HEADER_BYTES;
+  }
+
+  std::size_t index = bytes / ALIGNMENT - 1;
+  if (index < free_lists.size() && free_lists[index]) {
+    FreeBlock *block = free_lists[index];
+    free_lists[index] = block->next;
+    return block;
+  }
+
+  if (static_cast<std::size_t>(limit - cursor) < bytes) {
+    Chunk *chunk = newChunk(next_chunk_bytes, chunks);
+    cursor = reinterpret_cast<char *>(chunk) + HEADER_BYTES;
+    limit = reinterpret_cast<char *>(chunk) + chunk->bytes;
+    if (next_chunk_bytes < MAX_CHUNK_BYTES) {
+      next_chunk_bytes *= 2;
+    }
+  }
+
+  void *p = cursor;
+  cursor += bytes;
+  return p;
+}
+
+inline void NodeArena::deallocate(void *p, std::size_t bytes) noexcept {
+  bytes = roundUp(bytes);
+
+  if (bytes > MAX_SMALL_BYTES) {
+    Chunk *chunk =
+        reinterpret_cast<Chunk *>(static_cast<char *>(p) - HEADER_BYTES);
+    if (chunk->shared) {
+      return;
+    }
+    if (chunk->previous) {
+      chunk->previous->next = chunk->next;
+    } else {
+      large = chunk->next;
+    }
+    if (chunk->next) {
+      chunk->next->previous = chunk->previous;
+    }
+    reserved -= chunk->bytes;
+    ::operator delete(chunk);
+    return;
+  }
+
+  std::size_t index = bytes / ALIGNMENT - 1;
+  if (index >= free_lists.size()) {
+    try {
+      free_lists.resize(index + 1, nullptr);
+    } catch (...) {
+      // Without a free list slot the block simply stays unused until the
+      // arena is destroyed.
+      return;
+    }
+  }
+  FreeBlock *block = static_cast<FreeBlock *>(p);
+  block->next = free_lists[index];
+  free_lists[index] = block;
+}
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef ___SHARDED_SKIP_LIST_HPP
+#define ___SHARDED_SKIP_LIST_HPP
+
+#include "EpochReclaimer.hpp"
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A map from Key to Value split by key range across N independent
+ * SkipLists, so that threads working on different ranges never touch the
+ * same towers or the same lock.
+ *
+ * Shard i holds the keys in [splitter[i - 1], splitter[i]). The N - 1
+ * splitters sit in one small array that every operation binary-searches to
+ * find its shard, and each shard is a SkipList behind its own reader/writer
+ * lock. Lookups share the lock, so they run in parallel with each other;
+ * insert and erase hold it alone, but only for their own shard.
+ *
+ * A new list has no splitters yet and keeps everything in shard 0 until
+ * there is something to split. Whenever a shard grows well past its share of
+ * the keys, the insert that noticed moves half of it into its smaller
+ * neighbour, locking those two shards only; rebalance() evens out all of
+ * them the same way, one pair at a time. Moving keys changes the splitters,
+ * so the array is replaced rather than written to, and the old one is
+ * retired through an EpochReclaimer. An operation that routed itself with
+ * an old array sees that it was replaced once it holds the shard's lock,
+ * and routes again.
+ *
+ * Shards are read concurrently through the const functions of SkipList,
+ * which do not write to the list, so SKIPLIST_STATS must not be defined
+ * for a ShardedSkipList used by several threads.
+ */
+template <typename Key, typename Value, std::size_t N = 16>
+class ShardedSkipList {
+  static_assert(N >= 2, "a ShardedSkipList needs at least two shards");
+
+public:
+  // A shard with more keys than HOT_FACTOR times its share, and at least
+  // MIN_HOT_KEYS, is split with its neighbour.
+  static constexpr std::size_t HOT_FACTOR = 2;
+  static constexpr std::size_t MIN_HOT_KEYS = 4096;
+
+  ShardedSkipList();
+
+  // Starts with the given N - 1 splitters, which must be in increasing
+  // order, for key distributions that are known up front.
+  explicit ShardedSkipList(const std::vector<Key> &splitters);
+
+  ShardedSkipList(const ShardedSkipList &) = delete;
+  ShardedSkipList &operator=(const ShardedSkipList &) = delete;
+  ~ShardedSkipList();
+
+  // These behave like the SkipList functions of the same name. Values are
+  // copied out, since a reference into a shard would outlive its lock.
+  std::size_t size() const noexcept { return num_keys.load(); }
+  bool isEmpty() const noexcept { return size() == 0; }
+  bool insert(const Key &k, const Value &v);
+  bool erase(const Key &k);
+  bool contains(const Key &k) const;
+  bool find(const Key &k, Value &out) const;
+  Value find(const Key &k) const;
+
+  // The keys of every shard in turn, which is all of them in increasing
+  // order. The shards are locked for the whole walk, so the result is the
+  // contents of the list at one point in time.
+  std::vector<Key> allKeysInOrder() const;
+
+  // Calls fn(key, value) for every key, in increasing order, with every
+  // shard locked for reading. fn must not change the list.
+  template <typename Fn> void forEach(Fn fn) const;
+
+  // Moves keys between neighbouring shards until each holds about size() / N
+  // of them. Only two shards are locked at any time, so the others keep
+  // serving operations, which may leave the result slightly uneven.
+  void rebalance();
+
+  static constexpr std::size_t numShards() noexcept { return N; }
+
+  // The number of keys in each shard.
+  std::array<std::size_t, N> shardSizes() const;
+
+  // The splitters in use, in increasing order. Shard i holds the keys from
+  // splitters()[i - 1] up to splitters()[i]; the shards past the last one
+  // in use are empty.
+  std::vector<Key> splitters() const;
+
+private:
+  struct Layout {
+    std::array<Key, N - 1> splitters;
+    // Only splitters[0, bounded) are in use; the rest are +inf.
+    std::size_t bounded = 0;
+
+    // The shard that holds k.
+    std::size_t shardOf(const Key &k) const {
+      return static_cast<std::size_t>(
+          std::upper_bound(splitters.begin(), splitters.begin() + bounded,
+                           k) -
+          splitters.begin());
+    }
+  };
+
+  // A cache line each, so that threads working on different shards do not
+  // share one for their locks.
+  struct alignas(64) Shard {
+    mutable std::shared_mutex lock;
+    SkipList<Key, Value> list;
+    // list.size(), for reading without the lock.
+    std::atomic<std::size_t> keys{0};
+  };
+
+  // Locks the shard holding k with a Lock (unique or shared) and stores its
+  // index in `index`.
+  template <typename Lock>
+  Lock lockShardOf(const Key &k, std::size_t &index) const;
+
+  // Does shard s hold too many keys?
+  bool isHot(std::size_t s) const noexcept;
+
+  // Moves keys across splitter i until shard i holds `left_keys` of the
+  // keys in shards i and i + 1, as far as they allow. The keys move by
+  // split and merge, which relink their towers in one pass over the two
+  // shards instead of a search per key. rebalance_mutex must be held.
+  void moveSplitter(std::size_t i, std::size_t left_keys);
+
+  // Replaces the splitters; rebalance_mutex must be held.
+  void publish(const Layout &next);
+
+  std::array<Shard, N> shards;
+  std::atomic<Layout *> layout;
+  std::atomic<std::size_t> num_keys{0};
+  // Held by whoever moves keys between shards.
+  std::mutex rebalance_mutex;
+  mutable EpochReclaimer epochs;
+};
+
+template <typename Key, typename Value, std::size_t N>
+ShardedSkipList<Key, Value, N>::ShardedSkipList() : layout(new Layout()) {}
+
+template <typename Key, typename Value, std::size_t N>
+ShardedSkipList<Key, Value, N>::ShardedSkipList(
+    const std::vector<Key> &splitters)
+    : layout(nullptr) {
+  if (splitters.size() != N - 1) {
+    throw RuntimeException("A ShardedSkipList needs N - 1 splitters");
+  }
+  for (std::size_t i = 1; i < splitters.size(); i++) {
+    if (!(splitters[i - 1] < splitters[i])) {
+      throw RuntimeException("Splitters must be in increasing order");
+    }
+  }
+  Layout *initial = new Layout();
+  std::copy(splitters.begin(), splitters.end(), initial->splitters.begin());
+  initial->bounded = N - 1;
+  layout.store(initial);
+}
+
+template <typename Key, typename Value, std::size_t N>
+ShardedSkipList<Key, Value, N>::~ShardedSkipList() {
+  delete layout.load();
+}
+
+template <typename Key, typename Value, std::size_t N>
+template <typename Lock>
+Lock ShardedSkipList<Key, Value, N>::lockShardOf(const Key &k,
+                                                 std::size_t &index) const {
+  for (;;) {
+    EpochReclaimer::Guard guard = epochs.pin();
+    const Layout *current = layout.load();
+    std::size_t s = current->shardOf(k);
+    Lock lock(shards[s].lock);
+    // Splitters only change while the shards on both sides are locked, so
+    // if these are still the current ones, k belongs to shard s.
+    if (layout.load() == current) {
+      index = s;
+      return lock;
+    }
+  }
+}
+
+template <typename Key, typename Value, std::size_t N>
+bool ShardedSkipList<Key, Value, N>::insert(const Key &k, const Value &v) {
+  std::size_t s;
+  {
+    auto lock = lockShardOf<std::unique_lock<std::shared_mutex>>(k, s);
+    if (!shards[s].list.insert(k, v)) {
+      return false;
+    }
+    shards[s].keys.fetch_add(1);
+  }
+  num_keys.fetch_add(1);
+
+  if (isHot(s)) {
+    // Nobody waits for a rebalance: if one is running, it can have this
+    // shard next time.
+    std::unique_lock<std::mutex> balancer(rebalance_mutex, std::try_to_lock);
+    if (balancer.owns_lock() && isHot(s)) {
+      // Split it with the smaller of its neighbours, across splitter i.
+      std::size_t i = s;
+      if (s == N - 1 ||
+          (s > 0 && shards[s - 1].keys.load() < shards[s + 1].keys.load())) {
+        i = s - 1;
+      }
+      moveSplitter(i,
+                   (shards[i].keys.load() + shards[i + 1].keys.load()) / 2);
+    }
+  }
+  return true;
+}
+
+template <typename Key, typename Value, std::size_t N>
+bool ShardedSkipList<Key, Value, N>::erase(const Key &k) {
+  std::size_t s;
+  auto lock = lockShardOf<std::unique_lock<std::shared_mutex>>(k, s);
+  if (!shards[s].list.erase(k)) {
+    return false;
+  }
+  shards[s].keys.fetch_sub(1);
+  num_keys.fetch_sub(1);
+  return true;
+}
+
+template <typename Key, typename Value, std::size_t N>
+bool ShardedSkipList<Key, Value, N>::contains(const Key &k) const {
+  std::size_t s;
+  auto lock = lockShardOf<std::shared_lock<std::shared_mutex>>(k, s);
+  return shards[s].list.contains(k);
+}
+
+template <typename Key, typename Value, std::size_t N>
+bool ShardedSkipList<Key, Value, N>::find(const Key &k, Value &out) const {
+  std::size_t s;
+  auto lock = lockShardOf<std::shared_lock<std::shared_mutex>>(k, s);
+  const Value *value = shards[s].list.tryFind(k);
+  if (!value) {
+    return false;
+  }
+  out = *value;
+  return true;
+}
+
+template <typename Key, typename Value, std::size_t N>
+Value ShardedSkipList<Key, Value, N>::find(const Key &k) const {
+  Value value;
+  if (!find(k, value)) {
+    throw RuntimeException("Key not found");
+  }
+  return value;
+}
+
+template <typename Key, typename Value, std::size_t N>
+std::vector<Key> ShardedSkipList<Key, Value, N>::allKeysInOrder() const {
+  std::vector<Key> keys;
+  keys.reserve(size());
+  forEach([&keys](const Key &k, const Value &) { keys.push_back(k); });
+  return keys;
+}
+
+template <typename Key, typename Value, std::size_t N>
+template <typename Fn>
+void ShardedSkipList<Key, Value, N>::forEach(Fn fn) const {
+  // Shards are always locked in increasing order, here and when keys move,
+  // so holding all of them cannot deadlock.
+  std::vector<std::shared_lock<std::shared_mutex>> locks;
+  locks.reserve(N);
+  for (const Shard &shard : shards) {
+    locks.emplace_back(shard.lock);
+  }
+  for (const Shard &shard : shards) {
+    for (auto it = shard.list.begin(); it != shard.list.end(); ++it) {
+      fn(it.key(), it.value());
+    }
+  }
+}
+
+template <typename Key, typename Value, std::size_t N>
+bool ShardedSkipList<Key, Value, N>::isHot(std::size_t s) const noexcept {
+  std::size_t keys = shards[s].keys.load();
+  return keys >= MIN_HOT_KEYS && keys > HOT_FACTOR * (size() / N + 1);
+}
+
+template <typename Key, typename Value, std::size_t N>
+void ShardedSkipList<Key, Value, N>::rebalance() {
+  std::lock_guard<std::mutex> balancer(rebalance_mutex);
+  std::size_t total = size();
+  // Shards 0 to i should end up with target(i) keys between them.
+  auto target = [total](std::size_t i) { return (i + 1) * total / N; };
+
+  // Right to left, trim every suffix of shards to at most its share. Each
+  // shard then holds enough keys for the second pass to hand out from the
+  // left, which leaves every prefix at exactly its share.
+  std::size_t suffix = 0;
+  for (std::size_t i = N - 1; i-- > 0;) {
+    std::size_t left = shards[i].keys.load();
+    std::size_t right = shards[i + 1].keys.load();
+    std::size_t room = total - target(i);
+    std::size_t keep = room > suffix ? room - suffix : 0;
+    if (right > keep) {
+      moveSplitter(i, left + right - keep);
+    }
+    suffix += shards[i + 1].keys.load();
+  }
+
+  std::size_t prefix = 0;
+  for (std::size_t i = 0; i + 1 < N; i++) {
+    std::size_t share = target(i) > prefix ? target(i) - prefix : 0;
+    if (shards[i].keys.load() > share) {
+      moveSplitter(i, share);
+    }
+    prefix += shards[i].keys.load();
+  }
+}
+
+template <typename Key, typename Value, std::size_t N>
+void ShardedSkipList<Key, Value, N>::moveSplitter(std::size_t i,
+                                                  std::size_t left_keys) {
+  std::unique_lock<std::shared_mutex> lock_left(shards[i].lock);
+  std::unique_lock<std::shared_mutex> lock_right(shards[i + 1].lock);
+  SkipList<Key, Value> &left = shards[i].list;
+  SkipList<Key, Value> &right = shards[i + 1].list;
+  Layout next = *layout.load();
+
+  if (left_keys < left.size()) {
+    // The largest keys of the left shard go to the front of the right one.
+    next.splitters[i] = left.select(left_keys);
+    next.bounded = std::max(next.bounded, i + 1);
+    SkipList<Key, Value> moved;
+    left.split(next.splitters[i], moved);
+    right.merge(std::move(moved));
+  } else if (left_keys > left.size() && !right.isEmpty()) {
+    // The smallest keys of the right shard are appended to the left one.
+    std::size_t moved = std::min(left_keys - left.size(), right.size());
+    SkipList<Key, Value> rest;
+    if (moved < right.size()) {
+      next.splitters[i] = right.select(moved);
+      right.split(next.splitters[i], rest);
+    } else if (i + 1 < next.bounded) {
+      next.splitters[i] = next.splitters[i + 1];
+    } else {
+      next.bounded = i;
+    }
+    left.merge(std::move(right));
+    right.merge(std::move(rest));
+  } else {
+    return;
+  }
+
+  shards[i].keys.store(left.size());
+  shards[i + 1].keys.store(right.size());
+  publish(next);
+}
+
+template <typename Key, typename Value, std::size_t N>
+void ShardedSkipList<Key, Value, N>::publish(const Layout &next) {
+  EpochReclaimer::Guard guard = epochs.pin();
+  Layout *old = layout.exchange(new Layout(next));
+  guard.retire(old, [](void *p) { delete static_cast<Layout *>(p); });
+}
+
+template <typename Key, typename Value, std::size_t N>
+std::array<std::size_t, N>
+ShardedSkipList<Key, Value, N>::shardSizes() const {
+  std::array<std::size_t, N> sizes;
+  for (std::size_t s = 0; s < N; s++) {
+    sizes[s] = shards[s].keys.load();
+  }
+  return sizes;
+}
+
+template <typename Key, typename Value, std::size_t N>
+std::vector<Key> ShardedSkipList<Key, Value, N>::splitters() const {
+  EpochReclaimer::Guard guard = epochs.pin();
+  const Layout *current = layout.load();
+  return std::vector<Key>(current->splitters.begin(),
+                          current->splitters.begin() + current->bounded);
+}
+
+#endif
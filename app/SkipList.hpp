@@ -1,12 +1,27 @@
 #ifndef ___SKIP_LIST_HPP
 #define ___SKIP_LIST_HPP
 
+#include "NodeAllocator.hpp"
+#include "SnapshotFormat.hpp"
 #include "runtimeexcept.hpp"
-#include <cmath> // for log2
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <iostream>
+#include <new>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#if __cplusplus > 201703L && __has_include(<compare>)
+#include <compare>
+#endif
 
 /**
  * flipCoin -- NOTE: Only read if you are interested in how the
@@ -110,7 +125,7 @@ inline bool flipCoin(unsigned key, unsigned previousFlips) {
  * @return true simulates a "heads" from a coin flip
  * @return false simulates a "tails" from a coin flip
  */
-inline bool flipCoin(std::string key, unsigned previousFlips) {
+inline bool flipCoin(const std::string &key, unsigned previousFlips) {
   char c = key[0];
   for (unsigned j = 1; j < key.length(); j++) {
     c = c ^ key[j];
@@ -119,33 +134,699 @@ inline bool flipCoin(std::string key, unsigned previousFlips) {
   return (c & (1 << previousFlips)) != 0;
 }
 
+/**
+ * @brief The number of trailing one bits in `bits`, i.e. how many heads
+ * come up before the first tails when each bit is one coin flip.
+ */
+inline unsigned trailingOnes(std::uint64_t bits) noexcept {
+  bits = ~bits;
+  if (bits == 0) {
+    return 64;
+  }
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(bits);
+#else
+  unsigned count = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+/**
+ * @brief The splitmix64 finalizer: a cheap bijection on 64-bit words whose
+ * output bits each depend on every input bit.
+ */
+inline std::uint64_t mixBits(std::uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * @brief The number of bits needed to write `n`, i.e. ceil(log2(n + 1)),
+ * and 0 for 0.
+ */
+inline unsigned bitWidth(std::uint64_t n) noexcept {
+  if (n == 0) {
+    return 0;
+  }
+#if defined(__GNUC__) || defined(__clang__)
+  return 64 - __builtin_clzll(n);
+#else
+  unsigned width = 0;
+  while (n != 0) {
+    n >>= 1;
+    width++;
+  }
+  return width;
+#endif
+}
+
+/**
+ * @brief The cap on the number of layers a tower may occupy in a skip list
+ * holding `n` keys: 12 while there are at most 16 keys, and
+ * 3 * ceil(log2(n)) after that.
+ *
+ * ceil(log2(n)) is the bit width of n - 1, so this is integer arithmetic
+ * and cheap enough to recompute on every insert.
+ */
+inline unsigned maxFlipsFor(std::size_t n) noexcept {
+  if (n <= 16) {
+    return 12;
+  } else {
+    return 3 * bitWidth(n - 1);
+  }
+}
+
+/**
+ * @brief The byte flipCoin XORs together for `bytes`: each flip reads one
+ * of its bits. Folds eight bytes at a time.
+ */
+inline unsigned char xorFold(const char *bytes, std::size_t length) noexcept {
+  std::uint64_t word = 0;
+  std::size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    std::uint64_t chunk;
+    std::memcpy(&chunk, bytes + i, 8);
+    word ^= chunk;
+  }
+  unsigned char c = 0;
+  for (; i < length; i++) {
+    c ^= static_cast<unsigned char>(bytes[i]);
+  }
+  word ^= word >> 32;
+  word ^= word >> 16;
+  word ^= word >> 8;
+  return c ^ static_cast<unsigned char>(word);
+}
+
+/**
+ * @brief Flips coins for `key` until one comes up tails or the tower reaches
+ * `max_flips` layers.
+ *
+ * @return the number of layers the key's tower occupies (at least 1)
+ */
+template <typename Key>
+unsigned flipCoinLevels(const Key &key, unsigned max_flips) {
+  unsigned height = 0;
+  while (flipCoin(key, height) && height + 1 < max_flips) {
+    height++;
+  }
+  return height + 1;
+}
+
+/**
+ * @brief flipCoinLevels for a key whose coins are the bits of `c`, flip
+ * `i` reading bit i % 8: all the flips at once. Every flip comes up heads
+ * for 0xFF, so those towers reach the cap.
+ */
+inline unsigned flipCoinLevelsOf(unsigned char c, unsigned max_flips) noexcept {
+  unsigned height = c == 0xFF ? max_flips : trailingOnes(c) + 1;
+  return height < max_flips ? height : max_flips;
+}
+
+// The same heights as the loop above for the two flipCoin overloads, from
+// one fold of the key.
+inline unsigned flipCoinLevels(unsigned key, unsigned max_flips) noexcept {
+  key ^= key >> 16;
+  key ^= key >> 8;
+  return flipCoinLevelsOf(static_cast<unsigned char>(key), max_flips);
+}
+
+inline unsigned flipCoinLevels(const std::string &key,
+                               unsigned max_flips) noexcept {
+  return flipCoinLevelsOf(xorFold(key.data(), key.size()), max_flips);
+}
+
+/*
+ * Level generators.
+ *
+ * The last template parameter of SkipList decides how tall each new tower
+ * is. A level generator is any class with a member
+ *
+ *   template <typename Key>
+ *   unsigned operator()(const Key &key, unsigned max_flips);
+ *
+ * returning a height in [1, max_flips]. The list owns one generator and
+ * calls it once per inserted key, so a generator may keep state.
+ */
+
+/**
+ * @brief The project's deterministic rule: the heights flipCoin produces.
+ *
+ * A key's height only depends on the XOR of its bytes, so this is what the
+ * unit tests expect, but keys that collide in those eight bits all get the
+ * same tower. Use one of the generators below for real workloads.
+ */
+struct FlipCoinLevels {
+  template <typename Key>
+  unsigned operator()(const Key &key, unsigned max_flips) const {
+    return flipCoinLevels(key, max_flips);
+  }
+};
+
+/**
+ * @brief Deterministic, hash-based heights.
+ *
+ * The key is hashed once with `Hash`, the result is mixed so that every bit
+ * is a fair coin, and the trailing one bits are all the flips at once. The
+ * same key always gets the same height, but nearby or structured keys no
+ * longer share one.
+ */
+template <typename Hash = void> struct HashedLevels {
+  template <typename Key>
+  unsigned operator()(const Key &key, unsigned max_flips) const {
+    using H = std::conditional_t<std::is_void<Hash>::value, std::hash<Key>,
+                                 Hash>;
+    std::uint64_t bits = mixBits(static_cast<std::uint64_t>(H()(key)));
+    unsigned height = trailingOnes(bits) + 1;
+    return height < max_flips ? height : max_flips;
+  }
+};
+
+/**
+ * @brief Random heights from a seeded xorshift64* generator.
+ *
+ * Heights do not depend on the keys at all, which is the textbook skip list.
+ * Two lists built with the same seed from the same sequence of inserts have
+ * the same shape.
+ */
+class RandomLevels {
+public:
+  explicit RandomLevels(std::uint64_t seed = 0x2545F4914F6CDD1Dull) noexcept
+      : state(mixBits(seed) | 1) {}
+
+  template <typename Key>
+  unsigned operator()(const Key &, unsigned max_flips) noexcept {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    unsigned height = trailingOnes(state * 0x2545F4914F6CDD1Dull) + 1;
+    return height < max_flips ? height : max_flips;
+  }
+
+private:
+  std::uint64_t state;
+};
+
+/**
+ * @brief Hints that *p will be read soon. A no-op on compilers without
+ * __builtin_prefetch.
+ */
+inline void prefetchForRead(const void *p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p, 0, 3);
+#else
+  (void)p;
+#endif
+}
+
+/**
+ * @brief How many threads a parallel operation over `n` items should start
+ * when asked for `threads` (0 meaning one per hardware thread), so that
+ * each gets at least `grain` items.
+ */
+inline unsigned parallelParts(std::size_t n, unsigned threads,
+                              std::size_t grain) noexcept {
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  std::size_t parts = grain == 0 ? n : n / grain;
+  if (parts > threads) {
+    parts = threads;
+  }
+  return parts > 1 ? static_cast<unsigned>(parts) : 1;
+}
+
+/**
+ * @brief Calls fn(i) for every i < parts, each on a thread of its own
+ * except the last, which runs on the calling thread. Waits for all of them,
+ * then rethrows the first exception any of them threw.
+ */
+template <typename Fn> void runInParallel(unsigned parts, Fn fn) {
+  std::vector<std::exception_ptr> errors(parts);
+  std::vector<std::thread> workers;
+  workers.reserve(parts);
+  auto run = [&fn, &errors](unsigned i) {
+    try {
+      fn(i);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  for (unsigned i = 0; i + 1 < parts; i++) {
+    workers.emplace_back(run, i);
+  }
+  if (parts > 0) {
+    run(parts - 1);
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  for (std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+/**
+ * @brief A single tower of the skip list.
+ *
+ * Every key is stored exactly once, in one allocation that also holds the
+ * tower's forward pointers. `next[i]` is the successor of this key in layer
+ * S_i, and the node is over-allocated so that `next[0]` through
+ * `next[levels - 1]` are all valid. Only the bottom layer is doubly linked
+ * (through `previous`); that is all `previousKey` and friends need.
+ *
+ * After the forward pointers come `levels` span counts: `span()[i]` is how
+ * many S_0 steps `next[i]` is ahead of this node, which is what the
+ * order-statistic queries add up.
+ *
+ * Nodes must be made with `create` and released with `destroy`, which take
+ * their memory from a SkipList allocator (see NodeAllocator.hpp); they are
+ * never constructed directly. `construct` is for memory that was taken
+ * from the allocator beforehand.
+ */
 template <typename Key, typename Value> struct SkipNode {
   Key key;
   Value value;
-  bool p_inf = false;
-  bool n_inf = false;
-  SkipNode<Key, Value> *next = nullptr;
+  unsigned levels;
   SkipNode<Key, Value> *previous = nullptr;
-  SkipNode<Key, Value> *top = nullptr;
-  SkipNode<Key, Value> *bottom = nullptr;
-  SkipNode<Key, Value>(Key k, Value v) : key(k), value(v) {}
-  SkipNode<Key, Value>() : key(Key()), value(Value()) {}
+  SkipNode<Key, Value> *next[1];
+
+  // Number of bytes needed for a tower that occupies `levels` layers.
+  static std::size_t bytes(unsigned levels) noexcept {
+    return sizeof(SkipNode<Key, Value>) +
+           (levels - 1) * sizeof(SkipNode<Key, Value> *) +
+           levels * sizeof(std::size_t);
+  }
+
+  std::size_t *span() noexcept {
+    return reinterpret_cast<std::size_t *>(next + levels);
+  }
+
+  // Builds the key from k and the value from args directly in the node.
+  template <typename Allocator, typename K, typename... Args>
+  static SkipNode<Key, Value> *create(Allocator &alloc, unsigned levels,
+                                      K &&k, Args &&...args) {
+    void *memory = alloc.allocate(bytes(levels));
+    SkipNode<Key, Value> *node;
+    try {
+      node = construct(memory, levels, std::forward<K>(k),
+                       std::forward<Args>(args)...);
+    } catch (...) {
+      alloc.deallocate(memory, bytes(levels));
+      throw;
+    }
+    return node;
+  }
+
+  // The same in memory already taken from an allocator, which must be at
+  // least bytes(levels) long. Nothing is freed if the constructors throw.
+  template <typename K, typename... Args>
+  static SkipNode<Key, Value> *construct(void *memory, unsigned levels, K &&k,
+                                         Args &&...args) {
+    return new (memory) SkipNode<Key, Value>(levels, std::forward<K>(k),
+                                             std::forward<Args>(args)...);
+  }
+
+  template <typename Allocator>
+  static SkipNode<Key, Value> *create(Allocator &alloc, unsigned levels) {
+    return create(alloc, levels, Key());
+  }
+
+  template <typename Allocator>
+  static void destroy(Allocator &alloc, SkipNode<Key, Value> *node) noexcept {
+    unsigned levels = node->levels;
+    node->~SkipNode<Key, Value>();
+    alloc.deallocate(node, bytes(levels));
+  }
+
+  // Runs the destructor without returning the memory, for allocators that
+  // release all of their memory at once.
+  static void destroyInPlace(SkipNode<Key, Value> *node) noexcept {
+    node->~SkipNode<Key, Value>();
+  }
+
+private:
+  template <typename K, typename... Args>
+  SkipNode(unsigned l, K &&k, Args &&...args)
+      : key(std::forward<K>(k)), value(std::forward<Args>(args)...),
+        levels(l) {
+    static_assert(sizeof(SkipNode<Key, Value> *) % alignof(std::size_t) == 0,
+                  "span counts must be aligned after the forward pointers");
+    for (unsigned i = 0; i < levels; i++) {
+      next[i] = nullptr;
+      span()[i] = 0;
+    }
+  }
+  ~SkipNode() = default;
+};
+
+/**
+ * @brief Three-way comparison of two keys under the natural order: negative
+ * if a < b, zero if they are equivalent and positive if a > b.
+ *
+ * Strings use std::string::compare, which walks the common prefix once
+ * instead of once per `<`. Under C++20, types that are
+ * std::three_way_comparable_with each other use operator<=>; everything
+ * else takes two `<`, which for built-in types is as cheap as one.
+ */
+inline int threeWay(const std::string &a, const std::string &b) noexcept {
+  return a.compare(b);
+}
+
+template <typename A, typename B> int threeWay(const A &a, const B &b) {
+#if defined(__cpp_lib_three_way_comparison) &&                              \
+    __cpp_lib_three_way_comparison >= 201907L
+  if constexpr (std::three_way_comparable_with<A, B>) {
+    auto order = a <=> b;
+    return order < 0 ? -1 : order > 0 ? 1 : 0;
+  } else {
+    return (b < a) - (a < b);
+  }
+#else
+  return (b < a) - (a < b);
+#endif
+}
+
+/**
+ * @brief True when std::less<T> is known to be the natural order, because
+ * a program may not specialize it: for built-in arithmetic types,
+ * std::string and std::less<void>. For any other T, std::less<T> may be a
+ * specialization with an order of its own.
+ */
+template <typename T>
+struct HasNaturalLess
+    : std::integral_constant<bool, std::is_arithmetic<T>::value ||
+                                       std::is_same<T, std::string>::value ||
+                                       std::is_void<T>::value> {};
+
+/**
+ * @brief Three-way comparison of two keys under `compare`.
+ *
+ * An arbitrary comparator only answers "is a before b?", so this asks twice.
+ * std::less of the types HasNaturalLess knows follows the natural order,
+ * which threeWay gets in a single pass.
+ */
+template <typename Compare, typename A, typename B>
+int threeWayCompare(const Compare &compare, const A &a, const B &b) {
+  return compare(a, b) ? -1 : compare(b, a) ? 1 : 0;
+}
+
+template <typename T, typename A, typename B>
+int threeWayCompare(const std::less<T> &compare, const A &a, const B &b) {
+  if constexpr (HasNaturalLess<T>::value) {
+    return threeWay(a, b);
+  } else {
+    return compare(a, b) ? -1 : compare(b, a) ? 1 : 0;
+  }
+}
+
+/**
+ * @brief Has a member `type` (equal to K) when Compare is transparent, i.e.
+ * declares `is_transparent` the way std::less<> does, and so can order Key
+ * against other types directly.
+ */
+template <typename Compare, typename K, typename = void>
+struct EnableIfTransparent {};
+
+template <typename Compare, typename K>
+struct EnableIfTransparent<Compare, K,
+                           std::void_t<typename Compare::is_transparent>> {
+  using type = K;
 };
 
-template <typename Key, typename Value> class SkipList {
+// Defining SKIPLIST_STATS before including this header turns on the
+// counters behind SkipList::stats(). Without it SKIPLIST_STAT drops its
+// argument, so the counting costs nothing. The macro changes the layout of
+// SkipList, so translation units sharing a SkipList type must agree on it.
+#ifdef SKIPLIST_STATS
+#define SKIPLIST_STAT(...) __VA_ARGS__
+#else
+#define SKIPLIST_STAT(...)
+#endif
+
+// `Allocator` supplies the memory for the towers; see NodeAllocator.hpp for
+// the interface. The default NodeArena carves nodes out of large chunks and
+// frees them all at once when the list is destroyed.
+//
+// `Levels` picks the height of each new tower; see the level generators
+// above. The default reproduces flipCoin.
+//
+// `Compare` orders the keys: compare(a, b) is true when a comes before b.
+// With a transparent comparator such as std::less<>, the lookups also
+// accept any type the comparator can order against Key.
+template <typename Key, typename Value, typename Allocator = NodeArena,
+          typename Levels = FlipCoinLevels,
+          typename Compare = std::less<Key>>
+class SkipList {
+
+public:
+  // Upper bound on numLayers(). A tower is capped at 3 * ceil(log2(n))
+  // layers, so even 2^64 keys need at most 192 layers plus the empty top.
+  static constexpr unsigned MAX_LAYERS = 3 * 64 + 1;
+
+  // How many searches findBatch keeps in flight at once.
+  static constexpr std::size_t BATCH_LANES = 16;
+
+  class Finger;
 
 private:
   // private variables go here.
   unsigned num_layers;
   std::size_t num_keys;
+  // Bumped by every change to the towers or links, so that a Finger can
+  // tell whether its path is still exactly where its last search left it.
+  std::uint64_t modifications = 0;
+  // `head` has a forward pointer for every possible layer, all of which
+  // point at `tail` until a tower reaches that layer. Both are nodes so that
+  // they can be linked like any other, but only their addresses matter:
+  // reaching `tail` ends a layer, and no search reads either one's key.
   SkipNode<Key, Value> *head;
   SkipNode<Key, Value> *tail;
+  Allocator alloc;
+  Levels level_generator;
+  Compare compare;
+
+  // Enables the heterogeneous lookups for K.
+  template <typename K>
+  using Transparent = typename EnableIfTransparent<Compare, K>::type;
+
+  // Returns the node in S_0 holding the largest key <= k (or head). K is
+  // Key, or with a transparent Compare anything Compare accepts with Key.
+  template <typename K> SkipNode<Key, Value> *locate(const K &k) const;
+
+  // Returns the node in S_0 holding the largest key < k (or head).
+  template <typename K> SkipNode<Key, Value> *locateBefore(const K &k) const;
+
+  // Points f.path at the predecessors of k on every layer and returns the
+  // first node whose key is >= k (or tail), starting from f if it is usable.
+  SkipNode<Key, Value> *seek(const Key &k, Finger &f) const;
+
+  // Calls emit(i, node) with the node holding keys[i], or nullptr when it
+  // is missing, for every i < n. Runs up to BATCH_LANES searches in lock
+  // step so that their cache misses overlap, or walks a finger when keys is
+  // sorted.
+  template <typename Emit>
+  void findNodes(const Key *keys, std::size_t n, Emit emit) const;
+
+  // Returns the node in S_0 holding k, or nullptr if k is not in the list.
+  template <typename K> SkipNode<Key, Value> *findNode(const K &k) const;
+
+  // Allocates a tower holding k and a value built from args, and splices
+  // it in after update[i] on every layer it occupies, adding layers at the
+  // top when needed. update[i] must be set for every current layer, since
+  // the spans of links passing over the tower change too.
+  template <typename K, typename... Args>
+  SkipNode<Key, Value> *link(SkipNode<Key, Value> **update, unsigned levels,
+                             K &&k, Args &&...args);
+
+  // The height of a new tower for k in a list about to hold one more key,
+  // i.e. level_generator(k, max_flips).
+  unsigned drawHeight(const Key &k, unsigned max_flips);
+
+  // Returns the tower holding k and false if there is one. Otherwise links
+  // in a new tower for k and a value built from args, and returns it and
+  // true. K is Key, possibly an rvalue.
+  template <typename K, typename... Args>
+  std::pair<SkipNode<Key, Value> *, bool> insertNode(K &&k, Args &&...args);
+
+  // Unlinks `node` from every layer it occupies, given its predecessors in
+  // update[], frees it and drops layers left empty at the top. Returns the
+  // node that followed it in S_0.
+  SkipNode<Key, Value> *unlink(SkipNode<Key, Value> **update,
+                               SkipNode<Key, Value> *node);
 
 public:
+  // Bidirectional iterator over S_0 in increasing key order. Dereferencing
+  // yields a pair of references to the key and value stored in the tower,
+  // so iterating never copies either. Iterators stay valid until the node
+  // they refer to is removed from the list.
+  template <bool IsConst> class basic_iterator {
+  public:
+    using mapped_type = std::conditional_t<IsConst, const Value, Value>;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::pair<const Key, Value>;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::pair<const Key &, mapped_type &>;
+
+    // operator-> has to hand out the address of a reference pair, so it
+    // returns one of these by value.
+    struct pointer {
+      reference ref;
+      reference *operator->() { return &ref; }
+    };
+
+    basic_iterator() = default;
+
+    // An iterator converts to a const_iterator, not the other way around.
+    template <bool WasConst,
+              typename = std::enable_if_t<IsConst && !WasConst>>
+    basic_iterator(const basic_iterator<WasConst> &other)
+        : node(other.node) {}
+
+    const Key &key() const { return node->key; }
+    mapped_type &value() const { return node->value; }
+    // The height of this key's tower, as height(key()) would return.
+    unsigned height() const { return node->levels; }
+
+    reference operator*() const { return reference(node->key, node->value); }
+    pointer operator->() const { return pointer{**this}; }
+
+    basic_iterator &operator++() {
+      node = node->next[0];
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator temp = *this;
+      ++*this;
+      return temp;
+    }
+    basic_iterator &operator--() {
+      node = node->previous;
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator temp = *this;
+      --*this;
+      return temp;
+    }
+
+    template <bool OtherConst>
+    bool operator==(const basic_iterator<OtherConst> &other) const {
+      return node == other.node;
+    }
+    template <bool OtherConst>
+    bool operator!=(const basic_iterator<OtherConst> &other) const {
+      return node != other.node;
+    }
+
+  private:
+    friend class SkipList;
+    template <bool> friend class basic_iterator;
+
+    explicit basic_iterator(SkipNode<Key, Value> *n) : node(n) {}
+
+    SkipNode<Key, Value> *node = nullptr;
+  };
+
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  // A search finger: the path taken by the last hinted search. Passing the
+  // same Finger to successive find/insert/lower_bound calls lets each search
+  // start where the previous one ended, climbing only as many layers as the
+  // distance d between the two keys requires. Searches for keys at or after
+  // the previous one cost O(log d); a search that moves backwards starts
+  // over from the top of the list. The list may change between two uses of
+  // a Finger; the first search after a change checks every layer of the
+  // path, which costs O(log n) once.
+  //
+  // A Finger belongs to one list at a time and is refreshed by every call
+  // it is passed to. It must not be used after a key on its path is
+  // removed from the list.
+  class Finger {
+  public:
+    Finger() = default;
+
+  private:
+    friend class SkipList;
+
+    const SkipList *owner = nullptr;
+    // Number of layers the list had when `path` was recorded.
+    unsigned layers = 0;
+    // The list's modification count when `path` was recorded.
+    std::uint64_t version = 0;
+    // path[i] is the last node in S_i with a key smaller than the most
+    // recent search key (head if there is none).
+    SkipNode<Key, Value> *path[MAX_LAYERS];
+  };
+
+  // A lookup that runs one step at a time, for callers that interleave
+  // many of them the way findBatch does, but across requests: a scheduler
+  // (such as LookupExecutor in AsyncLookup.hpp) calls step() on each
+  // unfinished Search in turn. Every step moves along a layer or down one,
+  // then prefetches the node the next step reads, so that by the time the
+  // Search gets its next turn that node has had a whole round of other
+  // searches to arrive from memory.
+  //
+  // A Search refers to the list and to the key it was made with, so both
+  // must outlive it, and the list must not change until it is done.
+  class Search {
+  public:
+    Search() = default;
+
+    bool done() const noexcept { return finished; }
+
+    // Takes one step of the search, or none once it is done. Returns
+    // done().
+    bool step();
+
+    // Once done: whether the key was found, its value (nullptr if it was
+    // not) and lower_bound of the key.
+    bool found() const noexcept { return hit; }
+    const Value *value() const noexcept { return hit ? &node->value : nullptr; }
+    const_iterator position() const noexcept { return const_iterator(node); }
+
+  private:
+    friend class SkipList;
+
+    Search(const SkipList *l, const Key *k) noexcept;
+
+    const SkipList *list = nullptr;
+    const Key *key = nullptr;
+    // Before the search is done, the node it stands on and the layer it is
+    // walking; after, the first node with a key >= *key.
+    SkipNode<Key, Value> *node = nullptr;
+    unsigned level = 0;
+    bool finished = true;
+    bool hit = false;
+  };
+
   SkipList();
 
+  // Starts an empty list whose towers are sized by `generator`, for level
+  // generators that take parameters such as a seed, and whose keys are
+  // ordered by `comparator`.
+  explicit SkipList(const Levels &generator,
+                    const Compare &comparator = Compare());
+
+  // Builds the list from the range [first, last) of key/value pairs (any
+  // element type with `first` and `second` members). See bulkLoad.
+  template <typename InputIt> SkipList(InputIt first, InputIt last);
+
   // You DO NOT need to implement a copy constructor or an assignment
   // operator.
+  SkipList(const SkipList &) = delete;
+  SkipList &operator=(const SkipList &) = delete;
 
   ~SkipList();
 
@@ -194,7 +875,7 @@ public:
   // These return the value associated with the given key.
   // Throw a RuntimeException if the key does not exist.
   Value &find(const Key &k);
-  const Value &find(Key k) const;
+  const Value &find(const Key &k) const;
 
   // Return true if this key/value pair is successfully inserted, false
   // otherwise. See the project write-up for conditions under which the key
@@ -202,9 +883,67 @@ public:
   // not insert one -- return false.
   bool insert(const Key &k, const Value &v);
 
+  // The same, moving from the arguments instead of copying them.
+  bool insert(const Key &k, Value &&v);
+  bool insert(Key &&k, Value &&v);
+
+  // std::map-style insertion. Each of these makes one search, constructs
+  // the value in place in the new tower and returns an iterator to the
+  // key's tower along with whether it was inserted. When the key is
+  // already present, no node is built and args are left untouched.
+  //
+  // emplace(k, args...) builds the key from k and the value from args.
+  // try_emplace is the same for a k that already is a Key.
+  // insert_or_assign(k, obj) inserts (k, obj), or assigns obj to the value
+  // already stored under k.
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> emplace(K &&k, Args &&...args);
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key &k, Args &&...args);
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key &&k, Args &&...args);
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key &k, M &&obj);
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(Key &&k, M &&obj);
+
+  // Inserts every key/value pair in [first, last), which should be sorted
+  // by key. Keys larger than everything already in the list are appended
+  // through a per-layer finger in O(1) each, so loading a sorted range into
+  // an empty list is linear. Any other key falls back to insert(). Heights
+  // are exactly what the same sequence of insert() calls would produce.
+  // Returns the number of keys inserted.
+  template <typename InputIt> std::size_t bulkLoad(InputIt first, InputIt last);
+
+  // Replaces the contents of the list with the key/value pairs in
+  // [first, last), which need not be sorted, using up to `threads` threads
+  // (0 for one per hardware thread). The pairs are copied out and sorted in
+  // parallel. The towers are then built in parallel on disjoint runs of S_0,
+  // and the runs are stitched together on every layer. When a key appears
+  // more than once, its first occurrence wins, as with insert(). Heights
+  // are drawn on the calling thread in key order, so the towers are the
+  // ones bulkLoad gives the sorted range in an empty list. If anything
+  // throws, the list is left empty. Returns size().
+  template <typename InputIt>
+  std::size_t buildParallel(InputIt first, InputIt last, unsigned threads = 0);
+
   // Return a vector containing all inserted keys in increasing order.
   std::vector<Key> allKeysInOrder() const;
 
+  // Parallel walks of S_0 with up to `threads` threads (0 for one per
+  // hardware thread). S_0 is cut into runs at towers of an upper layer,
+  // whose positions the spans give, and each worker walks its own run.
+  //
+  // exportInOrder returns the same vector as allKeysInOrder(), with each
+  // worker writing its run straight into place.
+  // forEachParallel calls fn(key, value) once for every key. The keys of a
+  // run are visited in order on one thread, but runs are visited at the
+  // same time, so fn must be safe to call from several threads at once.
+  std::vector<Key> exportInOrder(unsigned threads = 0) const;
+  template <typename Fn> void forEachParallel(Fn fn, unsigned threads = 0);
+  template <typename Fn>
+  void forEachParallel(Fn fn, unsigned threads = 0) const;
+
   // Is this the smallest key in the SkipList? Throw a RuntimeException
   // if the key *k* does not exist in the Skip List.
   bool isSmallestKey(const Key &k) const;
@@ -213,275 +952,2043 @@ public:
   // if the key *k* does not exist in the Skip List.
   bool isLargestKey(const Key &k) const;
 
-  // I am not requiring you to implement remove.
-};
+  // Non-throwing lookups. These report a missing key through their return
+  // value instead of a RuntimeException, which makes misses as cheap as
+  // hits. The throwing functions above are thin wrappers around them.
 
-template <typename Key, typename Value> SkipList<Key, Value>::SkipList() {
-  head = new SkipNode<Key, Value>();
-  tail = new SkipNode<Key, Value>();
-  SkipNode<Key, Value> *temp_head = new SkipNode<Key, Value>();
-  SkipNode<Key, Value> *temp_tail = new SkipNode<Key, Value>();
+  // Is this key in the Skip List?
+  bool contains(const Key &k) const;
 
-  head->n_inf = true;
-  tail->p_inf = true;
-  temp_head->n_inf = true;
-  temp_tail->p_inf = true;
+  // The value associated with k, or nullptr if k is not in the Skip List.
+  Value *tryFind(const Key &k);
+  const Value *tryFind(const Key &k) const;
 
-  head->next = tail;
-  tail->previous = head;
-  temp_head->next = temp_tail;
-  temp_tail->previous = temp_head;
-  head->bottom = temp_head;
-  tail->bottom = temp_tail;
-  temp_head->top = head;
-  temp_tail->top = tail;
-  num_layers = 2;
-  num_keys = 0;
-}
+  // The height of k, or 0 if k is not in the Skip List.
+  unsigned tryHeight(const Key &k) const;
 
-template <typename Key, typename Value> SkipList<Key, Value>::~SkipList() {
-  SkipNode<Key, Value> *temp;
+  // The key after (before) k, or nullptr if k is not in the Skip List or is
+  // the largest (smallest) key.
+  const Key *tryNextKey(const Key &k) const;
+  const Key *tryPreviousKey(const Key &k) const;
 
-  while (head) {
-    temp = head;
-    head = head->bottom;
-    while (temp) {
-      SkipNode<Key, Value> *temp2 = temp;
-      temp = temp->next;
-      delete temp2;
-    }
-  }
-}
+  // The smallest (largest) key, or nullptr if the Skip List is empty.
+  // isSmallestKey(k) is equivalent to `contains(k) && *smallestKey() == k`.
+  const Key *smallestKey() const noexcept;
+  const Key *largestKey() const noexcept;
 
-template <typename Key, typename Value>
-size_t SkipList<Key, Value>::size() const noexcept {
-  return num_keys;
-}
+  // Iteration over S_0 in increasing key order.
+  iterator begin() noexcept;
+  iterator end() noexcept;
+  const_iterator begin() const noexcept;
+  const_iterator end() const noexcept;
+  const_iterator cbegin() const noexcept;
+  const_iterator cend() const noexcept;
 
-template <typename Key, typename Value>
-bool SkipList<Key, Value>::isEmpty() const noexcept {
-  return num_keys == 0;
-}
+  // Range scans. Each one costs a single O(log n) search; walking the
+  // returned range is then one pointer step per key.
+  //
+  // lower_bound: the first key >= k.
+  // upper_bound: the first key > k.
+  // equal_range(k): [lower_bound(k), upper_bound(k)), at most one key.
+  // equal_range(lo, hi): every key in the closed interval [lo, hi], i.e.
+  //   [lower_bound(lo), upper_bound(hi)). Empty when hi < lo.
+  iterator lower_bound(const Key &k);
+  const_iterator lower_bound(const Key &k) const;
+  iterator upper_bound(const Key &k);
+  const_iterator upper_bound(const Key &k) const;
+  std::pair<iterator, iterator> equal_range(const Key &k);
+  std::pair<const_iterator, const_iterator> equal_range(const Key &k) const;
+  std::pair<iterator, iterator> equal_range(const Key &lo, const Key &hi);
+  std::pair<const_iterator, const_iterator> equal_range(const Key &lo,
+                                                        const Key &hi) const;
 
-template <typename Key, typename Value>
-unsigned SkipList<Key, Value>::numLayers() const noexcept {
-  return num_layers;
-}
+  // Heterogeneous lookups, available when Compare is transparent. They
+  // behave like the functions of the same name above but take any K that
+  // Compare can order against Key, so a SkipList<std::string, V,
+  // NodeArena, FlipCoinLevels, std::less<>> can be searched with a
+  // std::string_view or a const char * without building a std::string.
+  template <typename K, typename = Transparent<K>>
+  bool contains(const K &k) const;
+  template <typename K, typename = Transparent<K>> Value &find(const K &k);
+  template <typename K, typename = Transparent<K>>
+  const Value &find(const K &k) const;
+  template <typename K, typename = Transparent<K>> Value *tryFind(const K &k);
+  template <typename K, typename = Transparent<K>>
+  const Value *tryFind(const K &k) const;
+  template <typename K, typename = Transparent<K>>
+  unsigned height(const K &k) const;
+  template <typename K, typename = Transparent<K>>
+  unsigned tryHeight(const K &k) const;
+  template <typename K, typename = Transparent<K>>
+  iterator lower_bound(const K &k);
+  template <typename K, typename = Transparent<K>>
+  const_iterator lower_bound(const K &k) const;
+  template <typename K, typename = Transparent<K>>
+  iterator upper_bound(const K &k);
+  template <typename K, typename = Transparent<K>>
+  const_iterator upper_bound(const K &k) const;
 
-template <typename Key, typename Value>
-unsigned SkipList<Key, Value>::height(const Key &k) const {
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
-    }
-  }
+  // Finger searches. These behave exactly like the functions of the same
+  // name above, but start from `hint` and leave it pointing at k.
+  Value &find(const Key &k, Finger &hint);
+  const Value &find(const Key &k, Finger &hint) const;
+  Value *tryFind(const Key &k, Finger &hint);
+  bool insert(const Key &k, const Value &v, Finger &hint);
+  iterator lower_bound(const Key &k, Finger &hint);
+  const_iterator lower_bound(const Key &k, Finger &hint) const;
 
-  if (temp->key != k || temp->n_inf) {
-    throw RuntimeException("Key not found");
-  }
+  // Batch operations for request pipelines.
+  //
+  // findBatch stores in values[i] a pointer to the value of keys[i], or
+  // nullptr if keys[i] is missing, for every i < n. Unsorted batches are
+  // searched BATCH_LANES at a time, one step of each search in turn with a
+  // prefetch of the node it will read next, so the memory stalls of
+  // independent searches overlap instead of adding up. Sorted batches reuse
+  // the previous key's search path through a Finger instead.
+  void findBatch(const Key *keys, std::size_t n, Value **values);
+  void findBatch(const Key *keys, std::size_t n, const Value **values) const;
 
-  unsigned height = 1;
-  while (temp->top) {
-    temp = temp->top;
-    height++;
-  }
+  // Starts a Search for k, which has not taken a step yet.
+  Search search(const Key &k) const;
 
-  return height;
-}
+  // insertBatch inserts (keys[i], values[i]) for every i < n, in order,
+  // with the same results as n calls to insert(). Each run of increasing
+  // keys reuses the previous key's search path. If `inserted` is non-null,
+  // inserted[i] records what insert() would have returned. Returns the
+  // number of keys inserted.
+  std::size_t insertBatch(const Key *keys, const Value *values,
+                          std::size_t n, bool *inserted = nullptr);
 
-template <typename Key, typename Value>
-Key SkipList<Key, Value>::nextKey(const Key &k) const {
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
-    }
-  }
+  // Removes k from the Skip List. Returns false if k was not present.
+  // The tower's memory goes back to the allocator for reuse (with the
+  // default NodeArena, onto its free list), and when the tallest towers go
+  // the empty layers they leave at the top are dropped, so numLayers()
+  // shrinks back to what the remaining keys need.
+  bool erase(const Key &k);
 
-  if (temp->key != k || temp->n_inf || temp->next->p_inf) {
-    throw RuntimeException("Key not found");
-  }
+  // Removes the key at pos, which must be dereferenceable, and returns an
+  // iterator to the key after it.
+  iterator erase(iterator pos);
+  iterator erase(const_iterator pos);
 
-  return temp->next->key;
-}
+  // Removes every key. The towers go back to the allocator for reuse and
+  // the list is left with the two layers of a new one.
+  void clear() noexcept;
 
-template <typename Key, typename Value>
-Key SkipList<Key, Value>::previousKey(const Key &k) const {
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
-    }
-  }
+  // The bytes the list takes up: the SkipList object and every tower,
+  // including the two sentinels, at the size asked of the allocator.
+  // Memory that keys and values own themselves, such as a long string's
+  // buffer, and the allocator's own overhead are not counted. Walks S_0.
+  std::size_t memoryUsage() const noexcept;
 
-  if (temp->key != k || temp->n_inf || temp->previous->n_inf) {
-    throw RuntimeException("Key not found");
-  }
+  // Moves every key of `other` into this list and leaves `other` empty.
+  // A key in both lists keeps the value it has here, and the tower from
+  // `other` is destroyed. Towers are relinked rather than copied, and keep
+  // their heights. One pass over S_0 of both lists rethreads every layer,
+  // in O(size() + other.size()) time. Compare must not throw. Returns the
+  // number of keys added.
+  std::size_t merge(SkipList &&other);
 
-  return temp->previous->key;
-}
+  // Moves the keys >= k into `right`, which must be another, empty list;
+  // otherwise this throws a RuntimeException. Only the links that cross
+  // the cut change. Two searches find them, so this takes O(log n)
+  // expected time. With SKIPLIST_STATS it also walks the moved towers to
+  // move their counts.
+  //
+  // Like merge, split needs Allocator::share (see NodeAllocator.hpp), since
+  // the towers it moves stay in the memory they were allocated from.
+  // Iterators to moved towers stay valid and now belong to the other list.
+  void split(const Key &k, SkipList &right);
 
-template <typename Key, typename Value>
-const Value &SkipList<Key, Value>::find(Key k) const {
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
-    }
-  }
+  // Snapshots, for Key and Value types that are trivially copyable.
+  //
+  // save writes the keys, values and tower heights in order to `path` (see
+  // SnapshotFormat.hpp), replacing the file.
+  //
+  // load replaces the contents of this list with the snapshot at `path`.
+  // Since the keys arrive sorted and with their heights, every tower is
+  // appended in O(1), so loading n keys is one linear pass with no
+  // searches or coin flips. If the file is missing, was written for other
+  // key or value types, or is corrupt, load throws a RuntimeException and
+  // leaves the list empty.
+  //
+  // Both throw a RuntimeException if the file cannot be opened or written.
+  void save(const std::string &path) const;
+  void load(const std::string &path);
 
-  if (temp->key == k && !temp->n_inf) {
-    return temp->value;
-  } else {
-    throw RuntimeException("Key not found");
-  }
-}
+  // Order statistics. Every forward link records how many keys it skips,
+  // so these take one O(log n) search instead of a walk over S_0.
+  //
+  // rank(k): the number of keys smaller than k. k need not be present; if
+  //   it is, it is at position rank(k) of allKeysInOrder().
+  // select(i): the key at position i of allKeysInOrder(), i.e. the
+  //   (i + 1)-th smallest. Throws a RuntimeException if i >= size().
+  // countInRange(lo, hi): the number of keys in the closed interval
+  //   [lo, hi], the same keys as equal_range(lo, hi). 0 when hi < lo.
+  std::size_t rank(const Key &k) const;
+  const Key &select(std::size_t i) const;
+  std::size_t countInRange(const Key &lo, const Key &hi) const;
 
-template <typename Key, typename Value>
-Value &SkipList<Key, Value>::find(const Key &k) {
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
-    }
+#ifdef SKIPLIST_STATS
+  // What the list has been doing, for telling a badly balanced list from
+  // other causes of slow operations. Only present with SKIPLIST_STATS.
+  struct Stats {
+    // Searches made for lookups (find, contains, the bounds, the finger
+    // operations, findBatch and erase) and the steps they took. A `next`
+    // step moves along a layer; there is one `down` step for every layer a
+    // search walks, so a search that stops early takes fewer of them. A
+    // finger search also takes one for every layer it checks before it
+    // starts walking.
+    std::uint64_t lookups = 0;
+    std::uint64_t lookup_next_steps = 0;
+    std::uint64_t lookup_down_steps = 0;
+
+    // The same for the searches of insert, emplace and their variants.
+    // Finger and batch inserts search as lookups.
+    std::uint64_t inserts = 0;
+    std::uint64_t insert_next_steps = 0;
+    std::uint64_t insert_down_steps = 0;
+
+    // New towers whose height reached the max_flips cap.
+    std::uint64_t capped_heights = 0;
+
+    // The towers holding keys right now, and the bytes they take up.
+    // towers_by_height[h] counts the towers of height h.
+    std::uint64_t towers = 0;
+    std::uint64_t tower_bytes = 0;
+    std::uint64_t towers_by_height[MAX_LAYERS] = {};
+
+    // Towers allocated and freed over the lifetime of the list.
+    std::uint64_t allocations = 0;
+    std::uint64_t deallocations = 0;
+
+    // The number of keys in S_level, i.e. the towers taller than level.
+    std::uint64_t nodesInLayer(unsigned level) const noexcept {
+      std::uint64_t nodes = 0;
+      for (unsigned h = level + 1; h < MAX_LAYERS; h++) {
+        nodes += towers_by_height[h];
+      }
+      return nodes;
+    }
+  };
+
+  const Stats &stats() const noexcept;
+
+  // Zeroes the search and cap counters, leaving the tower counts alone.
+  void resetSearchStats() noexcept;
+#endif
+
+private:
+  // The number of keys before k, counting k itself if `inclusive`.
+  std::size_t countBefore(const Key &k, bool inclusive) const;
+
+  // The fewest keys worth handing to a thread of its own.
+  static constexpr std::size_t PARALLEL_GRAIN = 1 << 14;
+
+  // `length` consecutive nodes of S_0, the first of which is `first`, the
+  // key at position `position`.
+  struct Run {
+    SkipNode<Key, Value> *first;
+    std::size_t position;
+    std::size_t length;
+  };
+
+  // Cuts S_0 into at most `parts` runs of similar length that cover it in
+  // order. The cuts are at towers of the highest layer that has at least
+  // `parts` of them, so finding them walks few nodes.
+  std::vector<Run> splitRuns(unsigned parts) const;
+
+#ifdef SKIPLIST_STATS
+  // Mutable so that const lookups can count their steps.
+  mutable Stats counters;
+#endif
+};
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipList<Key, Value, Allocator, Levels, Compare>::SkipList()
+    : SkipList(Levels()) {}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipList<Key, Value, Allocator, Levels, Compare>::SkipList(
+    const Levels &generator, const Compare &comparator)
+    : level_generator(generator), compare(comparator) {
+  head = SkipNode<Key, Value>::create(alloc, MAX_LAYERS);
+  try {
+    tail = SkipNode<Key, Value>::create(alloc, 1);
+  } catch (...) {
+    SkipNode<Key, Value>::destroy(alloc, head);
+    throw;
   }
 
-  if (temp->key == k && !temp->n_inf) {
-    return temp->value;
+  for (unsigned level = 0; level < MAX_LAYERS; level++) {
+    head->next[level] = tail;
+    head->span()[level] = 1;
+  }
+  tail->previous = head;
+  num_layers = 2;
+  num_keys = 0;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipList<Key, Value, Allocator, Levels, Compare>::~SkipList() {
+  if (Allocator::releases_on_destruction &&
+      std::is_trivially_destructible<Key>::value &&
+      std::is_trivially_destructible<Value>::value) {
+    // The allocator frees whole chunks when `alloc` is destroyed.
+    return;
+  }
+
+  SkipNode<Key, Value> *temp = head;
+  while (temp) {
+    SkipNode<Key, Value> *temp2 = temp;
+    temp = temp->next[0];
+    if (Allocator::releases_on_destruction) {
+      SkipNode<Key, Value>::destroyInPlace(temp2);
+    } else {
+      SkipNode<Key, Value>::destroy(alloc, temp2);
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K>
+SkipNode<Key, Value> *
+SkipList<Key, Value, Allocator, Levels, Compare>::locate(const K &k) const {
+  SKIPLIST_STAT(counters.lookups++);
+  SkipNode<Key, Value> *const end = tail;
+  SkipNode<Key, Value> *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    SKIPLIST_STAT(counters.lookup_down_steps++);
+    SkipNode<Key, Value> *next;
+    while ((next = temp->next[level]) != end) {
+      int order = threeWayCompare(compare, k, next->key);
+      if (order < 0) {
+        break;
+      }
+      temp = next;
+      SKIPLIST_STAT(counters.lookup_next_steps++);
+      if (order == 0) {
+        // The tower holding k reaches S_0, so there is no need to descend.
+        return temp;
+      }
+    }
+  }
+  return temp;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+size_t SkipList<Key, Value, Allocator, Levels, Compare>::size() const noexcept {
+  return num_keys;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool
+SkipList<Key, Value, Allocator, Levels, Compare>::isEmpty() const noexcept {
+  return num_keys == 0;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+unsigned
+SkipList<Key, Value, Allocator, Levels, Compare>::numLayers() const noexcept {
+  return num_layers;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K>
+SkipNode<Key, Value> *
+SkipList<Key, Value, Allocator, Levels, Compare>::locateBefore(
+    const K &k) const {
+  SKIPLIST_STAT(counters.lookups++);
+  SkipNode<Key, Value> *const end = tail;
+  SkipNode<Key, Value> *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    SKIPLIST_STAT(counters.lookup_down_steps++);
+    SkipNode<Key, Value> *next;
+    while ((next = temp->next[level]) != end && compare(next->key, k)) {
+      temp = next;
+      SKIPLIST_STAT(counters.lookup_next_steps++);
+    }
+  }
+  return temp;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K>
+SkipNode<Key, Value> *
+SkipList<Key, Value, Allocator, Levels, Compare>::findNode(const K &k) const {
+  SKIPLIST_STAT(counters.lookups++);
+  SkipNode<Key, Value> *const end = tail;
+  SkipNode<Key, Value> *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    SKIPLIST_STAT(counters.lookup_down_steps++);
+    SkipNode<Key, Value> *next;
+    while ((next = temp->next[level]) != end) {
+      int order = threeWayCompare(compare, k, next->key);
+      if (order == 0) {
+        return next;
+      } else if (order < 0) {
+        break;
+      }
+      temp = next;
+      SKIPLIST_STAT(counters.lookup_next_steps++);
+    }
+  }
+  return nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+unsigned
+SkipList<Key, Value, Allocator, Levels, Compare>::height(const Key &k) const {
+  unsigned height = tryHeight(k);
+
+  if (height == 0) {
+    throw RuntimeException("Key not found");
+  }
+
+  return height;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Key
+SkipList<Key, Value, Allocator, Levels, Compare>::nextKey(const Key &k) const {
+  const Key *next = tryNextKey(k);
+
+  if (!next) {
+    throw RuntimeException("Key not found");
+  }
+
+  return *next;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Key SkipList<Key, Value, Allocator, Levels, Compare>::previousKey(
+    const Key &k) const {
+  const Key *previous = tryPreviousKey(k);
+
+  if (!previous) {
+    throw RuntimeException("Key not found");
+  }
+
+  return *previous;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Value &
+SkipList<Key, Value, Allocator, Levels, Compare>::find(const Key &k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
   } else {
     throw RuntimeException("Key not found");
   }
 }
 
-template <typename Key, typename Value>
-bool SkipList<Key, Value>::insert(const Key &k, const Value &v) {
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Value &SkipList<Key, Value, Allocator, Levels, Compare>::find(const Key &k) {
+  Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
 
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename... Args>
+SkipNode<Key, Value> *SkipList<Key, Value, Allocator, Levels, Compare>::link(
+    SkipNode<Key, Value> **update, unsigned levels, K &&k, Args &&...args) {
+  SkipNode<Key, Value> *new_node = SkipNode<Key, Value>::create(
+      alloc, levels, std::forward<K>(k), std::forward<Args>(args)...);
+  num_keys++;
+  modifications++;
+  SKIPLIST_STAT(counters.allocations++);
+  SKIPLIST_STAT(counters.towers++);
+  SKIPLIST_STAT(counters.tower_bytes += SkipNode<Key, Value>::bytes(levels));
+  SKIPLIST_STAT(counters.towers_by_height[levels]++);
+
+  // There should always be an empty layer at the top. A new layer starts
+  // out with head linked straight to tail, past every key but the new one.
+  while (levels + 1 > num_layers) {
+    update[num_layers] = head;
+    head->span()[num_layers] = num_keys;
+    num_layers++;
+  }
+
+  // distance is how many S_0 steps the new node is ahead of update[level].
+  // Going up a layer adds the steps from update[level] to update[level - 1],
+  // which the search that produced update[] took along layer level - 1.
+  std::size_t distance = 1;
+  for (unsigned level = 0; level < levels; level++) {
+    if (level > 0) {
+      for (SkipNode<Key, Value> *temp = update[level];
+           temp != update[level - 1]; temp = temp->next[level - 1]) {
+        distance += temp->span()[level - 1];
+      }
+    }
+    new_node->next[level] = update[level]->next[level];
+    new_node->span()[level] = update[level]->span()[level] + 1 - distance;
+    update[level]->next[level] = new_node;
+    update[level]->span()[level] = distance;
+  }
+  // Links that pass over the new tower get one step longer.
+  for (unsigned level = levels; level < num_layers; level++) {
+    update[level]->span()[level]++;
+  }
+  new_node->previous = update[0];
+  new_node->next[0]->previous = new_node;
+
+  return new_node;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipNode<Key, Value> *SkipList<Key, Value, Allocator, Levels, Compare>::unlink(
+    SkipNode<Key, Value> **update, SkipNode<Key, Value> *node) {
+  for (unsigned level = 0; level < node->levels; level++) {
+    update[level]->next[level] = node->next[level];
+    update[level]->span()[level] += node->span()[level] - 1;
+  }
+  for (unsigned level = node->levels; level < num_layers; level++) {
+    update[level]->span()[level]--;
+  }
+  SkipNode<Key, Value> *next = node->next[0];
+  next->previous = node->previous;
+  SKIPLIST_STAT(counters.deallocations++);
+  SKIPLIST_STAT(counters.towers--);
+  SKIPLIST_STAT(counters.tower_bytes -=
+                SkipNode<Key, Value>::bytes(node->levels));
+  SKIPLIST_STAT(counters.towers_by_height[node->levels]--);
+  SkipNode<Key, Value>::destroy(alloc, node);
+  num_keys--;
+  modifications++;
+
+  // Keep exactly one empty layer at the top.
+  while (num_layers > 2 && head->next[num_layers - 2] == tail) {
+    num_layers--;
+  }
+
+  return next;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename... Args>
+std::pair<SkipNode<Key, Value> *, bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::insertNode(K &&k,
+                                                             Args &&...args) {
+  // update[i] is the node after which the new tower is spliced into S_i.
+  SkipNode<Key, Value> *update[MAX_LAYERS];
+
+  SKIPLIST_STAT(counters.inserts++);
+  SkipNode<Key, Value> *const end = tail;
   SkipNode<Key, Value> *temp = head;
-  while (temp->bottom != nullptr) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
+  for (unsigned level = num_layers; level-- > 0;) {
+    SKIPLIST_STAT(counters.insert_down_steps++);
+    SkipNode<Key, Value> *next;
+    while ((next = temp->next[level]) != end) {
+      int order = threeWayCompare(compare, k, next->key);
+      if (order == 0) {
+        // k is already here, and seeing it on any layer is enough.
+        return {next, false};
+      } else if (order < 0) {
+        break;
+      }
+      temp = next;
+      SKIPLIST_STAT(counters.insert_next_steps++);
     }
+    update[level] = temp;
   }
 
-  if (!temp->n_inf && temp->key == k) {
-    return false;
+  // The height is drawn before link moves from k.
+  unsigned levels = drawHeight(k, maxFlipsFor(num_keys + 1));
+  return {link(update, levels, std::forward<K>(k), std::forward<Args>(args)...),
+          true};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+unsigned SkipList<Key, Value, Allocator, Levels, Compare>::drawHeight(
+    const Key &k, unsigned max_flips) {
+  unsigned levels = level_generator(k, max_flips);
+  SKIPLIST_STAT(counters.capped_heights += levels >= max_flips);
+  return levels;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::insert(const Key &k,
+                                                              const Value &v) {
+  return insertNode(k, v).second;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::insert(const Key &k,
+                                                              Value &&v) {
+  return insertNode(k, std::move(v)).second;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::insert(Key &&k,
+                                                              Value &&v) {
+  return insertNode(std::move(k), std::move(v)).second;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename... Args>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::emplace(K &&k,
+                                                          Args &&...args) {
+  if constexpr (std::is_same<std::decay_t<K>, Key>::value) {
+    return try_emplace(std::forward<K>(k), std::forward<Args>(args)...);
+  } else {
+    return try_emplace(Key(std::forward<K>(k)), std::forward<Args>(args)...);
   }
+}
 
-  SkipNode<Key, Value> *new_node = new SkipNode<Key, Value>(k, v);
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename... Args>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::try_emplace(const Key &k,
+                                                              Args &&...args) {
+  auto result = insertNode(k, std::forward<Args>(args)...);
+  return {iterator(result.first), result.second};
+}
 
-  new_node->next = temp->next;
-  new_node->previous = temp;
-  temp->next->previous = new_node;
-  temp->next = new_node;
-  num_keys++;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename... Args>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::try_emplace(Key &&k,
+                                                              Args &&...args) {
+  auto result = insertNode(std::move(k), std::forward<Args>(args)...);
+  return {iterator(result.first), result.second};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename M>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::insert_or_assign(const Key &k,
+                                                                   M &&obj) {
+  auto result = insertNode(k, std::forward<M>(obj));
+  if (!result.second) {
+    result.first->value = std::forward<M>(obj);
+  }
+  return {iterator(result.first), result.second};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename M>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          bool>
+SkipList<Key, Value, Allocator, Levels, Compare>::insert_or_assign(Key &&k,
+                                                                   M &&obj) {
+  auto result = insertNode(std::move(k), std::forward<M>(obj));
+  if (!result.second) {
+    result.first->value = std::forward<M>(obj);
+  }
+  return {iterator(result.first), result.second};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename InputIt>
+SkipList<Key, Value, Allocator, Levels, Compare>::SkipList(InputIt first,
+                                                           InputIt last)
+    : SkipList() {
+  bulkLoad(first, last);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename InputIt>
+std::size_t
+SkipList<Key, Value, Allocator, Levels, Compare>::bulkLoad(InputIt first,
+                                                           InputIt last) {
+  // finger[i] is the last node in S_i, which is where an appended key goes.
+  SkipNode<Key, Value> *finger[MAX_LAYERS];
+  bool finger_valid = false;
+
+  std::size_t inserted = 0;
+  for (; first != last; ++first) {
+    const Key &k = first->first;
+
+    if (!finger_valid) {
+      SkipNode<Key, Value> *temp = head;
+      for (unsigned level = num_layers; level-- > 0;) {
+        while (temp->next[level] != tail) {
+          temp = temp->next[level];
+        }
+        finger[level] = temp;
+      }
+      finger_valid = true;
+    }
+
+    if (finger[0] != head && !compare(finger[0]->key, k)) {
+      // Out of order: take the slow path and rebuild the finger, since the
+      // new tower may now end some of the upper layers.
+      if (insert(k, first->second)) {
+        inserted++;
+      }
+      finger_valid = false;
+      continue;
+    }
 
-  unsigned max_flips = 0;
-  if (num_keys <= 16) {
-    max_flips = 12;
+    SkipNode<Key, Value> *new_node = link(
+        finger, drawHeight(k, maxFlipsFor(num_keys + 1)), k, first->second);
+    for (unsigned level = 0; level < new_node->levels; level++) {
+      finger[level] = new_node;
+    }
+    inserted++;
+  }
+  return inserted;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::vector<Key>
+SkipList<Key, Value, Allocator, Levels, Compare>::allKeysInOrder() const {
+  std::vector<Key> keys;
+  keys.reserve(num_keys);
+  SkipNode<Key, Value> *temp = head;
+  while (temp->next[0] != tail) {
+    keys.push_back(temp->next[0]->key);
+    temp = temp->next[0];
+  }
+  return keys;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::isSmallestKey(
+    const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+
+  if (temp) {
+    return temp->previous == head;
   } else {
-    max_flips = 3 * ceil(log2(num_keys));
+    throw RuntimeException("Key not found");
   }
+}
 
-  unsigned height = 0;
-  while (flipCoin(k, height) && height + 1 < max_flips) {
-    height++;
-    if (height + 1 >= num_layers) {
-      num_layers++;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::isLargestKey(
+    const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+
+  if (temp) {
+    return temp->next[0] == tail;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool
+SkipList<Key, Value, Allocator, Levels, Compare>::contains(const Key &k) const {
+  return findNode(k) != nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Value *SkipList<Key, Value, Allocator, Levels, Compare>::tryFind(const Key &k) {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? &temp->value : nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Value *
+SkipList<Key, Value, Allocator, Levels, Compare>::tryFind(const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? &temp->value : nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+unsigned SkipList<Key, Value, Allocator, Levels, Compare>::tryHeight(
+    const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? temp->levels : 0;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Key *SkipList<Key, Value, Allocator, Levels, Compare>::tryNextKey(
+    const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  if (!temp || temp->next[0] == tail) {
+    return nullptr;
+  }
+  return &temp->next[0]->key;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Key *SkipList<Key, Value, Allocator, Levels, Compare>::tryPreviousKey(
+    const Key &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  if (!temp || temp->previous == head) {
+    return nullptr;
+  }
+  return &temp->previous->key;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Key *
+SkipList<Key, Value, Allocator, Levels, Compare>::smallestKey() const noexcept {
+  return num_keys == 0 ? nullptr : &head->next[0]->key;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Key *
+SkipList<Key, Value, Allocator, Levels, Compare>::largestKey() const noexcept {
+  return num_keys == 0 ? nullptr : &tail->previous->key;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::begin() noexcept {
+  return iterator(head->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::end() noexcept {
+  return iterator(tail);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::begin() const noexcept {
+  return const_iterator(head->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::end() const noexcept {
+  return const_iterator(tail);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::cbegin() const noexcept {
+  return begin();
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::cend() const noexcept {
+  return end();
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(const Key &k) {
+  return iterator(locateBefore(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(
+    const Key &k) const {
+  return const_iterator(locateBefore(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::upper_bound(const Key &k) {
+  return iterator(locate(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::upper_bound(
+    const Key &k) const {
+  return const_iterator(locate(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator>
+SkipList<Key, Value, Allocator, Levels, Compare>::equal_range(const Key &k) {
+  return equal_range(k, k);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::pair<
+    typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator,
+    typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator>
+SkipList<Key, Value, Allocator, Levels, Compare>::equal_range(
+    const Key &k) const {
+  return equal_range(k, k);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::pair<typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator,
+          typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator>
+SkipList<Key, Value, Allocator, Levels, Compare>::equal_range(const Key &lo,
+                                                              const Key &hi) {
+  auto range = static_cast<const SkipList *>(this)->equal_range(lo, hi);
+  return {iterator(range.first.node), iterator(range.second.node)};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::pair<
+    typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator,
+    typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator>
+SkipList<Key, Value, Allocator, Levels, Compare>::equal_range(
+    const Key &lo, const Key &hi) const {
+  SkipNode<Key, Value> *first = locateBefore(lo)->next[0];
+  if (compare(hi, lo)) {
+    return {const_iterator(first), const_iterator(first)};
+  }
+  SkipNode<Key, Value> *last = locate(hi)->next[0];
+  return {const_iterator(first), const_iterator(last)};
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipNode<Key, Value> *
+SkipList<Key, Value, Allocator, Levels, Compare>::seek(const Key &k,
+                                                       Finger &f) const {
+  SKIPLIST_STAT(counters.lookups++);
+  SkipNode<Key, Value> *temp;
+  unsigned level;
+
+  if (f.owner != this || f.layers == 0 ||
+      (f.path[0] != head && !compare(f.path[0]->key, k))) {
+    // No usable finger, or k is behind it: search from the top.
+    f.owner = this;
+    temp = head;
+    level = num_layers;
+  } else {
+    // Layers added since the finger was recorded start at head.
+    for (unsigned i = f.layers; i < num_layers; i++) {
+      f.path[i] = head;
+    }
+
+    if (f.version == modifications) {
+      // Climb while the next node on this layer is still before k, since a
+      // higher layer may then cover the distance faster. Once a layer's
+      // next node is at or past k, every layer above it is already in
+      // place, so this costs O(log d).
+      level = 0;
+      while (level + 1 < num_layers && f.path[level]->next[level] != tail &&
+             compare(f.path[level]->next[level]->key, k)) {
+        SKIPLIST_STAT(counters.lookup_down_steps++);
+        level++;
+      }
+    } else {
+      // A tower inserted since the finger was recorded may sit between a
+      // path node and k on any layer, so check them all and start from the
+      // highest layer whose next node is still before k.
+      level = num_layers - 1;
+      while (level > 0 && (f.path[level]->next[level] == tail ||
+                           !compare(f.path[level]->next[level]->key, k))) {
+        SKIPLIST_STAT(counters.lookup_down_steps++);
+        level--;
+      }
+    }
+    temp = f.path[level];
+    level++;
+  }
+
+  SkipNode<Key, Value> *const end = tail;
+  while (level-- > 0) {
+    SKIPLIST_STAT(counters.lookup_down_steps++);
+    SkipNode<Key, Value> *next;
+    while ((next = temp->next[level]) != end && compare(next->key, k)) {
+      temp = next;
+      SKIPLIST_STAT(counters.lookup_next_steps++);
+    }
+    f.path[level] = temp;
+  }
+  f.layers = num_layers;
+  f.version = modifications;
+
+  return temp->next[0];
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Value &SkipList<Key, Value, Allocator, Levels, Compare>::find(const Key &k,
+                                                              Finger &hint) {
+  Value *value = tryFind(k, hint);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
 
-      SkipNode<Key, Value> *temp_head = new SkipNode<Key, Value>();
-      SkipNode<Key, Value> *temp_tail = new SkipNode<Key, Value>();
-      temp_head->n_inf = true;
-      temp_tail->p_inf = true;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Value &
+SkipList<Key, Value, Allocator, Levels, Compare>::find(const Key &k,
+                                                       Finger &hint) const {
+  SkipNode<Key, Value> *temp = seek(k, hint);
 
-      temp_head->next = temp_tail;
-      temp_tail->previous = temp_head;
-      temp_head->bottom = head;
-      temp_tail->bottom = tail;
-      head->top = temp_head;
-      tail->top = temp_tail;
-      head = temp_head;
-      tail = temp_tail;
+  if (temp != tail && !compare(k, temp->key)) {
+    return temp->value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+Value *SkipList<Key, Value, Allocator, Levels, Compare>::tryFind(const Key &k,
+                                                                 Finger &hint) {
+  SkipNode<Key, Value> *temp = seek(k, hint);
+  return temp != tail && !compare(k, temp->key) ? &temp->value : nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::insert(const Key &k,
+                                                              const Value &v,
+                                                              Finger &hint) {
+  SkipNode<Key, Value> *temp = seek(k, hint);
+
+  if (temp != tail && !compare(k, temp->key)) {
+    return false;
+  }
+
+  // The predecessors of k are exactly where the new tower is spliced in,
+  // and they stay the predecessors of k afterwards.
+  link(hint.path, drawHeight(k, maxFlipsFor(num_keys + 1)), k, v);
+  hint.layers = num_layers;
+  hint.version = modifications;
+  return true;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(const Key &k,
+                                                              Finger &hint) {
+  return iterator(seek(k, hint));
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(
+    const Key &k, Finger &hint) const {
+  return const_iterator(seek(k, hint));
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename Emit>
+void
+SkipList<Key, Value, Allocator, Levels, Compare>::findNodes(const Key *keys,
+                                                            std::size_t n,
+                                                            Emit emit) const {
+  bool sorted = true;
+  for (std::size_t i = 1; i < n && sorted; i++) {
+    sorted = compare(keys[i - 1], keys[i]);
+  }
+
+  if (sorted) {
+    Finger finger;
+    for (std::size_t i = 0; i < n; i++) {
+      SkipNode<Key, Value> *temp = seek(keys[i], finger);
+      emit(i, temp != tail && !compare(keys[i], temp->key) ? temp
+                                                              : nullptr);
     }
-    while (temp->previous && temp->top == nullptr) {
-      temp = temp->previous;
+    return;
+  }
+
+  // One in-flight search: the node it stands on and the layer it is
+  // walking. Searches that finish hand their lane to the next key.
+  struct Lane {
+    SkipNode<Key, Value> *node;
+    unsigned level;
+    std::size_t index;
+  };
+  Lane lanes[BATCH_LANES];
+  std::size_t active = 0;
+  std::size_t next_index = 0;
+
+  while (active < BATCH_LANES && next_index < n) {
+    lanes[active++] = Lane{head, num_layers - 1, next_index++};
+    SKIPLIST_STAT(counters.lookups++);
+    SKIPLIST_STAT(counters.lookup_down_steps++);
+  }
+  prefetchForRead(head->next[num_layers - 1]);
+
+  while (active > 0) {
+    for (std::size_t lane = 0; lane < active;) {
+      Lane &l = lanes[lane];
+      SkipNode<Key, Value> *next = l.node->next[l.level];
+      int order = next == tail
+                      ? -1
+                      : threeWayCompare(compare, keys[l.index], next->key);
+
+      if (order > 0) {
+        l.node = next;
+        SKIPLIST_STAT(counters.lookup_next_steps++);
+      } else if (order < 0 && l.level > 0) {
+        l.level--;
+        SKIPLIST_STAT(counters.lookup_down_steps++);
+      } else {
+        // Either next holds the key, or the search ran out of layers
+        // without meeting it.
+        emit(l.index, order == 0 ? next : nullptr);
+        if (next_index < n) {
+          l = Lane{head, num_layers - 1, next_index++};
+          SKIPLIST_STAT(counters.lookups++);
+          SKIPLIST_STAT(counters.lookup_down_steps++);
+        } else {
+          l = lanes[--active];
+          continue;
+        }
+      }
+
+      prefetchForRead(l.node->next[l.level]);
+      lane++;
     }
-    temp = temp->top;
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void
+SkipList<Key, Value, Allocator, Levels, Compare>::findBatch(const Key *keys,
+                                                            std::size_t n,
+                                                            Value **values) {
+  findNodes(keys, n, [values](std::size_t i, SkipNode<Key, Value> *node) {
+    values[i] = node ? &node->value : nullptr;
+  });
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void SkipList<Key, Value, Allocator, Levels, Compare>::findBatch(
+    const Key *keys, std::size_t n, const Value **values) const {
+  findNodes(keys, n, [values](std::size_t i, SkipNode<Key, Value> *node) {
+    values[i] = node ? &node->value : nullptr;
+  });
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+SkipList<Key, Value, Allocator, Levels, Compare>::Search::Search(
+    const SkipList *l, const Key *k) noexcept
+    : list(l), key(k), node(l->head), level(l->num_layers - 1),
+      finished(false) {
+  prefetchForRead(node->next[level]);
+  SKIPLIST_STAT(list->counters.lookups++);
+  SKIPLIST_STAT(list->counters.lookup_down_steps++);
+}
 
-    SkipNode<Key, Value> *new_node_top = new SkipNode<Key, Value>(k, v);
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::Search
+SkipList<Key, Value, Allocator, Levels, Compare>::search(const Key &k) const {
+  return Search(this, &k);
+}
 
-    new_node_top->next = temp->next;
-    new_node_top->previous = temp;
-    temp->next->previous = new_node_top;
-    temp->next = new_node_top;
-    new_node_top->bottom = new_node;
-    new_node->top = new_node_top;
-    new_node = new_node_top;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::Search::step() {
+  // A finished search may stand on tail, which has no next node to read.
+  if (finished) {
+    return true;
   }
 
+  // The same walk as findNodes, one step per call.
+  SkipNode<Key, Value> *next = node->next[level];
+  int order = next == list->tail
+                  ? -1
+                  : threeWayCompare(list->compare, *key, next->key);
+
+  if (order > 0) {
+    node = next;
+    SKIPLIST_STAT(list->counters.lookup_next_steps++);
+  } else if (order < 0 && level > 0) {
+    level--;
+    SKIPLIST_STAT(list->counters.lookup_down_steps++);
+  } else {
+    node = next;
+    hit = order == 0;
+    finished = true;
+    return true;
+  }
+
+  prefetchForRead(node->next[level]);
+  return false;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t SkipList<Key, Value, Allocator, Levels, Compare>::insertBatch(
+    const Key *keys, const Value *values, std::size_t n, bool *inserted) {
+  Finger finger;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    // The finger search restarts from head on its own when keys[i] is not
+    // past the previous key.
+    bool result = insert(keys[i], values[i], finger);
+    if (inserted) {
+      inserted[i] = result;
+    }
+    if (result) {
+      count++;
+    }
+  }
+  return count;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+bool SkipList<Key, Value, Allocator, Levels, Compare>::erase(const Key &k) {
+  Finger finger;
+  SkipNode<Key, Value> *temp = seek(k, finger);
+
+  if (temp == tail || compare(k, temp->key)) {
+    return false;
+  }
+
+  unlink(finger.path, temp);
   return true;
 }
 
-template <typename Key, typename Value>
-std::vector<Key> SkipList<Key, Value>::allKeysInOrder() const {
-  std::vector<Key> keys;
-  SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::erase(iterator pos) {
+  // Only S_0 is doubly linked, so the predecessors on the upper layers
+  // come from a search for the key.
+  Finger finger;
+  seek(pos.node->key, finger);
+  return iterator(unlink(finger.path, pos.node));
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::erase(const_iterator pos) {
+  return erase(iterator(pos.node));
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+bool
+SkipList<Key, Value, Allocator, Levels, Compare>::contains(const K &k) const {
+  return findNode(k) != nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+Value &SkipList<Key, Value, Allocator, Levels, Compare>::find(const K &k) {
+  Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
   }
-  while (temp->next->p_inf == false) {
-    keys.push_back(temp->next->key);
-    temp = temp->next;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+const Value &
+SkipList<Key, Value, Allocator, Levels, Compare>::find(const K &k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
   }
-  return keys;
 }
 
-template <typename Key, typename Value>
-bool SkipList<Key, Value>::isSmallestKey(const Key &k) const {
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+Value *SkipList<Key, Value, Allocator, Levels, Compare>::tryFind(const K &k) {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? &temp->value : nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+const Value *
+SkipList<Key, Value, Allocator, Levels, Compare>::tryFind(const K &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? &temp->value : nullptr;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+unsigned
+SkipList<Key, Value, Allocator, Levels, Compare>::height(const K &k) const {
+  unsigned height = tryHeight(k);
+
+  if (height == 0) {
+    throw RuntimeException("Key not found");
+  }
+
+  return height;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+unsigned
+SkipList<Key, Value, Allocator, Levels, Compare>::tryHeight(const K &k) const {
+  SkipNode<Key, Value> *temp = findNode(k);
+  return temp ? temp->levels : 0;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(const K &k) {
+  return iterator(locateBefore(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::lower_bound(
+    const K &k) const {
+  return const_iterator(locateBefore(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::upper_bound(const K &k) {
+  return iterator(locate(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename K, typename>
+typename SkipList<Key, Value, Allocator, Levels, Compare>::const_iterator
+SkipList<Key, Value, Allocator, Levels, Compare>::upper_bound(
+    const K &k) const {
+  return const_iterator(locate(k)->next[0]);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t SkipList<Key, Value, Allocator, Levels, Compare>::countBefore(
+    const Key &k, bool inclusive) const {
+  std::size_t position = 0;
   SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (temp->next[level] != tail) {
+      int order = threeWayCompare(compare, temp->next[level]->key, k);
+      if (order > 0 || (order == 0 && !inclusive)) {
+        break;
+      }
+      position += temp->span()[level];
+      temp = temp->next[level];
+      if (order == 0) {
+        return position;
+      }
     }
   }
+  return position;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t
+SkipList<Key, Value, Allocator, Levels, Compare>::rank(const Key &k) const {
+  return countBefore(k, false);
+}
 
-  if (temp->key == k && !temp->n_inf) {
-    if (temp->previous->n_inf) {
-      return true;
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const Key &
+SkipList<Key, Value, Allocator, Levels, Compare>::select(std::size_t i) const {
+  if (i >= num_keys) {
+    throw RuntimeException("Index out of range");
+  }
+
+  // head is position 0 and the key we want is position i + 1.
+  std::size_t position = 0;
+  SkipNode<Key, Value> *temp = head;
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (position + temp->span()[level] <= i + 1) {
+      position += temp->span()[level];
+      temp = temp->next[level];
+    }
+    if (position == i + 1) {
+      break;
+    }
+  }
+  return temp->key;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t SkipList<Key, Value, Allocator, Levels, Compare>::countInRange(
+    const Key &lo, const Key &hi) const {
+  if (compare(hi, lo)) {
+    return 0;
+  }
+  return countBefore(hi, true) - countBefore(lo, false);
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t
+SkipList<Key, Value, Allocator, Levels, Compare>::memoryUsage() const noexcept {
+  std::size_t bytes = sizeof(*this) + SkipNode<Key, Value>::bytes(MAX_LAYERS);
+  for (SkipNode<Key, Value> *temp = head->next[0]; temp;
+       temp = temp->next[0]) {
+    bytes += SkipNode<Key, Value>::bytes(temp->levels);
+  }
+  return bytes;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::size_t
+SkipList<Key, Value, Allocator, Levels, Compare>::merge(SkipList &&other) {
+  if (&other == this || other.num_keys == 0) {
+    return 0;
+  }
+  other.alloc.share(alloc);
+
+  // last[i] is the last node linked into S_i so far, at S_0 position
+  // last_position[i], as in bulkLoad.
+  SkipNode<Key, Value> *last[MAX_LAYERS];
+  std::size_t last_position[MAX_LAYERS];
+  unsigned layers = std::max(num_layers, other.num_layers);
+  for (unsigned level = 0; level < layers; level++) {
+    last[level] = head;
+    last_position[level] = 0;
+  }
+
+  SkipNode<Key, Value> *ours = head->next[0];
+  SkipNode<Key, Value> *theirs = other.head->next[0];
+  std::size_t position = 0;
+  std::size_t added = 0;
+  while (ours != tail || theirs != other.tail) {
+    SkipNode<Key, Value> *node;
+    if (theirs == other.tail ||
+        (ours != tail && compare(ours->key, theirs->key))) {
+      node = ours;
+      ours = ours->next[0];
+    } else if (ours == tail || compare(theirs->key, ours->key)) {
+      node = theirs;
+      theirs = theirs->next[0];
+      added++;
+      SKIPLIST_STAT(counters.towers++);
+      SKIPLIST_STAT(counters.tower_bytes +=
+                    SkipNode<Key, Value>::bytes(node->levels));
+      SKIPLIST_STAT(counters.towers_by_height[node->levels]++);
     } else {
-      return false;
+      // The same key in both lists.
+      SkipNode<Key, Value> *duplicate = theirs;
+      theirs = theirs->next[0];
+      SKIPLIST_STAT(other.counters.deallocations++);
+      SkipNode<Key, Value>::destroy(alloc, duplicate);
+      continue;
     }
-  } else {
-    throw RuntimeException("Key not found");
+
+    position++;
+    node->previous = last[0];
+    for (unsigned level = 0; level < node->levels; level++) {
+      last[level]->next[level] = node;
+      last[level]->span()[level] = position - last_position[level];
+      last[level] = node;
+      last_position[level] = position;
+    }
+  }
+
+  for (unsigned level = 0; level < layers; level++) {
+    last[level]->next[level] = tail;
+    last[level]->span()[level] = position + 1 - last_position[level];
   }
+  tail->previous = last[0];
+  num_keys = position;
+  num_layers = layers;
+  while (num_layers > 2 && head->next[num_layers - 2] == tail) {
+    num_layers--;
+  }
+
+  for (unsigned level = 0; level < other.num_layers; level++) {
+    other.head->next[level] = other.tail;
+    other.head->span()[level] = 1;
+  }
+  other.tail->previous = other.head;
+  other.num_layers = 2;
+  other.num_keys = 0;
+  modifications++;
+  other.modifications++;
+#ifdef SKIPLIST_STATS
+  other.counters.towers = 0;
+  other.counters.tower_bytes = 0;
+  std::fill(std::begin(other.counters.towers_by_height),
+            std::end(other.counters.towers_by_height), 0);
+#endif
+  return added;
 }
 
-template <typename Key, typename Value>
-bool SkipList<Key, Value>::isLargestKey(const Key &k) const {
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void SkipList<Key, Value, Allocator, Levels, Compare>::split(const Key &k,
+                                                             SkipList &right) {
+  if (&right == this || !right.isEmpty()) {
+    throw RuntimeException("Can only split into another, empty list");
+  }
+  alloc.share(right.alloc);
+
+  // update[i] is the last node in S_i with a key < k, at S_0 position
+  // update_position[i], and last[i] is the last node in S_i.
+  SkipNode<Key, Value> *update[MAX_LAYERS] = {};
+  std::size_t update_position[MAX_LAYERS] = {};
+  SkipNode<Key, Value> *last[MAX_LAYERS];
+
   SkipNode<Key, Value> *temp = head;
-  while (temp->bottom) {
-    temp = temp->bottom;
-    while (!temp->next->p_inf && k >= temp->next->key) {
-      temp = temp->next;
+  std::size_t position = 0;
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (temp->next[level] != tail && compare(temp->next[level]->key, k)) {
+      position += temp->span()[level];
+      temp = temp->next[level];
     }
+    update[level] = temp;
+    update_position[level] = position;
+  }
+  const std::size_t keep = update_position[0];
+  const std::size_t n = num_keys;
+  if (keep == n) {
+    return;
+  }
+  temp = update[num_layers - 1];
+  for (unsigned level = num_layers; level-- > 0;) {
+    while (temp->next[level] != tail) {
+      temp = temp->next[level];
+    }
+    last[level] = temp;
   }
 
-  if (temp->key == k && !temp->n_inf) {
-    if (temp->next->p_inf) {
-      return true;
+  // Links from the last towers to tail keep their spans, since the right
+  // part moves their positions and the end by the same amount.
+  SkipNode<Key, Value> *first = update[0]->next[0];
+  for (unsigned level = 0; level < num_layers; level++) {
+    if (update[level]->next[level] != tail) {
+      right.head->next[level] = update[level]->next[level];
+      right.head->span()[level] =
+          update_position[level] + update[level]->span()[level] - keep;
+      last[level]->next[level] = right.tail;
     } else {
-      return false;
+      right.head->next[level] = right.tail;
+      right.head->span()[level] = n - keep + 1;
     }
-  } else {
-    throw RuntimeException("Key not found");
+    update[level]->next[level] = tail;
+    update[level]->span()[level] = keep + 1 - update_position[level];
+  }
+  first->previous = right.head;
+  right.tail->previous = last[0];
+  tail->previous = update[0];
+
+  right.num_keys = n - keep;
+  num_keys = keep;
+  modifications++;
+  right.modifications++;
+  right.num_layers = num_layers;
+  for (SkipList *list : {this, &right}) {
+    while (list->num_layers > 2 &&
+           list->head->next[list->num_layers - 2] == list->tail) {
+      list->num_layers--;
+    }
+  }
+
+#ifdef SKIPLIST_STATS
+  for (temp = first; temp != right.tail; temp = temp->next[0]) {
+    std::uint64_t bytes = SkipNode<Key, Value>::bytes(temp->levels);
+    counters.towers--;
+    counters.tower_bytes -= bytes;
+    counters.towers_by_height[temp->levels]--;
+    right.counters.towers++;
+    right.counters.tower_bytes += bytes;
+    right.counters.towers_by_height[temp->levels]++;
   }
+#endif
 }
 
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void SkipList<Key, Value, Allocator, Levels, Compare>::clear() noexcept {
+  SkipNode<Key, Value> *temp = head->next[0];
+  while (temp != tail) {
+    SkipNode<Key, Value> *temp2 = temp;
+    temp = temp->next[0];
+    SkipNode<Key, Value>::destroy(alloc, temp2);
+  }
+#ifdef SKIPLIST_STATS
+  counters.deallocations += counters.towers;
+  counters.towers = 0;
+  counters.tower_bytes = 0;
+  std::fill(std::begin(counters.towers_by_height),
+            std::end(counters.towers_by_height), 0);
+#endif
+
+  // Layers at or above num_layers already lead straight to tail.
+  for (unsigned level = 0; level < num_layers; level++) {
+    head->next[level] = tail;
+    head->span()[level] = 1;
+  }
+  tail->previous = head;
+  num_layers = 2;
+  num_keys = 0;
+  modifications++;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void SkipList<Key, Value, Allocator, Levels, Compare>::save(
+    const std::string &path) const {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+                    std::is_trivially_copyable<Value>::value,
+                "snapshots need trivially copyable keys and values");
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw RuntimeException("Cannot open " + path);
+  }
+
+  SnapshotHeader header = snapshotHeader(num_keys, sizeof(Key), sizeof(Value));
+  std::uint64_t written = 0;
+  auto write = [&out, &written](const void *p, std::uint64_t bytes) {
+    out.write(static_cast<const char *>(p), bytes);
+    written += bytes;
+  };
+  auto padTo = [&write, &written](std::uint64_t offset) {
+    static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+    write(zeros, offset - written);
+  };
+
+  write(&header, sizeof(header));
+  padTo(header.keys_offset);
+  for (SkipNode<Key, Value> *temp = head->next[0]; temp != tail;
+       temp = temp->next[0]) {
+    write(&temp->key, sizeof(Key));
+  }
+  padTo(header.values_offset);
+  for (SkipNode<Key, Value> *temp = head->next[0]; temp != tail;
+       temp = temp->next[0]) {
+    write(&temp->value, sizeof(Value));
+  }
+  padTo(header.heights_offset);
+  for (SkipNode<Key, Value> *temp = head->next[0]; temp != tail;
+       temp = temp->next[0]) {
+    unsigned char height = static_cast<unsigned char>(temp->levels);
+    write(&height, 1);
+  }
+
+  out.flush();
+  if (!out) {
+    throw RuntimeException("Cannot write " + path);
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void SkipList<Key, Value, Allocator, Levels, Compare>::load(
+    const std::string &path) {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+                    std::is_trivially_copyable<Value>::value,
+                "snapshots need trivially copyable keys and values");
+  static_assert(MAX_LAYERS <= 256, "heights are stored in one byte");
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw RuntimeException("Cannot open " + path);
+  }
+  in.seekg(0, std::ios::end);
+  std::uint64_t file_bytes = static_cast<std::uint64_t>(in.tellg());
+  in.seekg(0);
+
+  SnapshotHeader header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in ||
+      !validSnapshotHeader(header, sizeof(Key), sizeof(Value), file_bytes)) {
+    throw RuntimeException("Not a snapshot of this key and value type: " +
+                           path);
+  }
+
+  clear();
+  try {
+    // finger[i] is the last node in S_i, which is where the next tower goes.
+    SkipNode<Key, Value> *finger[MAX_LAYERS];
+    for (unsigned level = 0; level < num_layers; level++) {
+      finger[level] = head;
+    }
+
+    // The three arrays are read a chunk at a time, in step.
+    const std::uint64_t CHUNK = 4096;
+    std::vector<Key> keys(CHUNK);
+    std::vector<Value> values(CHUNK);
+    std::vector<unsigned char> heights(CHUNK);
+
+    for (std::uint64_t done = 0; done < header.count;) {
+      std::uint64_t n = std::min(CHUNK, header.count - done);
+      in.seekg(header.keys_offset + done * sizeof(Key));
+      in.read(reinterpret_cast<char *>(keys.data()), n * sizeof(Key));
+      in.seekg(header.values_offset + done * sizeof(Value));
+      in.read(reinterpret_cast<char *>(values.data()), n * sizeof(Value));
+      in.seekg(header.heights_offset + done);
+      in.read(reinterpret_cast<char *>(heights.data()), n);
+      if (!in) {
+        throw RuntimeException("Cannot read " + path);
+      }
+
+      for (std::uint64_t i = 0; i < n; i++) {
+        unsigned levels = heights[i];
+        if (levels == 0 || levels + 1 > MAX_LAYERS ||
+            (num_keys > 0 && !compare(finger[0]->key, keys[i]))) {
+          throw RuntimeException("Corrupt snapshot: " + path);
+        }
+        SkipNode<Key, Value> *new_node =
+            link(finger, levels, keys[i], values[i]);
+        for (unsigned level = 0; level < levels; level++) {
+          finger[level] = new_node;
+        }
+      }
+      done += n;
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename InputIt>
+std::size_t SkipList<Key, Value, Allocator, Levels, Compare>::buildParallel(
+    InputIt first, InputIt last, unsigned threads) {
+  clear();
+
+  std::vector<std::pair<Key, Value>> pairs;
+  for (; first != last; ++first) {
+    pairs.emplace_back(first->first, first->second);
+  }
+
+  // Sort pieces of the input in parallel, then merge neighbouring pieces in
+  // rounds. Both steps are stable, so equal keys keep their input order
+  // and unique() keeps the first of them.
+  auto less = [this](const std::pair<Key, Value> &a,
+                     const std::pair<Key, Value> &b) {
+    return compare(a.first, b.first);
+  };
+  unsigned parts = parallelParts(pairs.size(), threads, PARALLEL_GRAIN);
+  std::vector<std::size_t> bounds(parts + 1);
+  for (unsigned i = 0; i <= parts; i++) {
+    bounds[i] = pairs.size() * i / parts;
+  }
+  runInParallel(parts, [&](unsigned i) {
+    std::stable_sort(pairs.begin() + bounds[i], pairs.begin() + bounds[i + 1],
+                     less);
+  });
+  for (unsigned width = 1; width < parts; width *= 2) {
+    runInParallel((parts + 2 * width - 1) / (2 * width), [&](unsigned i) {
+      unsigned lo = 2 * width * i;
+      unsigned mid = std::min(lo + width, parts);
+      unsigned hi = std::min(lo + 2 * width, parts);
+      std::inplace_merge(pairs.begin() + bounds[lo],
+                         pairs.begin() + bounds[mid],
+                         pairs.begin() + bounds[hi], less);
+    });
+  }
+  pairs.erase(std::unique(pairs.begin(), pairs.end(),
+                          [this](const std::pair<Key, Value> &a,
+                                 const std::pair<Key, Value> &b) {
+                            return !compare(a.first, b.first);
+                          }),
+              pairs.end());
+
+  std::size_t n = pairs.size();
+  if (n == 0) {
+    return 0;
+  }
+
+  // The heights come from a generator that may keep state, and the memory
+  // from an allocator that is not thread-safe, so both are done here.
+  std::vector<unsigned> levels(n);
+  std::vector<SkipNode<Key, Value> *> nodes(n);
+  unsigned top = 1;
+  std::size_t allocated = 0;
+  try {
+    for (; allocated < n; allocated++) {
+      std::size_t i = allocated;
+      levels[i] = drawHeight(pairs[i].first, maxFlipsFor(i + 1));
+      nodes[i] = static_cast<SkipNode<Key, Value> *>(
+          alloc.allocate(SkipNode<Key, Value>::bytes(levels[i])));
+      top = std::max(top, levels[i]);
+    }
+  } catch (...) {
+    for (std::size_t i = 0; i < allocated; i++) {
+      alloc.deallocate(nodes[i], SkipNode<Key, Value>::bytes(levels[i]));
+    }
+    throw;
+  }
+
+  // Each worker builds the nodes of its piece and links them to each other
+  // on every layer. Positions count from head, which is at 0, so 0 can
+  // stand for "none yet" in firsts and lasts, which record the first and
+  // last position each piece has on each layer for the stitching below.
+  parts = parallelParts(n, threads, PARALLEL_GRAIN);
+  bounds.assign(parts + 1, 0);
+  for (unsigned i = 0; i <= parts; i++) {
+    bounds[i] = n * i / parts;
+  }
+  std::vector<std::size_t> constructed(parts, 0);
+  std::vector<std::size_t> firsts(std::size_t(parts) * top, 0);
+  std::vector<std::size_t> lasts(std::size_t(parts) * top, 0);
+  try {
+    runInParallel(parts, [&](unsigned part) {
+      for (std::size_t i = bounds[part]; i < bounds[part + 1]; i++) {
+        SkipNode<Key, Value>::construct(nodes[i], levels[i],
+                                        std::move(pairs[i].first),
+                                        std::move(pairs[i].second));
+        constructed[part]++;
+      }
+      for (std::size_t i = bounds[part]; i < bounds[part + 1]; i++) {
+        SkipNode<Key, Value> *node = nodes[i];
+        node->previous = i == 0 ? head : nodes[i - 1];
+        node->next[0] = i + 1 < n ? nodes[i + 1] : tail;
+        node->span()[0] = 1;
+        for (unsigned level = 1; level < levels[i]; level++) {
+          std::size_t &last = lasts[part * top + level];
+          if (last) {
+            nodes[last - 1]->next[level] = node;
+            nodes[last - 1]->span()[level] = i + 1 - last;
+          } else {
+            firsts[part * top + level] = i + 1;
+          }
+          last = i + 1;
+        }
+      }
+    });
+  } catch (...) {
+    for (unsigned part = 0; part < parts; part++) {
+      for (std::size_t i = bounds[part]; i < bounds[part + 1]; i++) {
+        if (i < bounds[part] + constructed[part]) {
+          SkipNode<Key, Value>::destroy(alloc, nodes[i]);
+        } else {
+          alloc.deallocate(nodes[i], SkipNode<Key, Value>::bytes(levels[i]));
+        }
+      }
+    }
+    throw;
+  }
+
+  // Join the pieces on every layer, including the empty one at the top.
+  head->next[0] = nodes[0];
+  head->span()[0] = 1;
+  tail->previous = nodes[n - 1];
+  num_layers = top + 1;
+  for (unsigned level = 1; level < num_layers; level++) {
+    SkipNode<Key, Value> *temp = head;
+    std::size_t position = 0;
+    for (unsigned part = 0; part < parts && level < top; part++) {
+      std::size_t next = firsts[part * top + level];
+      if (next) {
+        temp->next[level] = nodes[next - 1];
+        temp->span()[level] = next - position;
+        position = lasts[part * top + level];
+        temp = nodes[position - 1];
+      }
+    }
+    temp->next[level] = tail;
+    temp->span()[level] = n + 1 - position;
+  }
+  num_keys = n;
+
+#ifdef SKIPLIST_STATS
+  for (std::size_t i = 0; i < n; i++) {
+    counters.allocations++;
+    counters.towers++;
+    counters.tower_bytes += SkipNode<Key, Value>::bytes(levels[i]);
+    counters.towers_by_height[levels[i]]++;
+  }
+#endif
+  return n;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::vector<typename SkipList<Key, Value, Allocator, Levels, Compare>::Run>
+SkipList<Key, Value, Allocator, Levels, Compare>::splitRuns(
+    unsigned parts) const {
+  std::vector<Run> runs;
+  if (num_keys == 0) {
+    return runs;
+  }
+
+  // towers[i] is a node of the layer being tried and its position in S_0.
+  // The layer below has about twice as many nodes, so stopping at the first
+  // layer with enough of them walks O(parts) nodes in all.
+  std::vector<std::pair<SkipNode<Key, Value> *, std::size_t>> towers;
+  for (unsigned level = num_layers - 1; level-- > 1 && towers.size() < parts;) {
+    towers.clear();
+    std::size_t distance = 0;
+    for (SkipNode<Key, Value> *temp = head; temp->next[level] != tail;
+         temp = temp->next[level]) {
+      distance += temp->span()[level];
+      towers.emplace_back(temp->next[level], distance - 1);
+    }
+  }
+
+  // Cut at the first tower at or past each multiple of num_keys / parts.
+  runs.push_back(Run{head->next[0], 0, 0});
+  std::size_t next = 0;
+  for (unsigned i = 1; i < parts; i++) {
+    std::size_t target = num_keys * i / parts;
+    while (next < towers.size() && towers[next].second < target) {
+      next++;
+    }
+    if (next == towers.size()) {
+      break;
+    }
+    if (towers[next].second > runs.back().position) {
+      runs.push_back(Run{towers[next].first, towers[next].second, 0});
+    }
+  }
+  for (std::size_t i = 0; i < runs.size(); i++) {
+    std::size_t end = i + 1 < runs.size() ? runs[i + 1].position : num_keys;
+    runs[i].length = end - runs[i].position;
+  }
+  return runs;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+std::vector<Key>
+SkipList<Key, Value, Allocator, Levels, Compare>::exportInOrder(
+    unsigned threads) const {
+  std::vector<Key> keys(num_keys);
+  std::vector<Run> runs = splitRuns(parallelParts(num_keys, threads,
+                                                  PARALLEL_GRAIN));
+  runInParallel(static_cast<unsigned>(runs.size()), [&](unsigned i) {
+    SkipNode<Key, Value> *temp = runs[i].first;
+    for (std::size_t j = 0; j < runs[i].length; j++) {
+      keys[runs[i].position + j] = temp->key;
+      temp = temp->next[0];
+    }
+  });
+  return keys;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename Fn>
+void SkipList<Key, Value, Allocator, Levels, Compare>::forEachParallel(
+    Fn fn, unsigned threads) {
+  std::vector<Run> runs = splitRuns(parallelParts(num_keys, threads,
+                                                  PARALLEL_GRAIN));
+  runInParallel(static_cast<unsigned>(runs.size()), [&](unsigned i) {
+    SkipNode<Key, Value> *temp = runs[i].first;
+    for (std::size_t j = 0; j < runs[i].length; j++) {
+      fn(static_cast<const Key &>(temp->key), temp->value);
+      temp = temp->next[0];
+    }
+  });
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+template <typename Fn>
+void SkipList<Key, Value, Allocator, Levels, Compare>::forEachParallel(
+    Fn fn, unsigned threads) const {
+  std::vector<Run> runs = splitRuns(parallelParts(num_keys, threads,
+                                                  PARALLEL_GRAIN));
+  runInParallel(static_cast<unsigned>(runs.size()), [&](unsigned i) {
+    const SkipNode<Key, Value> *temp = runs[i].first;
+    for (std::size_t j = 0; j < runs[i].length; j++) {
+      fn(temp->key, temp->value);
+      temp = temp->next[0];
+    }
+  });
+}
+
+#ifdef SKIPLIST_STATS
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+const typename SkipList<Key, Value, Allocator, Levels, Compare>::Stats &
+SkipList<Key, Value, Allocator, Levels, Compare>::stats() const noexcept {
+  return counters;
+}
+
+template <typename Key, typename Value, typename Allocator, typename Levels,
+          typename Compare>
+void
+SkipList<Key, Value, Allocator, Levels, Compare>::resetSearchStats() noexcept {
+  counters.lookups = 0;
+  counters.lookup_next_steps = 0;
+  counters.lookup_down_steps = 0;
+  counters.inserts = 0;
+  counters.insert_next_steps = 0;
+  counters.insert_down_steps = 0;
+  counters.capped_heights = 0;
+}
+#endif
+
+#undef SKIPLIST_STAT
+
 #endif
@@ -0,0 +1,95 @@
+#ifndef ___SNAPSHOT_FORMAT_HPP
+#define ___SNAPSHOT_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief The on-disk layout written by SkipList::save.
+ *
+ * A snapshot is a SnapshotHeader followed by three arrays, each starting on
+ * a SNAPSHOT_ALIGNMENT boundary:
+ *
+ *   keys[count]     the keys in increasing order, as raw bytes
+ *   values[count]   values[i] belongs to keys[i]
+ *   heights[count]  the height of each key's tower, one byte each
+ *
+ * Everything is stored in host byte order, so a snapshot is only meant to
+ * be read back on the same kind of machine. Since the arrays are aligned,
+ * a mapped snapshot can be searched in place (see MappedSkipList.hpp).
+ */
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t key_bytes;
+  std::uint32_t value_bytes;
+  std::uint32_t reserved;
+  std::uint64_t count;
+  std::uint64_t keys_offset;
+  std::uint64_t values_offset;
+  std::uint64_t heights_offset;
+  std::uint64_t file_bytes;
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'S', 'K', 'I', 'P', 'L', 'I', 'S', 'T'};
+constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+constexpr std::uint64_t SNAPSHOT_ALIGNMENT = 64;
+
+inline std::uint64_t alignSnapshotOffset(std::uint64_t offset) noexcept {
+  return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT *
+         SNAPSHOT_ALIGNMENT;
+}
+
+/**
+ * @brief The header of a snapshot holding `count` keys of `key_bytes`
+ * bytes and values of `value_bytes` bytes.
+ */
+inline SnapshotHeader snapshotHeader(std::uint64_t count,
+                                     std::uint32_t key_bytes,
+                                     std::uint32_t value_bytes) noexcept {
+  SnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.key_bytes = key_bytes;
+  header.value_bytes = value_bytes;
+  header.count = count;
+  header.keys_offset = alignSnapshotOffset(sizeof(SnapshotHeader));
+  header.values_offset =
+      alignSnapshotOffset(header.keys_offset + count * key_bytes);
+  header.heights_offset =
+      alignSnapshotOffset(header.values_offset + count * value_bytes);
+  header.file_bytes = header.heights_offset + count;
+  return header;
+}
+
+/**
+ * @brief Is `header` a snapshot of `key_bytes`-byte keys and
+ * `value_bytes`-byte values that fits in a file of `file_bytes` bytes?
+ */
+inline bool validSnapshotHeader(const SnapshotHeader &header,
+                                std::uint32_t key_bytes,
+                                std::uint32_t value_bytes,
+                                std::uint64_t file_bytes) noexcept {
+  if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION || header.key_bytes != key_bytes ||
+      header.value_bytes != value_bytes) {
+    return false;
+  }
+  // Every entry takes at least this many bytes of the file, which also
+  // keeps the offsets below from overflowing.
+  std::uint64_t entry_bytes = std::uint64_t(key_bytes) + value_bytes + 1;
+  if (header.count > file_bytes / entry_bytes) {
+    return false;
+  }
+  SnapshotHeader expected = snapshotHeader(header.count, key_bytes,
+                                           value_bytes);
+  return header.keys_offset == expected.keys_offset &&
+         header.values_offset == expected.values_offset &&
+         header.heights_offset == expected.heights_offset &&
+         header.file_bytes == expected.file_bytes &&
+         header.file_bytes == file_bytes;
+}
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef ___STRING_SKIP_LIST_HPP
+#define ___STRING_SKIP_LIST_HPP
+
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The big-endian value of the 8 bytes at `bytes`, or of the
+ * `length` bytes there followed by zeros when there are fewer, so that
+ * comparing two of them compares those bytes in order.
+ */
+inline std::uint64_t inlinePrefix(const char *bytes,
+                                  std::size_t length) noexcept {
+  unsigned char buffer[8] = {};
+  if (length > 0) {
+    std::memcpy(buffer, bytes, length < 8 ? length : 8);
+  }
+  std::uint64_t prefix = 0;
+  for (unsigned char c : buffer) {
+    prefix = prefix << 8 | c;
+  }
+  return prefix;
+}
+
+/**
+ * @brief A key of a StringSkipList as it is stored in a tower.
+ *
+ * The bytes of the key live elsewhere (in the list's key arena, or in the
+ * caller's string for a search). The tower keeps the eight bytes that
+ * follow the prefix every key in the list shares, packed into an integer,
+ * so most comparisons are one integer compare on the node's own cache
+ * line. Only keys whose first `offset + 8` bytes are equal read the rest.
+ */
+struct InlineStringKey {
+  InlineStringKey() = default;
+  InlineStringKey(const char *b, std::size_t n, std::size_t shared)
+      : prefix(inlinePrefix(b + shared, n - shared)), bytes(b),
+        length(static_cast<std::uint32_t>(n)),
+        offset(static_cast<std::uint32_t>(shared)) {}
+
+  std::string_view view() const noexcept {
+    return std::string_view(bytes, length);
+  }
+
+  std::uint64_t prefix = 0;
+  const char *bytes = nullptr;
+  std::uint32_t length = 0;
+  // The length of the shared prefix the inline bytes follow.
+  std::uint32_t offset = 0;
+};
+
+namespace std {
+// Hashes the whole key, for HashedLevels.
+template <> struct hash<InlineStringKey> {
+  size_t operator()(const InlineStringKey &key) const noexcept {
+    return hash<string_view>()(key.view());
+  }
+};
+} // namespace std
+
+/**
+ * @brief Orders InlineStringKeys like the strings they hold, for keys that
+ * share their first `offset` bytes.
+ */
+struct InlineStringLess {
+  bool operator()(const InlineStringKey &a,
+                  const InlineStringKey &b) const noexcept {
+    if (a.prefix != b.prefix) {
+      return a.prefix < b.prefix;
+    }
+    std::size_t start = a.offset + 8;
+    std::size_t common = std::min(a.length, b.length);
+    if (common > start) {
+      int c = std::memcmp(a.bytes + start, b.bytes + start, common - start);
+      if (c != 0) {
+        return c < 0;
+      }
+    }
+    return a.length < b.length;
+  }
+};
+
+/**
+ * @brief The same coin flips as flipCoin(std::string), so a StringSkipList
+ * gives a key the tower a SkipList<std::string, Value> would.
+ */
+inline bool flipCoin(const InlineStringKey &key, unsigned previousFlips) {
+  char c = 0;
+  for (std::uint32_t j = 0; j < key.length; j++) {
+    c = c ^ key.bytes[j];
+  }
+  previousFlips = previousFlips % 8;
+  return (c & (1 << previousFlips)) != 0;
+}
+
+// The whole tower at once, like flipCoinLevels(std::string).
+inline unsigned flipCoinLevels(const InlineStringKey &key,
+                               unsigned max_flips) noexcept {
+  return flipCoinLevelsOf(xorFold(key.bytes, key.length), max_flips);
+}
+
+/**
+ * @brief A skip list from strings to Value, for keys that are mostly
+ * longer than the small-string buffer and share long prefixes.
+ *
+ * A SkipList<std::string, Value> tower holds a std::string, so a key past
+ * the small-string limit is a heap allocation of its own and every
+ * comparison follows its pointer. Here the list remembers the prefix all
+ * of its keys share (say "tenant/region/") once, and every tower holds an
+ * InlineStringKey: the next eight bytes as an integer plus a pointer into
+ * a key arena, where the bytes of all keys are packed one after another.
+ * Comparisons that the inline bytes decide never leave the tower.
+ *
+ * When a new key does not start with the shared prefix, the prefix
+ * shrinks to what the keys still have in common and the list is rebuilt
+ * with the new inline bytes in one linear pass. That happens at most once
+ * per byte of the first key. Erased keys leave their bytes in the arena,
+ * which is compacted by the same rebuild once more than half of it is
+ * dead. Values are copied during a rebuild.
+ *
+ * Heights come from `Levels` called with the InlineStringKey, which sees
+ * the whole key. The default flipCoin rule gives every key the tower a
+ * SkipList<std::string, Value> would; HashedLevels<> hashes the key bytes.
+ */
+template <typename Value, typename Levels = FlipCoinLevels>
+class StringSkipList {
+public:
+  StringSkipList();
+  StringSkipList(const StringSkipList &) = delete;
+  StringSkipList &operator=(const StringSkipList &) = delete;
+
+  // These behave like the SkipList functions of the same name.
+  std::size_t size() const noexcept { return index->size(); }
+  bool isEmpty() const noexcept { return index->isEmpty(); }
+  unsigned numLayers() const noexcept { return index->numLayers(); }
+  bool insert(std::string_view k, const Value &v);
+  bool erase(std::string_view k);
+  bool contains(std::string_view k) const;
+  Value *tryFind(std::string_view k);
+  const Value *tryFind(std::string_view k) const;
+  Value &find(std::string_view k);
+  const Value &find(std::string_view k) const;
+  unsigned height(std::string_view k) const;
+  std::vector<std::string> allKeysInOrder() const;
+  void clear() noexcept;
+
+  // Calls fn(key, value) for every key, in increasing order.
+  template <typename Fn> void forEach(Fn fn) const;
+
+  // The prefix every key shares, and the bytes the key arena holds.
+  std::string_view sharedPrefix() const noexcept { return shared; }
+  std::size_t arenaBytes() const noexcept { return arena.used; }
+
+private:
+  using Index =
+      SkipList<InlineStringKey, Value, NodeArena, Levels, InlineStringLess>;
+
+  // The bytes of the keys, in chunks that never move.
+  struct KeyArena {
+    static constexpr std::size_t CHUNK_BYTES = 64 * 1024;
+
+    const char *store(const char *bytes, std::size_t n);
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::size_t chunk_left = 0;
+    char *cursor = nullptr;
+    std::size_t used = 0;
+  };
+
+  // The probe for k, or false if k cannot be in the list.
+  bool probe(std::string_view k, InlineStringKey &key) const noexcept;
+
+  // Rebuilds the towers and the arena for a shared prefix of `shared_length`
+  // bytes, keeping the keys and values.
+  void rebuild(std::size_t shared_length);
+
+  std::unique_ptr<Index> index;
+  KeyArena arena;
+  // Bytes in the arena that belong to erased keys.
+  std::size_t dead_bytes = 0;
+  std::string shared;
+};
+
+template <typename Value, typename Levels>
+const char *StringSkipList<Value, Levels>::KeyArena::store(const char *bytes,
+                                                   std::size_t n) {
+  if (n == 0) {
+    return cursor;
+  }
+  if (n > chunk_left) {
+    std::size_t chunk = std::max(n, CHUNK_BYTES);
+    chunks.emplace_back(new char[chunk]);
+    cursor = chunks.back().get();
+    chunk_left = chunk;
+  }
+  char *copy = cursor;
+  std::memcpy(copy, bytes, n);
+  cursor += n;
+  chunk_left -= n;
+  used += n;
+  return copy;
+}
+
+template <typename Value, typename Levels>
+StringSkipList<Value, Levels>::StringSkipList() : index(new Index()) {}
+
+template <typename Value, typename Levels>
+bool StringSkipList<Value, Levels>::probe(std::string_view k,
+                                  InlineStringKey &key) const noexcept {
+  if (k.size() < shared.size() ||
+      k.compare(0, shared.size(), shared) != 0) {
+    return false;
+  }
+  key = InlineStringKey(k.data(), k.size(), shared.size());
+  return true;
+}
+
+template <typename Value, typename Levels>
+void StringSkipList<Value, Levels>::rebuild(std::size_t shared_length) {
+  std::unique_ptr<Index> fresh(new Index());
+  KeyArena fresh_arena;
+
+  // Sorted with the new offset too, since every key still shares it.
+  std::vector<std::pair<InlineStringKey, Value>> entries;
+  entries.reserve(index->size());
+  for (auto it = index->begin(); it != index->end(); ++it) {
+    const char *bytes = fresh_arena.store(it.key().bytes, it.key().length);
+    entries.emplace_back(
+        InlineStringKey(bytes, it.key().length, shared_length),
+        std::move(it.value()));
+  }
+  fresh->bulkLoad(entries.begin(), entries.end());
+
+  index = std::move(fresh);
+  arena = std::move(fresh_arena);
+  dead_bytes = 0;
+}
+
+template <typename Value, typename Levels>
+bool StringSkipList<Value, Levels>::insert(std::string_view k, const Value &v) {
+  if (isEmpty()) {
+    // The first key shares all of itself.
+    clear();
+    shared.assign(k.data(), k.size());
+  } else if (k.size() < shared.size() ||
+             k.compare(0, shared.size(), shared) != 0) {
+    std::size_t common = static_cast<std::size_t>(
+        std::mismatch(shared.begin(),
+                      shared.begin() + std::min(shared.size(), k.size()),
+                      k.begin())
+            .first -
+        shared.begin());
+    shared.resize(common);
+    rebuild(common);
+  }
+
+  // The bytes only go into the arena once the key is known to be new; the
+  // finger lets the insert start where the search ended.
+  InlineStringKey key(k.data(), k.size(), shared.size());
+  typename Index::Finger finger;
+  auto it = index->lower_bound(key, finger);
+  if (it != index->end() && !InlineStringLess()(key, it.key())) {
+    return false;
+  }
+  key = InlineStringKey(arena.store(k.data(), k.size()), k.size(),
+                        shared.size());
+  return index->insert(key, v, finger);
+}
+
+template <typename Value, typename Levels>
+bool StringSkipList<Value, Levels>::erase(std::string_view k) {
+  InlineStringKey key;
+  if (!probe(k, key) || !index->erase(key)) {
+    return false;
+  }
+  dead_bytes += k.size();
+  if (isEmpty()) {
+    clear();
+  } else if (dead_bytes > KeyArena::CHUNK_BYTES &&
+             dead_bytes > arena.used / 2) {
+    rebuild(shared.size());
+  }
+  return true;
+}
+
+template <typename Value, typename Levels>
+bool StringSkipList<Value, Levels>::contains(std::string_view k) const {
+  InlineStringKey key;
+  return probe(k, key) && index->contains(key);
+}
+
+template <typename Value, typename Levels>
+Value *StringSkipList<Value, Levels>::tryFind(std::string_view k) {
+  InlineStringKey key;
+  return probe(k, key) ? index->tryFind(key) : nullptr;
+}
+
+template <typename Value, typename Levels>
+const Value *StringSkipList<Value, Levels>::tryFind(std::string_view k) const {
+  InlineStringKey key;
+  return probe(k, key) ? static_cast<const Index &>(*index).tryFind(key)
+                       : nullptr;
+}
+
+template <typename Value, typename Levels>
+Value &StringSkipList<Value, Levels>::find(std::string_view k) {
+  Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Value, typename Levels>
+const Value &StringSkipList<Value, Levels>::find(std::string_view k) const {
+  const Value *value = tryFind(k);
+
+  if (value) {
+    return *value;
+  } else {
+    throw RuntimeException("Key not found");
+  }
+}
+
+template <typename Value, typename Levels>
+unsigned StringSkipList<Value, Levels>::height(std::string_view k) const {
+  InlineStringKey key;
+  unsigned levels = probe(k, key) ? index->tryHeight(key) : 0;
+
+  if (levels == 0) {
+    throw RuntimeException("Key not found");
+  }
+
+  return levels;
+}
+
+template <typename Value, typename Levels>
+std::vector<std::string> StringSkipList<Value, Levels>::allKeysInOrder() const {
+  std::vector<std::string> keys;
+  keys.reserve(size());
+  forEach([&keys](std::string_view k, const Value &) { keys.emplace_back(k); });
+  return keys;
+}
+
+template <typename Value, typename Levels>
+template <typename Fn>
+void StringSkipList<Value, Levels>::forEach(Fn fn) const {
+  const Index &towers = *index;
+  for (auto it = towers.begin(); it != towers.end(); ++it) {
+    fn(it.key().view(), it.value());
+  }
+}
+
+template <typename Value, typename Levels>
+void StringSkipList<Value, Levels>::clear() noexcept {
+  index->clear();
+  arena = KeyArena();
+  dead_bytes = 0;
+  shared.clear();
+}
+
+#endif
@@ -0,0 +1,484 @@
+#ifndef ___WORKLOAD_DRIVER_HPP
+#define ___WORKLOAD_DRIVER_HPP
+
+#include "ConcurrentSkipList.hpp"
+#include "ShardedSkipList.hpp"
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Replaying workloads against the lists and measuring their latency, for
+ * reproducing tail latency offline. main.cpp wraps this in a command line.
+ *
+ * A workload is a sequence of steps over 64-bit keys, either read from a
+ * trace (readTrace) or generated (generateWorkload). runWorkload replays
+ * it on any number of threads, timing every step into a LatencyHistogram.
+ */
+
+enum class WorkloadOp { Insert, Find, Next, Previous };
+
+constexpr std::size_t WORKLOAD_OPS = 4;
+
+// The name a trace uses for op, e.g. "prev" for WorkloadOp::Previous.
+inline const char *workloadOpName(WorkloadOp op) noexcept {
+  static const char *const names[WORKLOAD_OPS] = {"insert", "find", "next",
+                                                  "prev"};
+  return names[static_cast<std::size_t>(op)];
+}
+
+struct WorkloadStep {
+  WorkloadOp op;
+  std::uint64_t key;
+  // Only used by inserts.
+  std::uint64_t value;
+};
+
+/**
+ * @brief A histogram of latencies in nanoseconds with a bounded relative
+ * error, in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BITS each have a bucket of their own. Above that,
+ * every power of two is split into 2^(SUB_BITS - 1) equal buckets, so a
+ * bucket is never wider than 1/32 of the values in it, from a nanosecond
+ * up to the largest 64-bit value, in under two thousand counters.
+ * Recording is a few shifts and an increment. valueAt() reports the
+ * largest value in the bucket, capped at the largest value recorded.
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned SUB_BITS = 6;
+  static constexpr std::size_t BUCKETS =
+      (64 - SUB_BITS + 2) * (std::size_t(1) << (SUB_BITS - 1));
+
+  LatencyHistogram() : counts(BUCKETS, 0) {}
+
+  void record(std::uint64_t value) noexcept {
+    counts[bucketOf(value)]++;
+    total++;
+    sum += value;
+    smallest = std::min(smallest, value);
+    largest = std::max(largest, value);
+  }
+
+  // Adds every value recorded in `other`.
+  void merge(const LatencyHistogram &other) noexcept;
+
+  std::uint64_t count() const noexcept { return total; }
+  // 0 when nothing has been recorded.
+  std::uint64_t min() const noexcept { return total ? smallest : 0; }
+  std::uint64_t max() const noexcept { return largest; }
+  double mean() const noexcept {
+    return total ? static_cast<double>(sum) / total : 0;
+  }
+
+  // The value that `percentile` percent of the recorded values are at or
+  // below, e.g. valueAt(99.9) for the p999. 0 when nothing was recorded.
+  std::uint64_t valueAt(double percentile) const noexcept;
+
+private:
+  static std::size_t bucketOf(std::uint64_t value) noexcept {
+    unsigned width = bitWidth(value);
+    if (width <= SUB_BITS) {
+      return static_cast<std::size_t>(value);
+    }
+    // The top SUB_BITS bits, whose first bit is always 1, pick the bucket
+    // within the power of two.
+    unsigned shift = width - SUB_BITS;
+    return (std::size_t(shift) << (SUB_BITS - 1)) +
+           static_cast<std::size_t>(value >> shift);
+  }
+
+  static std::uint64_t highestIn(std::size_t bucket) noexcept {
+    if (bucket < (std::size_t(1) << SUB_BITS)) {
+      return bucket;
+    }
+    unsigned shift = static_cast<unsigned>(bucket >> (SUB_BITS - 1)) - 1;
+    std::uint64_t top = bucket - (std::size_t(shift) << (SUB_BITS - 1));
+    return (top << shift) + ((std::uint64_t(1) << shift) - 1);
+  }
+
+  std::vector<std::uint64_t> counts;
+  std::uint64_t total = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t smallest = UINT64_MAX;
+  std::uint64_t largest = 0;
+};
+
+inline void LatencyHistogram::merge(const LatencyHistogram &other) noexcept {
+  for (std::size_t i = 0; i < BUCKETS; i++) {
+    counts[i] += other.counts[i];
+  }
+  total += other.total;
+  sum += other.sum;
+  smallest = std::min(smallest, other.smallest);
+  largest = std::max(largest, other.largest);
+}
+
+inline std::uint64_t LatencyHistogram::valueAt(double percentile) const
+    noexcept {
+  if (total == 0) {
+    return 0;
+  }
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  std::uint64_t rank = static_cast<std::uint64_t>(
+      std::ceil(percentile / 100 * static_cast<double>(total)));
+  rank = std::max<std::uint64_t>(rank, 1);
+
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return std::min(highestIn(i), largest);
+    }
+  }
+  return largest;
+}
+
+/**
+ * @brief Reads a trace: one step per line, as `insert <key> <value>`,
+ * `find <key>`, `next <key>` or `prev <key>`. Blank lines and lines
+ * starting with '#' are skipped. Throws a RuntimeException naming the
+ * first line it cannot read.
+ */
+inline std::vector<WorkloadStep> readTrace(std::istream &in) {
+  std::vector<WorkloadStep> steps;
+  std::string line;
+  for (std::size_t number = 1; std::getline(in, line); number++) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name) || name[0] == '#') {
+      continue;
+    }
+
+    WorkloadStep step{WorkloadOp::Find, 0, 0};
+    bool known = false;
+    for (std::size_t op = 0; op < WORKLOAD_OPS; op++) {
+      if (name == workloadOpName(static_cast<WorkloadOp>(op))) {
+        step.op = static_cast<WorkloadOp>(op);
+        known = true;
+      }
+    }
+    std::string rest;
+    if (!known || !(fields >> step.key) ||
+        (step.op == WorkloadOp::Insert && !(fields >> step.value)) ||
+        fields >> rest) {
+      throw RuntimeException("Bad trace line " + std::to_string(number));
+    }
+    steps.push_back(step);
+  }
+  return steps;
+}
+
+enum class KeyDistribution { Uniform, Zipfian, Sequential };
+
+// The fraction of the steps that are each op, in WorkloadOp order. They
+// need not add up to one.
+using WorkloadMix = std::array<double, WORKLOAD_OPS>;
+
+/**
+ * @brief Draws ranks in [0, n) from a Zipfian distribution, rank 0 being
+ * the most likely, with the method of Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases" (the one YCSB uses). Construction
+ * sums n terms; every draw after that is constant time.
+ */
+class ZipfianRanks {
+public:
+  explicit ZipfianRanks(std::uint64_t n, double skew = 0.99)
+      : items(n == 0 ? 1 : n), theta(skew), alpha(1 / (1 - skew)),
+        zeta_n(zeta(items, skew)) {
+    // With two items or fewer, every draw is settled before eta is needed.
+    eta = items > 2 ? (1 - std::pow(2.0 / items, 1 - theta)) /
+                          (1 - zeta(2, theta) / zeta_n)
+                    : 0;
+  }
+
+  template <typename Engine> std::uint64_t operator()(Engine &engine) const {
+    double u = std::uniform_real_distribution<double>(0, 1)(engine);
+    double uz = u * zeta_n;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + std::pow(0.5, theta)) {
+      return std::min<std::uint64_t>(1, items - 1);
+    }
+    std::uint64_t rank = static_cast<std::uint64_t>(
+        items * std::pow(eta * u - eta + 1, alpha));
+    return std::min(rank, items - 1);
+  }
+
+private:
+  static double zeta(std::uint64_t n, double theta) {
+    double sum = 0;
+    for (std::uint64_t i = 1; i <= n; i++) {
+      sum += 1 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  std::uint64_t items;
+  double theta;
+  double alpha;
+  double zeta_n;
+  double eta;
+};
+
+/**
+ * @brief `count` steps over keys in [0, key_space), with ops drawn in the
+ * proportions of `mix`. Sequential keys go 0, 1, 2, ... and wrap around;
+ * Zipfian ones make the smallest keys the hottest. The same seed gives the
+ * same workload.
+ */
+inline std::vector<WorkloadStep>
+generateWorkload(KeyDistribution distribution, std::uint64_t key_space,
+                 std::size_t count, const WorkloadMix &mix,
+                 std::uint64_t seed = 1) {
+  if (key_space == 0) {
+    throw RuntimeException("A workload needs at least one key");
+  }
+  std::mt19937_64 engine(seed);
+  std::discrete_distribution<std::size_t> ops(mix.begin(), mix.end());
+  std::uniform_int_distribution<std::uint64_t> uniform(0, key_space - 1);
+  ZipfianRanks zipfian(
+      distribution == KeyDistribution::Zipfian ? key_space : 1);
+
+  std::vector<WorkloadStep> steps;
+  steps.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    WorkloadStep step{static_cast<WorkloadOp>(ops(engine)), 0, 0};
+    switch (distribution) {
+    case KeyDistribution::Uniform:
+      step.key = uniform(engine);
+      break;
+    case KeyDistribution::Zipfian:
+      step.key = zipfian(engine);
+      break;
+    case KeyDistribution::Sequential:
+      step.key = i % key_space;
+      break;
+    }
+    step.value = mixBits(step.key);
+    steps.push_back(step);
+  }
+  return steps;
+}
+
+/**
+ * The lists runWorkload can drive. Each wraps one list of 64-bit keys and
+ * values. apply() performs a step and returns whether it hit: the insert
+ * added its key, or the key looked up (and its neighbour, for next and
+ * prev) was there. supports() is false for ops the list does not have,
+ * which runWorkload then skips.
+ */
+
+// A SkipList used by one thread at a time, without any locking.
+class SkipListTarget {
+public:
+  static constexpr const char *NAME = "skiplist";
+  static constexpr bool THREAD_SAFE = false;
+
+  static constexpr bool supports(WorkloadOp) noexcept { return true; }
+
+  bool apply(const WorkloadStep &step) {
+    switch (step.op) {
+    case WorkloadOp::Insert:
+      return list.insert(step.key, step.value);
+    case WorkloadOp::Find:
+      return list.tryFind(step.key) != nullptr;
+    case WorkloadOp::Next:
+      return list.tryNextKey(step.key) != nullptr;
+    case WorkloadOp::Previous:
+      return list.tryPreviousKey(step.key) != nullptr;
+    }
+    return false;
+  }
+
+private:
+  SkipList<std::uint64_t, std::uint64_t> list;
+};
+
+// A SkipList behind one reader/writer lock: lookups share it and inserts
+// hold it alone.
+class LockedSkipListTarget {
+public:
+  static constexpr const char *NAME = "locked";
+  static constexpr bool THREAD_SAFE = true;
+
+  static constexpr bool supports(WorkloadOp) noexcept { return true; }
+
+  bool apply(const WorkloadStep &step) {
+    if (step.op == WorkloadOp::Insert) {
+      std::unique_lock<std::shared_mutex> lock(mutex);
+      return list.insert(step.key, step.value);
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const SkipList<std::uint64_t, std::uint64_t> &reader = list;
+    switch (step.op) {
+    case WorkloadOp::Find:
+      return reader.tryFind(step.key) != nullptr;
+    case WorkloadOp::Next:
+      return reader.tryNextKey(step.key) != nullptr;
+    default:
+      return reader.tryPreviousKey(step.key) != nullptr;
+    }
+  }
+
+private:
+  std::shared_mutex mutex;
+  SkipList<std::uint64_t, std::uint64_t> list;
+};
+
+// ConcurrentSkipList and ShardedSkipList have no next or previous key.
+template <typename List> class MapTarget {
+public:
+  static constexpr bool THREAD_SAFE = true;
+
+  static constexpr bool supports(WorkloadOp op) noexcept {
+    return op == WorkloadOp::Insert || op == WorkloadOp::Find;
+  }
+
+  bool apply(const WorkloadStep &step) {
+    if (step.op == WorkloadOp::Insert) {
+      return list.insert(step.key, step.value);
+    }
+    std::uint64_t value;
+    return list.find(step.key, value);
+  }
+
+private:
+  List list;
+};
+
+class ConcurrentSkipListTarget
+    : public MapTarget<ConcurrentSkipList<std::uint64_t, std::uint64_t>> {
+public:
+  static constexpr const char *NAME = "concurrent";
+};
+
+class ShardedSkipListTarget
+    : public MapTarget<ShardedSkipList<std::uint64_t, std::uint64_t>> {
+public:
+  static constexpr const char *NAME = "sharded";
+};
+
+// What one runWorkload call measured, with one entry per op.
+struct WorkloadResult {
+  unsigned threads = 1;
+  // From the moment every thread starts until the last one finishes.
+  double seconds = 0;
+  std::array<LatencyHistogram, WORKLOAD_OPS> latency;
+  std::array<std::uint64_t, WORKLOAD_OPS> hits{};
+  std::array<std::uint64_t, WORKLOAD_OPS> skipped{};
+
+  // The latencies of every op together.
+  LatencyHistogram overall() const {
+    LatencyHistogram all;
+    for (const LatencyHistogram &op : latency) {
+      all.merge(op);
+    }
+    return all;
+  }
+
+  // Timed steps per second, over all threads.
+  double throughput() const {
+    return seconds > 0 ? overall().count() / seconds : 0;
+  }
+};
+
+/**
+ * @brief Replays `steps` against `target` on `threads` threads and times
+ * each step.
+ *
+ * Thread t takes steps t, t + threads, t + 2 * threads, ..., in order, so
+ * a single thread replays a trace exactly and several interleave it. The
+ * threads wait for each other before their first step. Each keeps its own
+ * histograms, which are merged once all are done. Every timing includes
+ * the cost of reading the clock twice, some tens of nanoseconds.
+ *
+ * Throws a RuntimeException if threads is 0, or more than 1 for a target
+ * that is not THREAD_SAFE.
+ */
+template <typename Target>
+WorkloadResult runWorkload(Target &target,
+                           const std::vector<WorkloadStep> &steps,
+                           unsigned threads) {
+  if (threads == 0) {
+    throw RuntimeException("A workload needs at least one thread");
+  }
+  if (threads > 1 && !Target::THREAD_SAFE) {
+    throw RuntimeException(std::string(Target::NAME) +
+                           " can only be used by one thread");
+  }
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<WorkloadResult> partial(threads);
+  std::atomic<unsigned> ready(0);
+  std::atomic<bool> go(false);
+
+  auto replay = [&](unsigned t) {
+    WorkloadResult &mine = partial[t];
+    ready.fetch_add(1);
+    while (!go.load()) {
+      std::this_thread::yield();
+    }
+    for (std::size_t i = t; i < steps.size(); i += threads) {
+      const WorkloadStep &step = steps[i];
+      std::size_t op = static_cast<std::size_t>(step.op);
+      if (!Target::supports(step.op)) {
+        mine.skipped[op]++;
+        continue;
+      }
+      Clock::time_point before = Clock::now();
+      bool hit = target.apply(step);
+      Clock::time_point after = Clock::now();
+      mine.latency[op].record(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(after - before)
+              .count()));
+      mine.hits[op] += hit;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (unsigned t = 1; t < threads; t++) {
+    workers.emplace_back(replay, t);
+  }
+  while (ready.load() != threads - 1) {
+    std::this_thread::yield();
+  }
+  Clock::time_point start = Clock::now();
+  go.store(true);
+  replay(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  Clock::time_point end = Clock::now();
+
+  WorkloadResult result;
+  result.threads = threads;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  for (const WorkloadResult &part : partial) {
+    for (std::size_t op = 0; op < WORKLOAD_OPS; op++) {
+      result.latency[op].merge(part.latency[op]);
+      result.hits[op] += part.hits[op];
+      result.skipped[op] += part.skipped[op];
+    }
+  }
+  return result;
+}
+
+#endif
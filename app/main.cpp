@@ -1,3 +1,234 @@
-#include "SkipList.hpp"
+#include "WorkloadDriver.hpp"
+#include "runtimeexcept.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
-int main() { return 0; }
+// Replays a trace, or a generated workload, against the lists and reports
+// throughput and latency percentiles. Run with --help for the options.
+
+namespace {
+
+const char *const USAGE =
+    "usage: a.out.app [options]\n"
+    "  --trace FILE       replay FILE (insert K V / find K / next K / prev K)\n"
+    "  --dist NAME        or generate: uniform, zipfian or sequential"
+    " (uniform)\n"
+    "  --keys N           generated keys are in [0, N) (1000000)\n"
+    "  --ops N            generated steps (1000000)\n"
+    "  --mix I:F:N:P      insert:find:next:prev proportions (10:70:10:10)\n"
+    "  --seed N           seed of the generated workload (1)\n"
+    "  --preload N        insert N keys spread over [0, keys) first\n"
+    "                     (keys / 2 when generating, 0 for a trace)\n"
+    "  --target LIST      comma separated: skiplist, locked, concurrent,\n"
+    "                     sharded (all of them)\n"
+    "  --threads LIST     comma separated thread counts (1)\n";
+
+struct Options {
+  std::string trace;
+  KeyDistribution distribution = KeyDistribution::Uniform;
+  std::uint64_t keys = 1000000;
+  std::size_t ops = 1000000;
+  WorkloadMix mix = {10, 70, 10, 10};
+  std::uint64_t seed = 1;
+  bool preload_given = false;
+  std::uint64_t preload = 0;
+  std::vector<std::string> targets = {"skiplist", "locked", "concurrent",
+                                      "sharded"};
+  std::vector<unsigned> threads = {1};
+};
+
+std::vector<std::string> splitOn(const std::string &text, char separator) {
+  std::vector<std::string> parts;
+  std::istringstream in(text);
+  std::string part;
+  while (std::getline(in, part, separator)) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+std::uint64_t toNumber(const std::string &text) {
+  std::size_t used = 0;
+  std::uint64_t n = 0;
+  try {
+    n = std::stoull(text, &used);
+  } catch (...) {
+    used = 0;
+  }
+  if (used == 0 || used != text.size() || text[0] == '-') {
+    throw RuntimeException("Not a number: " + text);
+  }
+  return n;
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 == argc) {
+      throw RuntimeException("Missing value for " + flag);
+    }
+    std::string value = argv[++i];
+
+    if (flag == "--trace") {
+      options.trace = value;
+    } else if (flag == "--dist") {
+      if (value == "uniform") {
+        options.distribution = KeyDistribution::Uniform;
+      } else if (value == "zipfian") {
+        options.distribution = KeyDistribution::Zipfian;
+      } else if (value == "sequential") {
+        options.distribution = KeyDistribution::Sequential;
+      } else {
+        throw RuntimeException("Unknown distribution " + value);
+      }
+    } else if (flag == "--keys") {
+      options.keys = toNumber(value);
+    } else if (flag == "--ops") {
+      options.ops = toNumber(value);
+    } else if (flag == "--mix") {
+      std::vector<std::string> parts = splitOn(value, ':');
+      if (parts.size() != WORKLOAD_OPS) {
+        throw RuntimeException("--mix needs four proportions");
+      }
+      double total = 0;
+      for (std::size_t op = 0; op < WORKLOAD_OPS; op++) {
+        options.mix[op] = static_cast<double>(toNumber(parts[op]));
+        total += options.mix[op];
+      }
+      if (total == 0) {
+        throw RuntimeException("--mix needs a proportion above 0");
+      }
+    } else if (flag == "--seed") {
+      options.seed = toNumber(value);
+    } else if (flag == "--preload") {
+      options.preload_given = true;
+      options.preload = toNumber(value);
+    } else if (flag == "--target") {
+      options.targets = splitOn(value, ',');
+    } else if (flag == "--threads") {
+      options.threads.clear();
+      for (const std::string &count : splitOn(value, ',')) {
+        options.threads.push_back(static_cast<unsigned>(toNumber(count)));
+      }
+    } else {
+      throw RuntimeException("Unknown option " + flag);
+    }
+  }
+
+  if (!options.preload_given) {
+    options.preload = options.trace.empty() ? options.keys / 2 : 0;
+  }
+  if (options.preload > options.keys) {
+    throw RuntimeException("--preload cannot exceed --keys");
+  }
+  return options;
+}
+
+void printRow(const char *name, const LatencyHistogram &latency,
+              std::uint64_t hits) {
+  std::cout << "  " << std::left << std::setw(8) << name << std::right
+            << std::setw(10) << latency.count() << std::setw(7)
+            << std::fixed << std::setprecision(1)
+            << (latency.count() ? 100.0 * hits / latency.count() : 0)
+            << std::setw(9) << std::setprecision(0) << latency.mean();
+  for (double percentile : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+    std::cout << std::setw(9) << latency.valueAt(percentile);
+  }
+  std::cout << std::setw(11) << latency.max() << '\n';
+}
+
+void printResult(const char *name, const WorkloadResult &result) {
+  LatencyHistogram all = result.overall();
+  std::uint64_t hits = 0;
+  for (std::uint64_t op_hits : result.hits) {
+    hits += op_hits;
+  }
+
+  std::cout << name << ", " << result.threads << " thread"
+            << (result.threads == 1 ? "" : "s") << ": " << all.count()
+            << " ops in " << std::fixed << std::setprecision(3)
+            << result.seconds << " s, " << std::setprecision(0)
+            << result.throughput() << " ops/s\n"
+            << "  op           count   hit%  mean ns      p50      p90"
+               "      p99     p999    p9999        max\n";
+  printRow("all", all, hits);
+  for (std::size_t op = 0; op < WORKLOAD_OPS; op++) {
+    const char *op_name = workloadOpName(static_cast<WorkloadOp>(op));
+    if (result.latency[op].count()) {
+      printRow(op_name, result.latency[op], result.hits[op]);
+    }
+    if (result.skipped[op]) {
+      std::cout << "  " << op_name << ": " << result.skipped[op]
+                << " skipped, not supported by " << name << '\n';
+    }
+  }
+  std::cout << '\n';
+}
+
+// Builds a fresh Target for every thread count, so that each run starts
+// from the same preloaded list.
+template <typename Target>
+void runTarget(const Options &options, const std::vector<WorkloadStep> &steps) {
+  for (unsigned threads : options.threads) {
+    if (threads > 1 && !Target::THREAD_SAFE) {
+      std::cout << Target::NAME << ", " << threads
+                << " threads: skipped, it only supports one thread\n\n";
+      continue;
+    }
+    Target target;
+    for (std::uint64_t i = 0; i < options.preload; i++) {
+      std::uint64_t key = options.keys / options.preload * i;
+      target.apply(WorkloadStep{WorkloadOp::Insert, key, mixBits(key)});
+    }
+    printResult(Target::NAME, runWorkload(target, steps, threads));
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc == 2 && std::string(argv[1]) == "--help") {
+    std::cout << USAGE;
+    return 0;
+  }
+
+  try {
+    Options options = parseOptions(argc, argv);
+
+    std::vector<WorkloadStep> steps;
+    if (options.trace.empty()) {
+      steps = generateWorkload(options.distribution, options.keys,
+                               options.ops, options.mix, options.seed);
+    } else {
+      std::ifstream in(options.trace);
+      if (!in) {
+        throw RuntimeException("Cannot open " + options.trace);
+      }
+      steps = readTrace(in);
+    }
+
+    for (const std::string &target : options.targets) {
+      if (target == SkipListTarget::NAME) {
+        runTarget<SkipListTarget>(options, steps);
+      } else if (target == LockedSkipListTarget::NAME) {
+        runTarget<LockedSkipListTarget>(options, steps);
+      } else if (target == ConcurrentSkipListTarget::NAME) {
+        runTarget<ConcurrentSkipListTarget>(options, steps);
+      } else if (target == ShardedSkipListTarget::NAME) {
+        runTarget<ShardedSkipListTarget>(options, steps);
+      } else {
+        throw RuntimeException("Unknown target " + target);
+      }
+    }
+  } catch (const RuntimeException &e) {
+    std::cerr << "error: " << e << '\n' << USAGE;
+    return 1;
+  }
+  return 0;
+}
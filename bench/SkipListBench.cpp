@@ -0,0 +1,482 @@
+// SkipListBench.cpp
+//
+// Google Benchmark suite for SkipList. Every benchmark runs for unsigned and
+// std::string keys at sizes from 1K up to --max_entries (1M by default; pass
+// --max_entries=100000000 for the full 100M sweep).
+//
+// Unless --benchmark_out is given, results are also written as JSON to
+// bench.json in the working directory, so runs can be compared over time.
+
+#include "AsyncLookup.hpp"
+#include "BlockSkipList.hpp"
+#include "FrozenSkipList.hpp"
+#include "ShardedSkipList.hpp"
+#include "SkipList.hpp"
+#include "StringSkipList.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Value = unsigned;
+
+// Keys are generated from an index so that every benchmark can name hits
+// (even indices, which are loaded) and misses (odd indices) cheaply.
+template <typename Key> Key makeKey(std::size_t i);
+
+template <> unsigned makeKey<unsigned>(std::size_t i) {
+  return static_cast<unsigned>(i);
+}
+
+// Fixed width, so that string order matches index order, and a shared
+// prefix like the tenant/region keys the string tables hold.
+template <> std::string makeKey<std::string>(std::size_t i) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "key/%012zu", i);
+  return buffer;
+}
+
+const char *keyName(unsigned *) { return "unsigned"; }
+const char *keyName(std::string *) { return "string"; }
+
+// flipCoin returns heads on every layer for keys whose bytes XOR to 0xFF,
+// so every one of these keys gets a tower as tall as the cap allows, like
+// the magic value 255 in the unit tests. The unsigned keys are distinct for
+// i < 2^24.
+template <typename Key> Key makeAdversarialKey(std::size_t i);
+
+template <> unsigned makeAdversarialKey<unsigned>(std::size_t i) {
+  unsigned high = static_cast<unsigned>(i) << 8;
+  unsigned fold = (high >> 24) ^ (high >> 16) ^ (high >> 8);
+  return high | ((fold & 0xFF) ^ 0xFF);
+}
+
+template <> std::string makeAdversarialKey<std::string>(std::size_t i) {
+  std::string key = makeKey<std::string>(i);
+  char fold = 0;
+  for (char c : key) {
+    fold ^= c;
+  }
+  key.push_back(static_cast<char>(fold ^ 0xFF));
+  return key;
+}
+
+template <typename Key> std::vector<Key> shuffledHits(std::size_t n) {
+  std::vector<Key> keys;
+  keys.reserve(n);
+  for (std::size_t i = 0; i < n; i++) {
+    keys.push_back(makeKey<Key>(2 * i));
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(n));
+  return keys;
+}
+
+template <typename Key> std::vector<Key> shuffledMisses(std::size_t n) {
+  std::vector<Key> keys = shuffledHits<Key>(n);
+  for (std::size_t i = 0; i < n; i++) {
+    keys[i] = makeKey<Key>(2 * i + 1);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(n + 1));
+  return keys;
+}
+
+// Read-only benchmarks share one list per key type and size; building the
+// large ones dominates the run otherwise.
+template <typename Key> const SkipList<Key, Value> &loadedList(std::size_t n) {
+  static std::map<std::size_t, std::unique_ptr<SkipList<Key, Value>>> lists;
+  std::unique_ptr<SkipList<Key, Value>> &list = lists[n];
+  if (!list) {
+    std::vector<std::pair<Key, Value>> pairs;
+    pairs.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+      pairs.emplace_back(makeKey<Key>(2 * i), static_cast<Value>(i));
+    }
+    list.reset(new SkipList<Key, Value>(pairs.begin(), pairs.end()));
+  }
+  return *list;
+}
+
+template <typename Key>
+void insertAll(benchmark::State &state, const std::vector<Key> &keys) {
+  for (auto _ : state) {
+    SkipList<Key, Value> *sl = new SkipList<Key, Value>();
+    for (const Key &k : keys) {
+      sl->insert(k, 0);
+    }
+    benchmark::DoNotOptimize(sl);
+    state.PauseTiming();
+    delete sl;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template <typename Key> void BM_InsertSequential(benchmark::State &state) {
+  std::vector<Key> keys;
+  for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0)); i++) {
+    keys.push_back(makeKey<Key>(i));
+  }
+  insertAll(state, keys);
+}
+
+template <typename Key> void BM_InsertRandom(benchmark::State &state) {
+  insertAll(state, shuffledHits<Key>(state.range(0)));
+}
+
+template <typename Key> void BM_InsertAdversarial(benchmark::State &state) {
+  std::vector<Key> keys;
+  for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0)); i++) {
+    keys.push_back(makeAdversarialKey<Key>(i));
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(keys.size()));
+  insertAll(state, keys);
+}
+
+template <typename Key>
+void lookupAll(benchmark::State &state, const std::vector<Key> &keys) {
+  const SkipList<Key, Value> &sl = loadedList<Key>(state.range(0));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl.tryFind(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Key> void BM_FindHit(benchmark::State &state) {
+  lookupAll(state, shuffledHits<Key>(state.range(0)));
+}
+
+template <typename Key> void BM_FindMiss(benchmark::State &state) {
+  lookupAll(state, shuffledMisses<Key>(state.range(0)));
+}
+
+template <typename Key> void BM_NextKey(benchmark::State &state) {
+  const SkipList<Key, Value> &sl = loadedList<Key>(state.range(0));
+  std::vector<Key> keys = shuffledHits<Key>(state.range(0));
+  keys.erase(std::remove(keys.begin(), keys.end(), *sl.largestKey()),
+             keys.end());
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl.nextKey(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Key> void BM_PreviousKey(benchmark::State &state) {
+  const SkipList<Key, Value> &sl = loadedList<Key>(state.range(0));
+  std::vector<Key> keys = shuffledHits<Key>(state.range(0));
+  keys.erase(std::remove(keys.begin(), keys.end(), *sl.smallestKey()),
+             keys.end());
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl.previousKey(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Key> void BM_BuildParallel(benchmark::State &state) {
+  std::vector<std::pair<Key, Value>> pairs;
+  for (const Key &k : shuffledHits<Key>(state.range(0))) {
+    pairs.emplace_back(k, 0);
+  }
+  for (auto _ : state) {
+    SkipList<Key, Value> *sl = new SkipList<Key, Value>();
+    sl->buildParallel(pairs.begin(), pairs.end());
+    benchmark::DoNotOptimize(sl);
+    state.PauseTiming();
+    delete sl;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+template <typename Key> void BM_ExportInOrder(benchmark::State &state) {
+  const SkipList<Key, Value> &sl = loadedList<Key>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl.exportInOrder());
+  }
+  state.SetItemsProcessed(state.iterations() * sl.size());
+}
+
+template <typename Key> void BM_AllKeysInOrder(benchmark::State &state) {
+  const SkipList<Key, Value> &sl = loadedList<Key>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl.allKeysInOrder());
+  }
+  state.SetItemsProcessed(state.iterations() * sl.size());
+}
+
+template <typename Key> void BM_Destroy(benchmark::State &state) {
+  std::vector<Key> keys = shuffledHits<Key>(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    SkipList<Key, Value> *sl = new SkipList<Key, Value>();
+    for (const Key &k : keys) {
+      sl->insert(k, 0);
+    }
+    state.ResumeTiming();
+    delete sl;
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Snapshots need trivially copyable keys, so this only runs for unsigned.
+void BM_LoadSnapshot(benchmark::State &state) {
+  const SkipList<unsigned, Value> &sl = loadedList<unsigned>(state.range(0));
+  std::string path = "bench_snapshot_" + std::to_string(state.range(0));
+  sl.save(path);
+  for (auto _ : state) {
+    SkipList<unsigned, Value> *loaded = new SkipList<unsigned, Value>();
+    loaded->load(path);
+    benchmark::DoNotOptimize(loaded);
+    state.PauseTiming();
+    delete loaded;
+    state.ResumeTiming();
+  }
+  std::remove(path.c_str());
+  state.SetItemsProcessed(state.iterations() * sl.size());
+}
+
+// The same lookups as FindHit<unsigned>, on the block-packed variant.
+void BM_BlockFindHit(benchmark::State &state) {
+  static std::map<std::size_t, std::unique_ptr<BlockSkipList<unsigned, Value>>>
+      lists;
+  std::unique_ptr<BlockSkipList<unsigned, Value>> &sl = lists[state.range(0)];
+  if (!sl) {
+    sl.reset(new BlockSkipList<unsigned, Value>());
+    for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0));
+         i++) {
+      sl->insert(makeKey<unsigned>(2 * i), static_cast<Value>(i));
+    }
+  }
+  std::vector<unsigned> keys = shuffledHits<unsigned>(state.range(0));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl->tryFind(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The same lookups as FindHit<string>, on towers with inline key prefixes.
+void BM_StringFindHit(benchmark::State &state) {
+  static std::map<std::size_t, std::unique_ptr<StringSkipList<Value>>> lists;
+  std::unique_ptr<StringSkipList<Value>> &sl = lists[state.range(0)];
+  if (!sl) {
+    sl.reset(new StringSkipList<Value>());
+    for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0));
+         i++) {
+      sl->insert(makeKey<std::string>(2 * i), static_cast<Value>(i));
+    }
+  }
+  std::vector<std::string> keys = shuffledHits<std::string>(state.range(0));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sl->tryFind(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The same lookups as FindHit<unsigned>, on the frozen form of the list.
+void BM_FrozenFindHit(benchmark::State &state) {
+  static std::map<std::size_t,
+                  std::unique_ptr<FrozenSkipList<unsigned, Value>>>
+      lists;
+  std::unique_ptr<FrozenSkipList<unsigned, Value>> &frozen =
+      lists[state.range(0)];
+  if (!frozen) {
+    frozen.reset(new FrozenSkipList<unsigned, Value>(
+        loadedList<unsigned>(state.range(0))));
+  }
+  std::vector<unsigned> keys = shuffledHits<unsigned>(state.range(0));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(frozen->tryFind(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The same lookups as FindHit<unsigned>, 64 at a time through a
+// LookupExecutor, which overlaps their cache misses.
+void BM_ExecutorFindHit(benchmark::State &state) {
+  using List = SkipList<unsigned, Value>;
+  const List &sl = loadedList<unsigned>(state.range(0));
+  std::vector<unsigned> keys = shuffledHits<unsigned>(state.range(0));
+  LookupExecutor<List> executor;
+  const std::size_t batch = 64;
+  std::size_t i = 0;
+  std::size_t hits = 0;
+  for (auto _ : state) {
+    for (std::size_t j = 0; j < batch; j++) {
+      executor.submit(sl.search(keys[i]),
+                      [&hits](const List::Search &s) { hits += s.found(); });
+      if (++i == keys.size()) {
+        i = 0;
+      }
+    }
+    executor.run();
+  }
+  benchmark::DoNotOptimize(hits);
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+
+// Writers on a shared ShardedSkipList, each inserting and erasing random
+// keys between the ones already there. Run with several threads to see the
+// shards spread the writes.
+void BM_ShardedInsertErase(benchmark::State &state) {
+  static std::map<std::size_t,
+                  std::unique_ptr<ShardedSkipList<unsigned, Value>>>
+      lists;
+  static std::mutex lists_mutex;
+  ShardedSkipList<unsigned, Value> *sl;
+  {
+    std::lock_guard<std::mutex> lock(lists_mutex);
+    std::unique_ptr<ShardedSkipList<unsigned, Value>> &list =
+        lists[state.range(0)];
+    if (!list) {
+      list.reset(new ShardedSkipList<unsigned, Value>());
+      for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0));
+           i++) {
+        list->insert(makeKey<unsigned>(2 * i), static_cast<Value>(i));
+      }
+      list->rebalance();
+    }
+    sl = list.get();
+  }
+  std::mt19937 random(
+      static_cast<unsigned>(std::hash<std::thread::id>()(
+          std::this_thread::get_id())));
+  const std::size_t n = static_cast<std::size_t>(state.range(0));
+  for (auto _ : state) {
+    unsigned key = makeKey<unsigned>(2 * (random() % n) + 1);
+    sl->insert(key, 0);
+    sl->erase(key);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+template <typename Key>
+void registerAll(std::size_t max_entries) {
+  struct Entry {
+    const char *name;
+    void (*fn)(benchmark::State &);
+    bool per_operation;
+  };
+  const Entry entries[] = {
+      {"InsertSequential", &BM_InsertSequential<Key>, false},
+      {"InsertRandom", &BM_InsertRandom<Key>, false},
+      {"InsertAdversarial", &BM_InsertAdversarial<Key>, false},
+      {"BuildParallel", &BM_BuildParallel<Key>, false},
+      {"FindHit", &BM_FindHit<Key>, true},
+      {"FindMiss", &BM_FindMiss<Key>, true},
+      {"NextKey", &BM_NextKey<Key>, true},
+      {"PreviousKey", &BM_PreviousKey<Key>, true},
+      {"AllKeysInOrder", &BM_AllKeysInOrder<Key>, false},
+      {"ExportInOrder", &BM_ExportInOrder<Key>, false},
+      {"Destroy", &BM_Destroy<Key>, false},
+  };
+
+  for (const Entry &entry : entries) {
+    std::string name =
+        std::string(entry.name) + "<" + keyName(static_cast<Key *>(nullptr)) +
+        ">";
+    benchmark::internal::Benchmark *b =
+        benchmark::RegisterBenchmark(name.c_str(), entry.fn);
+    for (std::size_t n = 1000; n <= max_entries; n *= 10) {
+      b->Arg(static_cast<int64_t>(n));
+    }
+    b->Unit(entry.per_operation ? benchmark::kNanosecond
+                                : benchmark::kMillisecond);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::size_t max_entries = 1000000;
+  bool has_out = false;
+
+  std::vector<char *> args;
+  static char default_out[] = "--benchmark_out=bench.json";
+  static char default_format[] = "--benchmark_out_format=json";
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.rfind("--max_entries=", 0) == 0) {
+      max_entries = std::strtoull(argv[i] + 14, nullptr, 10);
+      continue;
+    }
+    if (arg.rfind("--benchmark_out=", 0) == 0) {
+      has_out = true;
+    }
+    args.push_back(argv[i]);
+  }
+  if (!has_out) {
+    args.push_back(default_out);
+    args.push_back(default_format);
+  }
+
+  registerAll<unsigned>(max_entries);
+  registerAll<std::string>(max_entries);
+  benchmark::internal::Benchmark *load =
+      benchmark::RegisterBenchmark("LoadSnapshot<unsigned>", BM_LoadSnapshot);
+  benchmark::internal::Benchmark *block =
+      benchmark::RegisterBenchmark("BlockFindHit<unsigned>", BM_BlockFindHit);
+  benchmark::internal::Benchmark *strings =
+      benchmark::RegisterBenchmark("StringFindHit<string>", BM_StringFindHit);
+  benchmark::internal::Benchmark *frozen =
+      benchmark::RegisterBenchmark("FrozenFindHit<unsigned>", BM_FrozenFindHit);
+  benchmark::internal::Benchmark *executor = benchmark::RegisterBenchmark(
+      "ExecutorFindHit<unsigned>", BM_ExecutorFindHit);
+  benchmark::internal::Benchmark *sharded = benchmark::RegisterBenchmark(
+      "ShardedInsertErase<unsigned>", BM_ShardedInsertErase);
+  for (std::size_t n = 1000; n <= max_entries; n *= 10) {
+    load->Arg(static_cast<int64_t>(n));
+    block->Arg(static_cast<int64_t>(n));
+    strings->Arg(static_cast<int64_t>(n));
+    frozen->Arg(static_cast<int64_t>(n));
+    executor->Arg(static_cast<int64_t>(n));
+    sharded->Arg(static_cast<int64_t>(n));
+  }
+  load->Unit(benchmark::kMillisecond);
+  block->Unit(benchmark::kNanosecond);
+  strings->Unit(benchmark::kNanosecond);
+  frozen->Unit(benchmark::kNanosecond);
+  executor->Unit(benchmark::kNanosecond);
+  sharded->Unit(benchmark::kNanosecond)->ThreadRange(1, 8)->UseRealTime();
+
+  int count = static_cast<int>(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
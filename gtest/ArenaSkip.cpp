@@ -0,0 +1,84 @@
+#include "NodeAllocator.hpp"
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+TEST(Arena, ReusesFreedBlocksOfTheSameSize) {
+  NodeArena arena;
+  void *a = arena.allocate(40);
+  void *b = arena.allocate(72);
+  arena.deallocate(a, 40);
+  EXPECT_EQ(arena.allocate(40), a);
+  EXPECT_NE(arena.allocate(72), b);
+  arena.deallocate(b, 72);
+  EXPECT_EQ(arena.allocate(72), b);
+}
+
+TEST(Arena, BlocksAreAligned) {
+  NodeArena arena;
+  for (std::size_t bytes = 1; bytes < 200; bytes += 7) {
+    void *p = arena.allocate(bytes);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % NodeArena::ALIGNMENT, 0u);
+  }
+}
+
+TEST(Arena, LargeBlocksAreReturnedImmediately) {
+  NodeArena arena;
+  std::size_t before = arena.reservedBytes();
+  void *p = arena.allocate(NodeArena::MAX_CHUNK_BYTES);
+  EXPECT_GT(arena.reservedBytes(), before + NodeArena::MAX_CHUNK_BYTES - 1);
+  arena.deallocate(p, NodeArena::MAX_CHUNK_BYTES);
+  EXPECT_EQ(arena.reservedBytes(), before);
+}
+
+TEST(Arena, SharedBlocksOutliveTheirArena) {
+  NodeArena *first = new NodeArena();
+  NodeArena second;
+  void *small = first->allocate(64);
+  void *large = first->allocate(NodeArena::MAX_CHUNK_BYTES);
+  std::size_t reserved = first->reservedBytes();
+  first->share(second);
+  EXPECT_EQ(second.reservedBytes(), reserved);
+  delete first;
+
+  // Both blocks are still there, and the small one is reused by the arena
+  // it was freed to.
+  static_cast<char *>(small)[63] = 1;
+  static_cast<char *>(large)[NodeArena::MAX_CHUNK_BYTES - 1] = 1;
+  second.deallocate(small, 64);
+  second.deallocate(large, NodeArena::MAX_CHUNK_BYTES);
+  EXPECT_EQ(second.allocate(64), small);
+  EXPECT_EQ(second.reservedBytes(), reserved);
+}
+
+TEST(Arena, NewDeleteAllocatorMatchesArena) {
+  SkipList<unsigned, unsigned, NewDeleteAllocator> plain;
+  SkipList<unsigned, unsigned> arena;
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_TRUE(plain.insert(i * 7 % 1000, i));
+    EXPECT_TRUE(arena.insert(i * 7 % 1000, i));
+  }
+  EXPECT_EQ(plain.allKeysInOrder(), arena.allKeysInOrder());
+  EXPECT_EQ(plain.numLayers(), arena.numLayers());
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_EQ(plain.height(i), arena.height(i));
+    EXPECT_EQ(plain.find(i), arena.find(i));
+  }
+}
+
+TEST(Arena, StringsAreDestroyed) {
+  SkipList<std::string, std::string, NewDeleteAllocator> plain;
+  SkipList<std::string, std::string> arena;
+  for (unsigned i = 0; i < 100; i++) {
+    std::string long_value(100, static_cast<char>('a' + i % 26));
+    plain.insert(std::to_string(i), long_value);
+    arena.insert(std::to_string(i), long_value);
+  }
+  EXPECT_EQ(plain.allKeysInOrder(), arena.allKeysInOrder());
+}
+
+} // namespace
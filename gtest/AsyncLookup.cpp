@@ -0,0 +1,181 @@
+#include "AsyncLookup.hpp"
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using List = SkipList<unsigned, unsigned, NodeArena, HashedLevels<>>;
+
+TEST(Async, SearchStepsToFindAndLowerBound) {
+  List sl;
+  const List &csl = sl;
+  List::Search empty = csl.search(5);
+  EXPECT_FALSE(empty.done());
+  while (!empty.step()) {
+  }
+  EXPECT_FALSE(empty.found());
+  EXPECT_EQ(empty.value(), nullptr);
+  EXPECT_TRUE(empty.position() == csl.end());
+
+  for (unsigned i = 0; i < 5000; i++) {
+    sl.insert(i * 3, i);
+  }
+  for (unsigned k = 0; k < 15010; k++) {
+    List::Search s = csl.search(k);
+    unsigned steps = 0;
+    while (!s.step()) {
+      steps++;
+    }
+    EXPECT_TRUE(s.done());
+    EXPECT_LT(steps, 200);
+    EXPECT_EQ(s.found(), k % 3 == 0 && k < 15000);
+    EXPECT_EQ(s.value(), csl.tryFind(k));
+    EXPECT_TRUE(s.position() == csl.lower_bound(k));
+  }
+
+  SkipList<std::string, int> words;
+  words.insert("kiwi", 1);
+  words.insert("fig", 2);
+  std::string key = "grape";
+  auto s = words.search(key);
+  while (!s.step()) {
+  }
+  EXPECT_FALSE(s.found());
+  EXPECT_EQ(s.position().key(), "kiwi");
+}
+
+TEST(Async, ExecutorInterleavesAndChainsSearches) {
+  List sl;
+  for (unsigned i = 0; i < 20000; i++) {
+    sl.insert(i, (i * 7 + 1) % 20000);
+  }
+
+  std::mt19937 random(3);
+  std::vector<unsigned> keys(500);
+  for (unsigned &key : keys) {
+    key = random() % 25000;
+  }
+
+  // Every hit looks its value up again, the way a request that follows a
+  // pointer would.
+  LookupExecutor<List> executor(4);
+  std::vector<const unsigned *> first(keys.size(), nullptr);
+  std::vector<const unsigned *> second(keys.size(), nullptr);
+  unsigned callbacks = 0;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    executor.submit(sl.search(keys[i]), [&, i](const List::Search &s) {
+      callbacks++;
+      first[i] = s.value();
+      if (first[i]) {
+        executor.submit(sl.search(*first[i]),
+                        [&, i](const List::Search &again) {
+                          callbacks++;
+                          second[i] = again.value();
+                        });
+      }
+    });
+  }
+  EXPECT_EQ(executor.pending(), keys.size());
+  executor.run();
+  EXPECT_EQ(executor.pending(), 0);
+
+  unsigned hits = 0;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(first[i], sl.tryFind(keys[i]));
+    if (first[i]) {
+      hits++;
+      EXPECT_EQ(second[i], sl.tryFind(*first[i]));
+      EXPECT_NE(second[i], nullptr);
+    }
+  }
+  EXPECT_EQ(callbacks, keys.size() + hits);
+}
+
+TEST(Async, FinishedSearchesAreNotSteppedAgain) {
+  List sl;
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert(i, i);
+  }
+  const List &csl = sl;
+
+  // A search for a key past the end finishes standing on tail.
+  unsigned past_end = 1000;
+  List::Search finished = csl.search(past_end);
+  while (!finished.step()) {
+  }
+  EXPECT_TRUE(finished.step());
+  EXPECT_FALSE(finished.found());
+  EXPECT_TRUE(finished.position() == csl.end());
+
+  List::Search none;
+  EXPECT_TRUE(none.done());
+  EXPECT_TRUE(none.step());
+  EXPECT_EQ(none.value(), nullptr);
+
+  LookupExecutor<List> executor(2);
+  unsigned callbacks = 0;
+  for (const List::Search &s : {finished, none, finished}) {
+    executor.submit(s, [&](const List::Search &done) {
+      callbacks++;
+      EXPECT_TRUE(done.done());
+      EXPECT_EQ(done.value(), nullptr);
+    });
+  }
+  executor.run();
+  EXPECT_EQ(callbacks, 3);
+}
+
+#ifdef SKIPLIST_COROUTINES
+// The least a coroutine needs: it starts at once and nobody waits for it.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+Detached sumChain(const List &sl, unsigned k, LookupExecutor<List> &executor,
+                  unsigned &sum) {
+  for (unsigned hop = 0; hop < 3; hop++) {
+    const unsigned *value = co_await co_find(sl, k, executor);
+    if (!value) {
+      co_return;
+    }
+    sum += *value;
+    k = *value;
+  }
+  auto it = co_await co_lower_bound(sl, k + 1, executor);
+  sum += it == sl.end() ? 0 : it.key();
+}
+
+TEST(Async, CoroutinesResumeFromTheExecutor) {
+  List sl;
+  for (unsigned i = 0; i < 1000; i += 2) {
+    sl.insert(i, (i + 10) % 1000);
+  }
+
+  LookupExecutor<List> executor;
+  std::vector<unsigned> sums(100, 0);
+  for (unsigned i = 0; i < sums.size(); i++) {
+    sumChain(sl, i * 2, executor, sums[i]);
+  }
+  EXPECT_EQ(executor.pending(), sums.size());
+  for (unsigned sum : sums) {
+    EXPECT_EQ(sum, 0);
+  }
+  executor.run();
+  for (unsigned i = 0; i < sums.size(); i++) {
+    unsigned k = i * 2;
+    unsigned expected = (k + 10) + (k + 20) + (k + 30) + (k + 32);
+    EXPECT_EQ(sums[i], expected);
+  }
+}
+#endif
+
+} // namespace
@@ -0,0 +1,99 @@
+#include "BlockSkipList.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Runs the same random inserts and erases on a BlockSkipList and a std::map
+// and checks that they agree after every step.
+template <typename Key> void expectMatchesMap(Key lo, Key hi) {
+  BlockSkipList<Key, unsigned> sl;
+  std::map<Key, unsigned> expected;
+  std::mt19937_64 random(7);
+  std::uniform_int_distribution<long long> pick(static_cast<long long>(lo),
+                                                static_cast<long long>(hi));
+
+  for (unsigned step = 0; step < 20000; step++) {
+    Key k = static_cast<Key>(pick(random));
+    if (random() % 3 == 0) {
+      EXPECT_EQ(sl.erase(k), expected.erase(k) == 1);
+    } else {
+      EXPECT_EQ(sl.insert(k, step), expected.emplace(k, step).second);
+    }
+    ASSERT_EQ(sl.size(), expected.size());
+
+    Key probe = static_cast<Key>(pick(random));
+    auto it = expected.find(probe);
+    const unsigned *value = sl.tryFind(probe);
+    if (it == expected.end()) {
+      EXPECT_EQ(value, nullptr);
+    } else {
+      ASSERT_NE(value, nullptr);
+      EXPECT_EQ(*value, it->second);
+    }
+  }
+
+  std::vector<Key> keys;
+  for (const auto &entry : expected) {
+    keys.push_back(entry.first);
+  }
+  EXPECT_EQ(sl.allKeysInOrder(), keys);
+}
+
+TEST(BlockSkip, MatchesMapForUnsignedKeys) {
+  expectMatchesMap<unsigned>(0, 3000);
+  expectMatchesMap<unsigned>(std::numeric_limits<unsigned>::max() - 3000,
+                             std::numeric_limits<unsigned>::max());
+}
+
+TEST(BlockSkip, MatchesMapForSignedAndWideKeys) {
+  expectMatchesMap<int>(-1500, 1500);
+  expectMatchesMap<std::uint64_t>(0, 3000);
+  expectMatchesMap<double>(-1500, 1500);
+}
+
+TEST(BlockSkip, PacksKeysIntoBlocks) {
+  using List = BlockSkipList<unsigned, unsigned>;
+  List sl;
+  EXPECT_TRUE(sl.isEmpty());
+  EXPECT_EQ(sl.numLayers(), 2);
+  EXPECT_THROW(sl.find(0), RuntimeException);
+
+  const unsigned n = 10000;
+  for (unsigned i = 0; i < n; i++) {
+    EXPECT_TRUE(sl.insert(i, i * 2));
+  }
+  // Appending splits the last block in half every BLOCK_KEYS / 2 keys.
+  EXPECT_EQ(List::BLOCK_KEYS, 16);
+  EXPECT_LE(sl.numBlocks(), n / 8 + 1);
+  EXPECT_EQ(sl.find(1234), 2468);
+  sl.find(1234) = 1;
+  EXPECT_EQ(sl.find(1234), 1);
+
+  // The largest key is also what fills the unused slots of a block.
+  const unsigned largest = std::numeric_limits<unsigned>::max();
+  EXPECT_FALSE(sl.contains(largest));
+  EXPECT_TRUE(sl.insert(largest, 5));
+  EXPECT_EQ(sl.find(largest), 5);
+  EXPECT_FALSE(sl.insert(largest, 6));
+
+  for (unsigned i = 0; i < n; i++) {
+    EXPECT_TRUE(sl.erase(i));
+  }
+  EXPECT_EQ(sl.size(), 1);
+  EXPECT_EQ(sl.numBlocks(), 1);
+  EXPECT_TRUE(sl.erase(largest));
+  EXPECT_EQ(sl.numBlocks(), 0);
+  EXPECT_EQ(sl.numLayers(), 2);
+
+  sl.insert(3, 3);
+  sl.clear();
+  EXPECT_TRUE(sl.isEmpty());
+  EXPECT_FALSE(sl.contains(3));
+}
+
+} // namespace
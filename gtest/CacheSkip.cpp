@@ -0,0 +1,121 @@
+#include "CacheSkipList.hpp"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <string>
+
+namespace {
+
+// A clock that only moves when a test moves it.
+struct FakeClock {
+  using duration = std::chrono::milliseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept { return current; }
+  static void advance(duration d) noexcept { current += d; }
+
+  static inline time_point current{};
+};
+
+using Cache = CacheSkipList<unsigned, unsigned, FakeClock>;
+using std::chrono::milliseconds;
+
+TEST(Cache, EntryLimitEvictsTheLeastRecentlyUsed) {
+  CacheLimits limits;
+  limits.max_entries = 3;
+  CacheSkipList<std::string, unsigned> cache(limits);
+
+  EXPECT_TRUE(cache.insert("a", 1));
+  EXPECT_TRUE(cache.insert("b", 2));
+  EXPECT_TRUE(cache.insert("c", 3));
+  EXPECT_FALSE(cache.insert("a", 10));
+  EXPECT_EQ(cache.find("a"), 1);
+
+  // "b" is now the least recently used.
+  EXPECT_TRUE(cache.insert("d", 4));
+  EXPECT_EQ(cache.size(), 3);
+  EXPECT_FALSE(cache.contains("b"));
+  EXPECT_EQ(cache.tryFind("b"), nullptr);
+  EXPECT_THROW(cache.find("b"), RuntimeException);
+
+  EXPECT_FALSE(cache.insert_or_assign("c", 30));
+  EXPECT_TRUE(cache.insert("e", 5));
+  EXPECT_FALSE(cache.contains("a"));
+  EXPECT_EQ(cache.find("c"), 30);
+  EXPECT_TRUE(cache.contains("d"));
+
+  EXPECT_EQ(cache.stats().evictions, 2);
+  EXPECT_EQ(cache.stats().hits, 2);
+  EXPECT_EQ(cache.stats().misses, 2);
+  EXPECT_EQ(cache.stats().expirations, 0);
+
+  EXPECT_TRUE(cache.erase("d"));
+  EXPECT_FALSE(cache.erase("d"));
+  EXPECT_EQ(cache.size(), 2);
+  cache.resetStats();
+  EXPECT_EQ(cache.stats().hits, 0);
+}
+
+TEST(Cache, ByteBudgetCountsTowers) {
+  CacheLimits limits;
+  limits.max_bytes = 64 * 1024;
+  Cache cache(limits);
+
+  for (unsigned i = 0; i < 20000; i++) {
+    cache.insert(i, i);
+    EXPECT_LE(cache.bytes(), limits.max_bytes);
+  }
+  EXPECT_GT(cache.size(), 500);
+  EXPECT_EQ(cache.stats().evictions, 20000 - cache.size());
+
+  // The most recent keys are the ones still there.
+  EXPECT_TRUE(cache.contains(19999));
+  EXPECT_FALSE(cache.contains(0));
+
+  cache.clear();
+  EXPECT_TRUE(cache.isEmpty());
+  EXPECT_EQ(cache.bytes(), 0);
+  EXPECT_TRUE(cache.insert(0, 0));
+  EXPECT_GT(cache.bytes(), 0);
+}
+
+TEST(Cache, ExpiredEntriesAreMissingAndSweptAway) {
+  Cache cache;
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_TRUE(cache.insert(i, i, milliseconds(10)));
+  }
+  EXPECT_TRUE(cache.insert(1000, 1000));
+  FakeClock::advance(milliseconds(5));
+  EXPECT_TRUE(cache.contains(50));
+  EXPECT_FALSE(cache.insert_or_assign(7, 70, milliseconds(100)));
+
+  FakeClock::advance(milliseconds(10));
+  EXPECT_FALSE(cache.contains(50));
+  EXPECT_EQ(cache.tryFind(50), nullptr);
+  EXPECT_EQ(cache.stats().expirations, 1);
+  EXPECT_EQ(cache.size(), 100);
+  EXPECT_EQ(cache.find(7), 70);
+  EXPECT_EQ(cache.find(1000), 1000);
+
+  // An expired key can be inserted again.
+  EXPECT_TRUE(cache.insert(60, 600));
+  EXPECT_EQ(cache.find(60), 600);
+
+  // Every insert sweeps a few more entries, and evictExpired the rest.
+  std::size_t before = cache.size();
+  for (unsigned i = 0; i < 5; i++) {
+    cache.insert(2000 + i, i);
+  }
+  EXPECT_LT(cache.size(), before + 5);
+  cache.evictExpired(cache.size() + 1);
+  EXPECT_EQ(cache.size(), 3 + 5);
+  EXPECT_TRUE(cache.contains(7));
+  EXPECT_TRUE(cache.contains(60));
+  EXPECT_TRUE(cache.contains(1000));
+  EXPECT_EQ(cache.stats().expirations, 99);
+  EXPECT_EQ(cache.stats().evictions, 0);
+}
+
+} // namespace
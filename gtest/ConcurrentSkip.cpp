@@ -0,0 +1,248 @@
+#include "ConcurrentSkipList.hpp"
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+TEST(Concurrent, SingleThreadMatchesSkipList) {
+  ConcurrentSkipList<unsigned, unsigned> csl;
+  SkipList<unsigned, unsigned> sl;
+  EXPECT_EQ(csl.numLayers(), 2);
+  EXPECT_TRUE(csl.isEmpty());
+
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_TRUE(csl.insert(i, 100 + i));
+    sl.insert(i, 100 + i);
+  }
+  csl.insert(255, 0);
+  EXPECT_FALSE(csl.insert(255, 0));
+
+  EXPECT_EQ(csl.size(), 1000);
+  EXPECT_EQ(csl.numLayers(), sl.numLayers());
+  EXPECT_EQ(csl.allKeysInOrder(), sl.allKeysInOrder());
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_EQ(csl.height(i), sl.height(i));
+    EXPECT_EQ(csl.find(i), 100 + i);
+  }
+  EXPECT_THROW(csl.find(1000), RuntimeException);
+  EXPECT_THROW(csl.height(1000), RuntimeException);
+}
+
+TEST(Concurrent, EraseAndReinsert) {
+  ConcurrentSkipList<std::string, unsigned> csl;
+  for (unsigned i = 0; i < 100; i++) {
+    csl.insert(std::to_string(i), i);
+  }
+  for (unsigned i = 0; i < 100; i += 2) {
+    EXPECT_TRUE(csl.erase(std::to_string(i)));
+    EXPECT_FALSE(csl.erase(std::to_string(i)));
+  }
+  EXPECT_EQ(csl.size(), 50);
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(csl.contains(std::to_string(i)), i % 2 == 1);
+  }
+  EXPECT_TRUE(csl.insert("0", 1000));
+  unsigned value = 0;
+  EXPECT_TRUE(csl.find("0", value));
+  EXPECT_EQ(value, 1000);
+}
+
+TEST(Concurrent, ParallelInsertsOfDisjointRanges) {
+  ConcurrentSkipList<unsigned, unsigned> csl;
+  const unsigned threads = 8;
+  const unsigned per_thread = 5000;
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&csl, t]() {
+      for (unsigned i = 0; i < per_thread; i++) {
+        unsigned key = i * threads + t;
+        EXPECT_TRUE(csl.insert(key, key + 1));
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_EQ(csl.size(), threads * per_thread);
+  std::vector<unsigned> keys = csl.allKeysInOrder();
+  ASSERT_EQ(keys.size(), threads * per_thread);
+  for (unsigned i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(keys[i], i);
+  }
+  for (unsigned i = 0; i < threads * per_thread; i++) {
+    EXPECT_EQ(csl.find(i), i + 1);
+  }
+}
+
+TEST(Concurrent, MixedInsertEraseFind) {
+  ConcurrentSkipList<unsigned, unsigned> csl;
+  const unsigned threads = 6;
+  const unsigned keys = 512;
+  std::atomic<unsigned> inserted{0};
+  std::atomic<unsigned> erased{0};
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      unsigned seed = t * 2654435761u + 1;
+      for (unsigned i = 0; i < 20000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        unsigned key = (seed >> 8) % keys;
+        unsigned value = 0;
+        switch ((seed >> 4) % 3) {
+        case 0:
+          if (csl.insert(key, key)) {
+            inserted++;
+          }
+          break;
+        case 1:
+          if (csl.erase(key)) {
+            erased++;
+          }
+          break;
+        default:
+          if (csl.find(key, value)) {
+            EXPECT_EQ(value, key);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<unsigned> remaining = csl.allKeysInOrder();
+  EXPECT_EQ(remaining.size(), inserted - erased);
+  EXPECT_EQ(csl.size(), inserted - erased);
+  for (unsigned i = 1; i < remaining.size(); i++) {
+    EXPECT_LT(remaining[i - 1], remaining[i]);
+  }
+}
+
+TEST(Concurrent, SnapshotKeepsItsPointInTime) {
+  ConcurrentSkipList<unsigned, unsigned> csl;
+  for (unsigned i = 0; i < 100; i++) {
+    csl.insert(i, i);
+  }
+
+  auto before = csl.snapshot();
+  for (unsigned i = 0; i < 100; i += 2) {
+    csl.erase(i);
+  }
+  csl.insert(100, 100);
+  EXPECT_TRUE(csl.insert(0, 1000));
+
+  EXPECT_EQ(csl.size(), 52);
+  EXPECT_EQ(csl.find(0), 1000);
+  EXPECT_FALSE(csl.contains(2));
+
+  std::vector<unsigned> keys = before.allKeysInOrder();
+  ASSERT_EQ(keys.size(), 100);
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(keys[i], i);
+    EXPECT_EQ(before.find(i), i);
+  }
+  EXPECT_FALSE(before.contains(100));
+  EXPECT_THROW(before.find(100), RuntimeException);
+
+  auto after = csl.snapshot();
+  EXPECT_GT(after.version(), before.version());
+  EXPECT_EQ(after.allKeysInOrder(), csl.allKeysInOrder());
+  EXPECT_EQ(after.find(0), 1000);
+
+  unsigned sum = 0;
+  after.forEach([&sum](const unsigned &k, const unsigned &) { sum += k; });
+  EXPECT_EQ(sum, 2500 + 100);
+}
+
+TEST(Concurrent, ClosingSnapshotsReleasesErasedTowers) {
+  ConcurrentSkipList<std::string, unsigned> csl;
+  csl.insert("a", 1);
+  csl.insert("b", 2);
+  {
+    auto first = csl.snapshot();
+    EXPECT_TRUE(csl.erase("a"));
+    EXPECT_TRUE(csl.insert("a", 3));
+    EXPECT_TRUE(csl.erase("a"));
+    EXPECT_FALSE(csl.erase("a"));
+    {
+      auto second = csl.snapshot();
+      EXPECT_TRUE(csl.insert("a", 4));
+      EXPECT_FALSE(second.contains("a"));
+    }
+    EXPECT_EQ(first.find("a"), 1);
+    EXPECT_EQ(csl.find("a"), 4);
+    EXPECT_EQ(csl.allKeysInOrder(), (std::vector<std::string>{"a", "b"}));
+  }
+
+  // Nothing needs the dead towers any more, so the list is back to exactly
+  // its live keys.
+  std::vector<std::string> keys;
+  unsigned values = 0;
+  auto now = csl.snapshot();
+  now.forEach([&](const std::string &k, const unsigned &v) {
+    keys.push_back(k);
+    values += v;
+  });
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "b"}));
+  EXPECT_EQ(values, 6);
+  EXPECT_TRUE(csl.erase("a"));
+  EXPECT_EQ(now.find("a"), 4);
+  EXPECT_EQ(csl.size(), 1);
+}
+
+TEST(Concurrent, SnapshotsDuringWritesAreConsistent) {
+  ConcurrentSkipList<unsigned, unsigned> csl;
+  const unsigned window = 64;
+  const unsigned writes = 20000;
+  std::atomic<bool> done{false};
+
+  // At every point in time the list holds a run of `window` consecutive
+  // keys (fewer at the start), so every snapshot must too.
+  std::thread writer([&]() {
+    for (unsigned i = 0; i < writes; i++) {
+      csl.insert(i, i * 3);
+      if (i >= window) {
+        csl.erase(i - window);
+      }
+    }
+    done = true;
+  });
+
+  std::vector<std::thread> readers;
+  for (unsigned t = 0; t < 2; t++) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        auto view = csl.snapshot();
+        std::vector<unsigned> keys = view.allKeysInOrder();
+        if (keys.empty()) {
+          continue;
+        }
+        EXPECT_LE(keys.size(), window + 1);
+        EXPECT_TRUE(keys.front() == 0 || keys.size() >= window);
+        for (unsigned i = 1; i < keys.size(); i++) {
+          EXPECT_EQ(keys[i], keys[i - 1] + 1);
+        }
+        EXPECT_EQ(view.find(keys.back()), keys.back() * 3);
+        EXPECT_FALSE(view.contains(keys.back() + 1));
+      }
+    });
+  }
+  writer.join();
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  std::vector<unsigned> keys = csl.allKeysInOrder();
+  ASSERT_EQ(keys.size(), window);
+  EXPECT_EQ(keys.front(), writes - window);
+}
+
+} // namespace
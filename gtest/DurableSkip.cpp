@@ -0,0 +1,137 @@
+#include "DurableSkipList.hpp"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A fresh path for each test, with no files left from an earlier run.
+std::string freshPath(const std::string &name) {
+  std::string path = testing::TempDir() + "durable_" + name;
+  std::remove((path + ".snapshot").c_str());
+  std::remove((path + ".log").c_str());
+  return path;
+}
+
+std::vector<unsigned> keysOf(const std::map<unsigned, unsigned> &expected) {
+  std::vector<unsigned> keys;
+  for (const auto &entry : expected) {
+    keys.push_back(entry.first);
+  }
+  return keys;
+}
+
+TEST(Durable, EveryPolicyRecoversTheLog) {
+  for (SyncPolicy policy :
+       {SyncPolicy::None, SyncPolicy::Batched, SyncPolicy::EveryOp}) {
+    std::string path = freshPath("policy");
+    DurabilityOptions options;
+    options.sync = policy;
+    options.max_batch_records = 64;
+    std::map<unsigned, unsigned> expected;
+    std::mt19937 random(5);
+    {
+      DurableSkipList<unsigned, unsigned> dsl(path, options);
+      for (unsigned i = 0; i < 3000; i++) {
+        unsigned key = random() % 1000;
+        if (i % 3 == 2) {
+          EXPECT_EQ(dsl.erase(key), expected.erase(key) == 1);
+        } else {
+          EXPECT_EQ(dsl.insert(key, i), expected.emplace(key, i).second);
+        }
+      }
+      if (policy == SyncPolicy::None) {
+        dsl.sync();
+      }
+      EXPECT_GT(dsl.logRecords(), 0);
+    }
+
+    DurableSkipList<unsigned, unsigned> reopened(path, options);
+    EXPECT_EQ(reopened.size(), expected.size());
+    EXPECT_EQ(reopened.list().allKeysInOrder(), keysOf(expected));
+    for (const auto &entry : expected) {
+      EXPECT_EQ(reopened.find(entry.first), entry.second);
+    }
+    EXPECT_EQ(reopened.tryFind(1000), nullptr);
+  }
+}
+
+TEST(Durable, CheckpointEmptiesTheLog) {
+  std::string path = freshPath("checkpoint");
+  {
+    DurableSkipList<unsigned, double> dsl(path);
+    for (unsigned i = 0; i < 500; i++) {
+      dsl.insert(i, i * 0.5);
+    }
+    dsl.checkpoint();
+    EXPECT_EQ(dsl.logRecords(), 0);
+
+    // Updates after the checkpoint go to the log on top of it.
+    EXPECT_TRUE(dsl.erase(10));
+    EXPECT_FALSE(dsl.erase(10));
+    EXPECT_TRUE(dsl.insert(1000, 1.5));
+    EXPECT_EQ(dsl.logRecords(), 2);
+  }
+
+  DurableSkipList<unsigned, double> reopened(path);
+  EXPECT_EQ(reopened.logRecords(), 2);
+  EXPECT_EQ(reopened.size(), 500);
+  EXPECT_FALSE(reopened.contains(10));
+  EXPECT_EQ(reopened.find(1000), 1.5);
+  EXPECT_EQ(reopened.find(499), 249.5);
+  EXPECT_THROW(reopened.find(10), RuntimeException);
+}
+
+TEST(Durable, TornTailIsCutOff) {
+  std::string path = freshPath("torn");
+  {
+    DurabilityOptions options;
+    options.sync = SyncPolicy::EveryOp;
+    DurableSkipList<unsigned, unsigned> dsl(path, options);
+    for (unsigned i = 0; i < 10; i++) {
+      dsl.insert(i, i);
+    }
+  }
+
+  // Half a record, as a crash in the middle of a write would leave it.
+  {
+    std::ofstream log(path + ".log", std::ios::binary | std::ios::app);
+    log.write("\x01\x02\x03\x04\x01\x05", 6);
+  }
+  {
+    DurableSkipList<unsigned, unsigned> dsl(path);
+    EXPECT_EQ(dsl.size(), 10);
+    EXPECT_EQ(dsl.logRecords(), 10);
+    EXPECT_TRUE(dsl.insert(10, 10));
+  }
+
+  // A damaged record ends the log too, along with everything after it.
+  {
+    std::fstream log(path + ".log",
+                     std::ios::binary | std::ios::in | std::ios::out);
+    log.seekp(static_cast<std::streamoff>(sizeof(WalHeader)) + 13 * 8 + 6);
+    log.put('\x7f');
+  }
+  DurableSkipList<unsigned, unsigned> dsl(path);
+  EXPECT_EQ(dsl.size(), 8);
+  EXPECT_FALSE(dsl.contains(8));
+  EXPECT_FALSE(dsl.contains(10));
+}
+
+TEST(Durable, WrongTypesAreRejected) {
+  std::string path = freshPath("types");
+  {
+    DurableSkipList<unsigned, unsigned> dsl(path);
+    dsl.insert(1, 1);
+  }
+  EXPECT_THROW((DurableSkipList<unsigned, double>(path)), RuntimeException);
+
+  std::ofstream(path + ".log") << "not a log at all";
+  EXPECT_THROW((DurableSkipList<unsigned, unsigned>(path)), RuntimeException);
+}
+
+} // namespace
@@ -0,0 +1,962 @@
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+TEST(BulkLoad, MatchesIncrementalInserts) {
+  std::vector<std::pair<unsigned, unsigned>> pairs;
+  SkipList<unsigned, unsigned> incremental;
+  for (unsigned i = 0; i < 1000; i++) {
+    pairs.emplace_back(i, 100 + i);
+    incremental.insert(i, 100 + i);
+  }
+  pairs.emplace_back(1255, 1255);
+  incremental.insert(1255, 1255);
+
+  SkipList<unsigned, unsigned> loaded(pairs.begin(), pairs.end());
+  EXPECT_EQ(loaded.size(), incremental.size());
+  EXPECT_EQ(loaded.numLayers(), incremental.numLayers());
+  EXPECT_EQ(loaded.allKeysInOrder(), incremental.allKeysInOrder());
+  for (const auto &p : pairs) {
+    EXPECT_EQ(loaded.height(p.first), incremental.height(p.first));
+    EXPECT_EQ(loaded.find(p.first), p.second);
+  }
+  EXPECT_TRUE(loaded.isSmallestKey(0));
+  EXPECT_TRUE(loaded.isLargestKey(1255));
+  EXPECT_EQ(loaded.previousKey(1255), 999);
+}
+
+TEST(BulkLoad, MagicValueRespectsCap) {
+  std::vector<std::pair<unsigned, unsigned>> pairs;
+  for (unsigned i = 0; i < 16; i++) {
+    pairs.emplace_back(i, i);
+  }
+  pairs.emplace_back(255, 255);
+
+  SkipList<unsigned, unsigned> sl(pairs.begin(), pairs.end());
+  EXPECT_EQ(sl.height(255), 15);
+  EXPECT_EQ(sl.numLayers(), 16);
+}
+
+TEST(BulkLoad, UnsortedAndDuplicateKeysFallBackToInsert) {
+  std::vector<std::pair<std::string, unsigned>> pairs = {
+      {"c", 3}, {"e", 5}, {"a", 1}, {"e", 50}, {"f", 6}, {"b", 2}, {"g", 7}};
+
+  SkipList<std::string, unsigned> sl;
+  EXPECT_EQ(sl.bulkLoad(pairs.begin(), pairs.end()), 6);
+  std::vector<std::string> expected = {"a", "b", "c", "e", "f", "g"};
+  EXPECT_EQ(sl.allKeysInOrder(), expected);
+  EXPECT_EQ(sl.find("e"), 5);
+  EXPECT_EQ(sl.nextKey("f"), "g");
+  EXPECT_EQ(sl.previousKey("c"), "b");
+}
+
+TEST(BulkLoad, AppendsToExistingList) {
+  SkipList<unsigned, unsigned> sl;
+  SkipList<unsigned, unsigned> incremental;
+  for (unsigned i = 0; i < 50; i++) {
+    sl.insert(i, i);
+    incremental.insert(i, i);
+  }
+  std::vector<std::pair<unsigned, unsigned>> pairs;
+  for (unsigned i = 50; i < 300; i++) {
+    pairs.emplace_back(i, i);
+    incremental.insert(i, i);
+  }
+  EXPECT_EQ(sl.bulkLoad(pairs.begin(), pairs.end()), 250);
+  EXPECT_EQ(sl.numLayers(), incremental.numLayers());
+  for (unsigned i = 0; i < 300; i++) {
+    EXPECT_EQ(sl.height(i), incremental.height(i));
+  }
+}
+
+TEST(NoThrow, LookupsReportMissingKeys) {
+  SkipList<unsigned, unsigned> sl;
+  EXPECT_FALSE(sl.contains(0));
+  EXPECT_EQ(sl.tryFind(0), nullptr);
+  EXPECT_EQ(sl.smallestKey(), nullptr);
+  EXPECT_EQ(sl.largestKey(), nullptr);
+
+  for (unsigned i = 1; i < 11; i++) {
+    sl.insert(i, 100 + i);
+  }
+
+  EXPECT_TRUE(sl.contains(5));
+  EXPECT_FALSE(sl.contains(11));
+  EXPECT_EQ(*sl.tryFind(5), 105);
+  EXPECT_EQ(sl.tryFind(0), nullptr);
+  *sl.tryFind(5) = 500;
+  EXPECT_EQ(sl.find(5), 500);
+
+  const SkipList<unsigned, unsigned> &csl = sl;
+  EXPECT_EQ(*csl.tryFind(5), 500);
+  EXPECT_EQ(csl.tryFind(12), nullptr);
+
+  EXPECT_EQ(sl.tryHeight(7), sl.height(7));
+  EXPECT_EQ(sl.tryHeight(0), 0);
+
+  EXPECT_EQ(*sl.tryNextKey(1), 2);
+  EXPECT_EQ(sl.tryNextKey(10), nullptr);
+  EXPECT_EQ(sl.tryNextKey(11), nullptr);
+  EXPECT_EQ(*sl.tryPreviousKey(10), 9);
+  EXPECT_EQ(sl.tryPreviousKey(1), nullptr);
+  EXPECT_EQ(sl.tryPreviousKey(0), nullptr);
+
+  EXPECT_EQ(*sl.smallestKey(), 1);
+  EXPECT_EQ(*sl.largestKey(), 10);
+}
+
+TEST(Iterators, WalkInOrderBothWays) {
+  SkipList<unsigned, unsigned> sl;
+  EXPECT_TRUE(sl.begin() == sl.end());
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert((i * 37) % 100, i);
+  }
+
+  unsigned expected = 0;
+  for (auto kv : sl) {
+    EXPECT_EQ(kv.first, expected);
+    EXPECT_EQ(kv.second, sl.find(expected));
+    expected++;
+  }
+  EXPECT_EQ(expected, 100);
+
+  auto it = sl.end();
+  for (unsigned i = 100; i-- > 0;) {
+    --it;
+    EXPECT_EQ(it.key(), i);
+  }
+  EXPECT_TRUE(it == sl.begin());
+
+  for (auto it = sl.begin(); it != sl.end(); ++it) {
+    it->second = it->first * 2;
+  }
+  EXPECT_EQ(sl.find(21), 42);
+
+  const SkipList<unsigned, unsigned> &csl = sl;
+  SkipList<unsigned, unsigned>::const_iterator cit = sl.begin();
+  EXPECT_TRUE(cit == csl.begin());
+  EXPECT_EQ(cit.value(), 0);
+}
+
+TEST(Iterators, BoundsAndRanges) {
+  SkipList<std::string, unsigned> sl;
+  for (std::string k : {"b", "d", "f", "h"}) {
+    sl.insert(k, k[0]);
+  }
+
+  EXPECT_EQ(sl.lower_bound("d").key(), "d");
+  EXPECT_EQ(sl.lower_bound("c").key(), "d");
+  EXPECT_EQ(sl.upper_bound("d").key(), "f");
+  EXPECT_TRUE(sl.lower_bound("i") == sl.end());
+  EXPECT_TRUE(sl.upper_bound("h") == sl.end());
+  EXPECT_TRUE(sl.lower_bound("a") == sl.begin());
+
+  auto one = sl.equal_range("f");
+  EXPECT_EQ(one.first.key(), "f");
+  EXPECT_EQ(one.second.key(), "h");
+  auto none = sl.equal_range("e");
+  EXPECT_TRUE(none.first == none.second);
+
+  std::vector<std::string> keys;
+  auto range = sl.equal_range("c", "h");
+  for (auto it = range.first; it != range.second; ++it) {
+    keys.push_back(it.key());
+  }
+  std::vector<std::string> expected = {"d", "f", "h"};
+  EXPECT_EQ(keys, expected);
+
+  auto empty = sl.equal_range("h", "c");
+  EXPECT_TRUE(empty.first == empty.second);
+}
+
+TEST(Finger, SequentialInsertsMatchPlainInserts) {
+  SkipList<unsigned, unsigned> plain;
+  SkipList<unsigned, unsigned> hinted;
+  SkipList<unsigned, unsigned>::Finger finger;
+  for (unsigned i = 0; i < 1000; i++) {
+    plain.insert(i, i);
+    EXPECT_TRUE(hinted.insert(i, i, finger));
+  }
+  plain.insert(1255, 0);
+  EXPECT_TRUE(hinted.insert(1255, 0, finger));
+  EXPECT_FALSE(hinted.insert(1255, 1, finger));
+  EXPECT_FALSE(hinted.insert(500, 1, finger));
+
+  EXPECT_EQ(hinted.numLayers(), plain.numLayers());
+  EXPECT_EQ(hinted.allKeysInOrder(), plain.allKeysInOrder());
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_EQ(hinted.height(i), plain.height(i));
+  }
+}
+
+TEST(Finger, LookupsInAnyOrder) {
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 500; i++) {
+    sl.insert(i * 2, i);
+  }
+
+  SkipList<unsigned, unsigned>::Finger finger;
+  for (unsigned i = 0; i < 500; i++) {
+    EXPECT_EQ(sl.find(i * 2, finger), i);
+    EXPECT_EQ(sl.tryFind(i * 2 + 1, finger), nullptr);
+  }
+  for (unsigned i = 500; i-- > 0;) {
+    EXPECT_EQ(sl.find(i * 2, finger), i);
+  }
+  EXPECT_THROW(sl.find(1001, finger), RuntimeException);
+  EXPECT_EQ(sl.lower_bound(301, finger).key(), 302);
+  EXPECT_EQ(sl.lower_bound(302, finger).key(), 302);
+  EXPECT_TRUE(sl.lower_bound(999, finger) == sl.end());
+
+  // Interleaving hinted inserts behind and ahead of the finger.
+  EXPECT_TRUE(sl.insert(303, 0, finger));
+  EXPECT_TRUE(sl.insert(1, 0, finger));
+  EXPECT_TRUE(sl.insert(305, 0, finger));
+  EXPECT_EQ(sl.nextKey(303), 304);
+  EXPECT_EQ(sl.nextKey(0), 1);
+  EXPECT_EQ(sl.find(305, finger), 0);
+  EXPECT_EQ(sl.size(), 503);
+}
+
+TEST(Finger, ListChangesBetweenHintedCalls) {
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned k : {1, 6, 100, 200}) {
+    sl.insert(k, k);
+  }
+  SkipList<unsigned, unsigned>::Finger finger;
+  sl.find(100, finger);
+  sl.insert(3, 3);
+  EXPECT_TRUE(sl.insert(7, 7, finger));
+  EXPECT_EQ(sl.rank(100), 4);
+  EXPECT_EQ(sl.allKeysInOrder(), (std::vector<unsigned>{1, 3, 6, 7, 100, 200}));
+
+  // Plain inserts land anywhere between hinted ones, including between the
+  // finger and the next hinted key.
+  std::mt19937 rng(11);
+  for (unsigned trial = 0; trial < 20; trial++) {
+    SkipList<unsigned, unsigned> list;
+    std::map<unsigned, unsigned> expected;
+    SkipList<unsigned, unsigned>::Finger hint;
+    unsigned hinted = 0;
+    for (unsigned i = 0; i < 300; i++) {
+      unsigned plain = rng() % 4000;
+      list.insert(plain, i);
+      expected.emplace(plain, i);
+      hinted += 1 + rng() % 20;
+      bool added = expected.emplace(hinted, i).second;
+      EXPECT_EQ(list.insert(hinted, i, hint), added);
+    }
+    ASSERT_EQ(list.size(), expected.size());
+    std::size_t position = 0;
+    for (const auto &entry : expected) {
+      EXPECT_EQ(list.rank(entry.first), position);
+      EXPECT_EQ(list.select(position), entry.first);
+      EXPECT_EQ(list.find(entry.first), entry.second);
+      position++;
+    }
+    EXPECT_EQ(list.exportInOrder(2), list.allKeysInOrder());
+  }
+}
+
+TEST(Batch, FindBatchSortedAndUnsorted) {
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 2000; i += 2) {
+    sl.insert(i, i + 1);
+  }
+
+  std::vector<unsigned> keys;
+  for (unsigned i = 0; i < 300; i++) {
+    keys.push_back((i * 7919) % 2100);
+  }
+  std::vector<unsigned *> values(keys.size());
+  sl.findBatch(keys.data(), keys.size(), values.data());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(values[i], sl.tryFind(keys[i]));
+  }
+
+  std::vector<unsigned> sorted;
+  for (unsigned i = 1; i < 2100; i += 3) {
+    sorted.push_back(i);
+  }
+  const SkipList<unsigned, unsigned> &csl = sl;
+  std::vector<const unsigned *> cvalues(sorted.size());
+  csl.findBatch(sorted.data(), sorted.size(), cvalues.data());
+  for (std::size_t i = 0; i < sorted.size(); i++) {
+    EXPECT_EQ(cvalues[i], csl.tryFind(sorted[i]));
+  }
+}
+
+TEST(Batch, InsertBatchMatchesInserts) {
+  std::vector<std::string> keys = {"a", "c", "e", "b", "d", "d", "f", "a"};
+  std::vector<unsigned> values = {1, 2, 3, 4, 5, 6, 7, 8};
+  bool inserted[8];
+
+  SkipList<std::string, unsigned> plain;
+  SkipList<std::string, unsigned> batched;
+  EXPECT_EQ(batched.insertBatch(keys.data(), values.data(), keys.size(),
+                                inserted),
+            6);
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(inserted[i], plain.insert(keys[i], values[i]));
+  }
+  EXPECT_EQ(batched.allKeysInOrder(), plain.allKeysInOrder());
+  EXPECT_EQ(batched.find("d"), 5);
+  EXPECT_EQ(batched.numLayers(), plain.numLayers());
+}
+
+TEST(Erase, RemovesKeysAndShrinksLayers) {
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert(i, i);
+  }
+  sl.insert(255, 255);
+  EXPECT_EQ(sl.numLayers(), 22);
+
+  EXPECT_TRUE(sl.erase(255));
+  EXPECT_FALSE(sl.erase(255));
+  EXPECT_FALSE(sl.contains(255));
+  EXPECT_EQ(sl.numLayers(), 8);
+  EXPECT_EQ(sl.size(), 100);
+
+  for (unsigned i = 0; i < 100; i += 2) {
+    EXPECT_TRUE(sl.erase(i));
+  }
+  EXPECT_EQ(sl.size(), 50);
+  EXPECT_TRUE(sl.isSmallestKey(1));
+  EXPECT_EQ(sl.nextKey(1), 3);
+  EXPECT_EQ(sl.previousKey(3), 1);
+  EXPECT_THROW(sl.find(2), RuntimeException);
+  for (unsigned i = 1; i < 100; i += 2) {
+    EXPECT_EQ(sl.find(i), i);
+  }
+
+  for (unsigned i = 1; i < 100; i += 2) {
+    EXPECT_TRUE(sl.erase(i));
+  }
+  EXPECT_TRUE(sl.isEmpty());
+  EXPECT_EQ(sl.numLayers(), 2);
+  EXPECT_TRUE(sl.begin() == sl.end());
+
+  // The emptied list behaves like a new one.
+  for (unsigned i = 0; i < 10; i++) {
+    sl.insert(i, i);
+  }
+  EXPECT_EQ(sl.numLayers(), 5);
+  EXPECT_EQ(sl.height(7), 4);
+}
+
+TEST(Erase, ByIterator) {
+  SkipList<std::string, unsigned> sl;
+  for (unsigned i = 0; i < 20; i++) {
+    sl.insert(std::to_string(i), i);
+  }
+  // Remove every key in ["3", "6"] by walking the range.
+  auto range = sl.equal_range("3", "6");
+  for (auto it = range.first; it != range.second;) {
+    it = sl.erase(it);
+  }
+  std::vector<std::string> expected = {"0",  "1",  "10", "11", "12", "13",
+                                       "14", "15", "16", "17", "18", "19",
+                                       "2",  "7",  "8",  "9"};
+  EXPECT_EQ(sl.allKeysInOrder(), expected);
+
+  auto last = --sl.end();
+  EXPECT_TRUE(sl.erase(last) == sl.end());
+  EXPECT_TRUE(sl.isLargestKey("8"));
+}
+
+TEST(LevelGenerators, FlipCoinIsTheDefault) {
+  SkipList<unsigned, unsigned> plain;
+  SkipList<unsigned, unsigned, NodeArena, FlipCoinLevels> explicit_policy;
+  for (unsigned i = 0; i < 1000; i++) {
+    plain.insert(i, i);
+    explicit_policy.insert(i, i);
+  }
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_EQ(explicit_policy.height(i), plain.height(i));
+    EXPECT_EQ(plain.height(i), flipCoinLevels(i, maxFlipsFor(i + 1)));
+  }
+}
+
+// The flip-at-a-time loop flipCoinLevels used to run for every key.
+template <typename Key> unsigned flipByFlip(const Key &key, unsigned cap) {
+  unsigned height = 0;
+  while (flipCoin(key, height) && height + 1 < cap) {
+    height++;
+  }
+  return height + 1;
+}
+
+TEST(LevelGenerators, OneStepHeightsMatchTheCoinFlips) {
+  for (unsigned cap : {1u, 2u, 7u, 12u, 15u, 60u}) {
+    for (unsigned key = 0; key < 70000; key += 3) {
+      ASSERT_EQ(flipCoinLevels(key, cap), flipByFlip(key, cap));
+    }
+    for (unsigned key : {0xFFFFFFFFu, 0x00FF00FFu, 0x80000000u, 255u}) {
+      EXPECT_EQ(flipCoinLevels(key, cap), flipByFlip(key, cap));
+    }
+    std::string key;
+    for (unsigned i = 0; i < 300; i++) {
+      EXPECT_EQ(flipCoinLevels(key, cap), flipByFlip(key, cap));
+      key.push_back(static_cast<char>(i * 37 + 11));
+    }
+  }
+
+  // 3 * ceil(log2(n)) past 16 keys, without floating point.
+  EXPECT_EQ(maxFlipsFor(0), 12);
+  EXPECT_EQ(maxFlipsFor(16), 12);
+  EXPECT_EQ(maxFlipsFor(17), 15);
+  EXPECT_EQ(maxFlipsFor(32), 15);
+  EXPECT_EQ(maxFlipsFor(33), 18);
+  EXPECT_EQ(maxFlipsFor(std::size_t(1) << 40), 120);
+  EXPECT_EQ(maxFlipsFor((std::size_t(1) << 40) + 1), 123);
+}
+
+TEST(LevelGenerators, HashedHeightsIgnoreXorCollisions) {
+  // Every one of these keys XORs to 0, so flipCoin gives them all height 1.
+  SkipList<unsigned, unsigned, NodeArena, HashedLevels<>> sl;
+  SkipList<unsigned, unsigned, NodeArena, HashedLevels<>> again;
+  unsigned short_towers = 0;
+  for (unsigned i = 0; i < 4096; i++) {
+    unsigned key = (i << 8) | ((i ^ (i >> 8)) & 0xFF);
+    EXPECT_EQ(flipCoinLevels(key, 12), 1);
+    sl.insert(key, i);
+    again.insert(key, i);
+    if (sl.height(key) == 1) {
+      short_towers++;
+    }
+  }
+  // About half of the towers stop at S_0, and identical inserts give
+  // identical towers.
+  EXPECT_GT(short_towers, 1800);
+  EXPECT_LT(short_towers, 2300);
+  EXPECT_GT(sl.numLayers(), 8);
+  EXPECT_LE(sl.numLayers(), maxFlipsFor(4096) + 1);
+  for (unsigned i = 0; i < 4096; i++) {
+    unsigned key = (i << 8) | ((i ^ (i >> 8)) & 0xFF);
+    EXPECT_EQ(sl.height(key), again.height(key));
+  }
+}
+
+TEST(LevelGenerators, RandomHeightsFollowTheSeed) {
+  using RandomList = SkipList<std::string, unsigned, NodeArena, RandomLevels>;
+  RandomList a(RandomLevels(7));
+  RandomList b(RandomLevels(7));
+  RandomList c(RandomLevels(8));
+  unsigned differences = 0;
+  for (unsigned i = 0; i < 1000; i++) {
+    std::string key = std::to_string(i);
+    a.insert(key, i);
+    b.insert(key, i);
+    c.insert(key, i);
+    EXPECT_EQ(a.height(key), b.height(key));
+    EXPECT_GE(a.height(key), 1);
+    EXPECT_LE(a.height(key), maxFlipsFor(i + 1));
+    if (a.height(key) != c.height(key)) {
+      differences++;
+    }
+  }
+  EXPECT_GT(differences, 100);
+  EXPECT_EQ(a.allKeysInOrder(), c.allKeysInOrder());
+}
+
+TEST(Heterogeneous, StringViewAndCharPointerLookups) {
+  // std::string_view does not convert to std::string implicitly, so these
+  // calls only compile through the transparent overloads.
+  SkipList<std::string, unsigned, NodeArena, FlipCoinLevels, std::less<>> sl;
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert(std::to_string(i), i);
+  }
+  std::string_view key = "42";
+  EXPECT_TRUE(sl.contains(key));
+  EXPECT_EQ(sl.find(key), 42);
+  EXPECT_EQ(sl.height(key), sl.height(std::string("42")));
+  EXPECT_EQ(*sl.tryFind("7"), 7);
+  EXPECT_EQ(sl.tryFind(std::string_view("100")), nullptr);
+  EXPECT_EQ(sl.tryHeight("100"), 0);
+  EXPECT_THROW(sl.find("100"), RuntimeException);
+  EXPECT_THROW(sl.height(std::string_view("")), RuntimeException);
+
+  EXPECT_EQ(sl.lower_bound("420")->first, "43");
+  EXPECT_EQ(sl.upper_bound(key)->first, "43");
+  EXPECT_TRUE(sl.lower_bound("999") == sl.end());
+
+  const auto &csl = sl;
+  EXPECT_EQ(csl.find(key), 42);
+  EXPECT_EQ(*csl.tryFind(key), 42);
+  EXPECT_EQ(csl.lower_bound(key).key(), "42");
+  EXPECT_TRUE(csl.upper_bound("99") == csl.end());
+}
+
+TEST(Compare, ReversedOrder) {
+  SkipList<unsigned, unsigned, NodeArena, FlipCoinLevels,
+           std::greater<unsigned>>
+      sl;
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_TRUE(sl.insert(i, i + 1));
+  }
+  EXPECT_FALSE(sl.insert(50, 0));
+  std::vector<unsigned> keys = sl.allKeysInOrder();
+  ASSERT_EQ(keys.size(), 100);
+  EXPECT_EQ(keys.front(), 99);
+  EXPECT_EQ(keys.back(), 0);
+  EXPECT_TRUE(sl.isSmallestKey(99));
+  EXPECT_EQ(sl.nextKey(50), 49);
+  EXPECT_EQ(sl.find(7), 8);
+  EXPECT_EQ(sl.lower_bound(200)->first, 99);
+  EXPECT_TRUE(sl.upper_bound(0) == sl.end());
+  EXPECT_TRUE(sl.erase(99));
+  EXPECT_EQ(*sl.smallestKey(), 98);
+}
+
+// Orders numbers normally, but counts how often it is asked.
+struct CountingLess {
+  unsigned *calls;
+  bool operator()(unsigned a, unsigned b) const {
+    ++*calls;
+    return a < b;
+  }
+};
+
+TEST(Compare, SearchStopsAtTheFirstExactMatch) {
+  unsigned calls = 0;
+  SkipList<unsigned, unsigned, NodeArena, FlipCoinLevels, CountingLess> sl(
+      FlipCoinLevels(), CountingLess{&calls});
+  for (unsigned i = 0; i < 1000; i++) {
+    sl.insert(i, i);
+  }
+  // The first key to reach the top layer is met by the very first step of
+  // every search; the key before it is only met in S_0.
+  unsigned tallest = 0;
+  for (unsigned i = 0; i < 1000; i++) {
+    if (sl.height(i) > sl.height(tallest)) {
+      tallest = i;
+    }
+  }
+  ASSERT_EQ(sl.height(tallest) + 1, sl.numLayers());
+
+  calls = 0;
+  EXPECT_TRUE(sl.contains(tallest));
+  unsigned tall = calls;
+  calls = 0;
+  EXPECT_TRUE(sl.contains(tallest - 1));
+  EXPECT_LE(tall, 2);
+  EXPECT_LT(tall, calls);
+
+  calls = 0;
+  EXPECT_FALSE(sl.insert(tallest, 0));
+  EXPECT_LE(calls, 2);
+}
+
+TEST(Compare, ThreeWay) {
+  EXPECT_LT(threeWay(std::string("abc"), std::string("abd")), 0);
+  EXPECT_EQ(threeWay(std::string("abc"), std::string("abc")), 0);
+  EXPECT_GT(threeWay(std::string("b"), std::string("abc")), 0);
+  EXPECT_LT(threeWay(1u, 2u), 0);
+  EXPECT_EQ(threeWay(2u, 2u), 0);
+  EXPECT_GT(threeWayCompare(std::greater<unsigned>(), 1u, 2u), 0);
+  EXPECT_LT(threeWayCompare(std::less<>(), std::string("a"), "b"), 0);
+}
+
+// Ordered by operator< alone, with no operator<=> even under C++20.
+struct LessOnly {
+  int v;
+  bool operator<(const LessOnly &other) const { return v < other.v; }
+};
+
+// Ordered backwards by its std::less specialization.
+struct Descending {
+  int v;
+  bool operator<(const Descending &other) const { return v < other.v; }
+};
+
+// Found by argument-dependent lookup, as for any key type of its own.
+bool flipCoin(const LessOnly &key, unsigned previousFlips) {
+  return ::flipCoin(static_cast<unsigned>(key.v), previousFlips);
+}
+
+bool flipCoin(const Descending &key, unsigned previousFlips) {
+  return ::flipCoin(static_cast<unsigned>(key.v), previousFlips);
+}
+
+} // namespace
+
+template <> struct std::less<Descending> {
+  bool operator()(const Descending &a, const Descending &b) const {
+    return b.v < a.v;
+  }
+};
+
+namespace {
+
+TEST(Compare, KeysWithOnlyLessAndSpecializedLess) {
+  EXPECT_LT(threeWay(LessOnly{1}, LessOnly{2}), 0);
+  EXPECT_EQ(threeWay(LessOnly{2}, LessOnly{2}), 0);
+  EXPECT_GT(threeWayCompare(std::less<Descending>(), Descending{1},
+                            Descending{2}),
+            0);
+
+  SkipList<LessOnly, int> less_only;
+  SkipList<Descending, int> descending;
+  for (int i : {5, 1, 9, 3, 7}) {
+    less_only.insert(LessOnly{i}, i * 10);
+    descending.insert(Descending{i}, i * 10);
+  }
+  EXPECT_EQ(less_only.find(LessOnly{9}), 90);
+  EXPECT_FALSE(less_only.contains(LessOnly{4}));
+  EXPECT_EQ(less_only.smallestKey()->v, 1);
+  EXPECT_EQ(descending.find(Descending{3}), 30);
+  EXPECT_FALSE(descending.contains(Descending{4}));
+  EXPECT_EQ(descending.smallestKey()->v, 9);
+  EXPECT_EQ(descending.nextKey(Descending{5}).v, 3);
+}
+
+// Counts how it is constructed, to show values are built exactly once.
+struct Tracked {
+  static unsigned copies;
+  static unsigned moves;
+  unsigned id = 0;
+
+  Tracked() = default;
+  explicit Tracked(unsigned i) : id(i) {}
+  Tracked(const Tracked &other) : id(other.id) { copies++; }
+  Tracked(Tracked &&other) noexcept : id(other.id) { moves++; }
+  Tracked &operator=(const Tracked &other) {
+    id = other.id;
+    copies++;
+    return *this;
+  }
+  Tracked &operator=(Tracked &&other) noexcept {
+    id = other.id;
+    moves++;
+    return *this;
+  }
+};
+
+unsigned Tracked::copies = 0;
+unsigned Tracked::moves = 0;
+
+TEST(Emplace, ConstructsValuesInPlace) {
+  SkipList<unsigned, Tracked> sl;
+  Tracked::copies = 0;
+  Tracked::moves = 0;
+  for (unsigned i = 0; i < 300; i++) {
+    auto result = sl.emplace(i, i + 1);
+    EXPECT_TRUE(result.second);
+    EXPECT_EQ(result.first.key(), i);
+    EXPECT_EQ(result.first.value().id, i + 1);
+  }
+  auto again = sl.try_emplace(255u, 0);
+  EXPECT_FALSE(again.second);
+  EXPECT_EQ(again.first->second.id, 256);
+  EXPECT_EQ(Tracked::copies, 0);
+  EXPECT_EQ(Tracked::moves, 0);
+
+  Tracked moved(1000);
+  EXPECT_TRUE(sl.insert(1000u, std::move(moved)));
+  EXPECT_EQ(Tracked::copies, 0);
+  EXPECT_EQ(Tracked::moves, 1);
+  EXPECT_EQ(sl.find(1000).id, 1000);
+}
+
+TEST(Emplace, MoveOnlyValuesAndKeys) {
+  SkipList<std::string, std::unique_ptr<unsigned>> sl;
+  std::string key = "a long key that does not fit in the small buffer";
+  EXPECT_TRUE(sl.insert(std::move(key), std::make_unique<unsigned>(1)));
+  EXPECT_TRUE(key.empty());
+
+  // emplace builds the key from a const char * and the value from a raw
+  // pointer.
+  auto result = sl.emplace("b", new unsigned(2));
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(*result.first.value(), 2);
+
+  // A rejected try_emplace leaves its arguments alone.
+  std::unique_ptr<unsigned> spare = std::make_unique<unsigned>(3);
+  EXPECT_FALSE(sl.try_emplace("b", std::move(spare)).second);
+  ASSERT_TRUE(spare);
+  EXPECT_EQ(*sl.find("b"), 2);
+}
+
+TEST(Emplace, InsertOrAssign) {
+  SkipList<std::string, unsigned> sl;
+  auto first = sl.insert_or_assign("k", 1u);
+  EXPECT_TRUE(first.second);
+  auto second = sl.insert_or_assign(std::string("k"), 2u);
+  EXPECT_FALSE(second.second);
+  EXPECT_TRUE(first.first == second.first);
+  EXPECT_EQ(sl.find("k"), 2);
+  EXPECT_EQ(sl.size(), 1);
+
+  std::string lvalue = "j";
+  EXPECT_TRUE(sl.insert_or_assign(lvalue, 3u).second);
+  EXPECT_EQ(lvalue, "j");
+  EXPECT_EQ(sl.allKeysInOrder(), (std::vector<std::string>{"j", "k"}));
+}
+
+// Checks rank, select and countInRange against a walk over the keys.
+template <typename List> void expectOrderStatistics(const List &sl) {
+  std::vector<unsigned> keys = sl.allKeysInOrder();
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(sl.select(i), keys[i]);
+    EXPECT_EQ(sl.rank(keys[i]), i);
+    EXPECT_EQ(sl.rank(keys[i] + 1), i + 1);
+  }
+  EXPECT_THROW(sl.select(keys.size()), RuntimeException);
+}
+
+TEST(OrderStatistics, RankAndSelectFollowEveryUpdate) {
+  SkipList<unsigned, unsigned> sl;
+  EXPECT_EQ(sl.rank(5), 0);
+  EXPECT_THROW(sl.select(0), RuntimeException);
+
+  unsigned seed = 7;
+  for (unsigned i = 0; i < 2000; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    sl.insert((seed >> 8) % 4096, i);
+  }
+  sl.insert(255, 0);
+  expectOrderStatistics(sl);
+
+  for (unsigned i = 0; i < 4096; i += 3) {
+    sl.erase(i);
+  }
+  expectOrderStatistics(sl);
+
+  SkipList<unsigned, unsigned>::Finger finger;
+  for (unsigned i = 4096; i < 4600; i++) {
+    sl.insert(i, i, finger);
+  }
+  std::vector<unsigned> batch = {9000, 1, 4, 8000, 7, 2};
+  std::vector<unsigned> values(batch.size(), 0);
+  sl.insertBatch(batch.data(), values.data(), batch.size());
+  sl.emplace(5000u, 0u);
+  expectOrderStatistics(sl);
+
+  while (!sl.isEmpty()) {
+    sl.erase(sl.begin());
+  }
+  EXPECT_EQ(sl.rank(100), 0);
+  sl.insert(3, 3);
+  EXPECT_EQ(sl.select(0), 3);
+}
+
+TEST(OrderStatistics, BulkLoadAndRanges) {
+  std::vector<std::pair<unsigned, unsigned>> pairs;
+  for (unsigned i = 0; i < 1000; i++) {
+    pairs.emplace_back(2 * i, i);
+  }
+  SkipList<unsigned, unsigned> sl(pairs.begin(), pairs.end());
+  expectOrderStatistics(sl);
+
+  EXPECT_EQ(sl.select(500), 1000);
+  EXPECT_EQ(sl.rank(1001), 501);
+  EXPECT_EQ(sl.countInRange(0, 1998), 1000);
+  EXPECT_EQ(sl.countInRange(10, 20), 6);
+  EXPECT_EQ(sl.countInRange(11, 19), 4);
+  EXPECT_EQ(sl.countInRange(11, 11), 0);
+  EXPECT_EQ(sl.countInRange(20, 10), 0);
+  EXPECT_EQ(sl.countInRange(1990, 5000), 5);
+
+  auto range = sl.equal_range(101, 333);
+  EXPECT_EQ(sl.countInRange(101, 333),
+            static_cast<std::size_t>(std::distance(range.first, range.second)));
+}
+
+// Every key's height, in order, and that S_0 links back the same way.
+template <typename List>
+std::vector<std::pair<unsigned, unsigned>> heightsOf(const List &sl) {
+  std::vector<std::pair<unsigned, unsigned>> heights;
+  for (auto it = sl.begin(); it != sl.end(); ++it) {
+    heights.emplace_back(it.key(), it.height());
+  }
+  std::size_t backwards = 0;
+  for (auto it = sl.end(); it != sl.begin();) {
+    --it;
+    backwards++;
+  }
+  EXPECT_EQ(backwards, heights.size());
+  return heights;
+}
+
+TEST(MergeSplit, MergeRelinksTowersOfBothLists) {
+  using List = SkipList<unsigned, unsigned, NodeArena, HashedLevels<>>;
+  List sl;
+  std::map<unsigned, unsigned> expected;
+  std::map<unsigned, unsigned> heights;
+  {
+    List hourly;
+    for (unsigned i = 0; i < 3000; i++) {
+      sl.insert(i * 2, i);
+      expected.emplace(i * 2, i);
+      // Every third key of hourly is already in sl.
+      unsigned key = i % 3 == 0 ? i * 2 : i * 2 + 1;
+      hourly.insert(key, 100000 + i);
+      expected.emplace(key, 100000 + i);
+    }
+    for (const List *list : {&sl, &hourly}) {
+      for (auto it = list->begin(); it != list->end(); ++it) {
+        heights.emplace(it.key(), it.height());
+      }
+    }
+    unsigned &moved = hourly.find(9);
+
+    EXPECT_EQ(sl.merge(std::move(hourly)), 2000);
+    EXPECT_TRUE(hourly.isEmpty());
+    EXPECT_EQ(hourly.numLayers(), 2);
+    EXPECT_TRUE(hourly.begin() == hourly.end());
+    EXPECT_EQ(&sl.find(9), &moved);
+
+    // What is left of hourly is a working, empty list.
+    EXPECT_TRUE(hourly.insert(5, 5));
+    EXPECT_EQ(hourly.allKeysInOrder(), std::vector<unsigned>{5});
+  }
+
+  // The towers of the merged list outlive the list they came from.
+  EXPECT_EQ(sl.size(), expected.size());
+  for (const auto &entry : expected) {
+    EXPECT_EQ(sl.find(entry.first), entry.second);
+  }
+  for (const auto &entry : heightsOf(sl)) {
+    EXPECT_EQ(entry.second, heights[entry.first]);
+  }
+  expectOrderStatistics(sl);
+  EXPECT_EQ(sl.merge(std::move(sl)), 0);
+  EXPECT_TRUE(sl.insert(99999, 1));
+  EXPECT_TRUE(sl.erase(3));
+  EXPECT_EQ(sl.size(), expected.size());
+
+  SkipList<std::string, std::string, NewDeleteAllocator> a;
+  SkipList<std::string, std::string, NewDeleteAllocator> b;
+  a.insert("kiwi", std::string(40, 'k'));
+  b.insert("apple", std::string(40, 'a'));
+  b.insert("kiwi", "second");
+  EXPECT_EQ(a.merge(std::move(b)), 1);
+  EXPECT_EQ(a.allKeysInOrder(), (std::vector<std::string>{"apple", "kiwi"}));
+  EXPECT_EQ(a.find("kiwi"), std::string(40, 'k'));
+}
+
+TEST(MergeSplit, SplitCutsAtTheKey) {
+  using List = SkipList<unsigned, unsigned, NodeArena, HashedLevels<>>;
+  for (unsigned cut : {0u, 1u, 2500u, 2501u, 4998u, 5000u, 9000u}) {
+    std::unique_ptr<List> sl(new List());
+    for (unsigned i = 0; i < 5000; i += 2) {
+      sl->insert(i, i + 1);
+    }
+    std::vector<std::pair<unsigned, unsigned>> before = heightsOf(*sl);
+
+    List right;
+    sl->split(cut, right);
+    EXPECT_EQ(sl->size() + right.size(), 2500);
+    EXPECT_EQ(sl->size(), (std::min(cut, 5000u) + 1) / 2);
+    expectOrderStatistics(*sl);
+    expectOrderStatistics(right);
+    if (!sl->isEmpty()) {
+      EXPECT_LT(sl->select(sl->size() - 1), cut);
+    }
+    if (!right.isEmpty()) {
+      EXPECT_GE(right.select(0), cut);
+    }
+    std::vector<std::pair<unsigned, unsigned>> after = heightsOf(*sl);
+    std::vector<std::pair<unsigned, unsigned>> moved = heightsOf(right);
+    after.insert(after.end(), moved.begin(), moved.end());
+    EXPECT_EQ(after, before);
+
+    // Both halves go on changing on their own, even once the list they
+    // were cut from is gone.
+    List more;
+    EXPECT_THROW(sl->split(cut, *sl), RuntimeException);
+    EXPECT_TRUE(more.insert(1, 1));
+    EXPECT_THROW(sl->split(cut, more), RuntimeException);
+    sl->insert(1, 2);
+    sl.reset();
+    for (unsigned i = cut; i < 5000; i += 2) {
+      if (i % 2 == 0) {
+        EXPECT_EQ(right.find(i), i + 1);
+        EXPECT_TRUE(right.erase(i));
+      }
+    }
+    EXPECT_TRUE(right.insert(7, 7));
+    EXPECT_EQ(right.merge(std::move(more)), 1);
+    expectOrderStatistics(right);
+  }
+}
+
+TEST(Parallel, BuildMatchesBulkLoadOfTheSortedInput) {
+  // Enough keys for several workers, with every key given twice.
+  std::vector<std::pair<unsigned, unsigned>> pairs;
+  for (unsigned i = 0; i < 100000; i++) {
+    pairs.emplace_back(i * 3, i);
+    pairs.emplace_back(i * 3, i + 1);
+  }
+  std::shuffle(pairs.begin(), pairs.end(), std::mt19937(3));
+
+  // The first occurrence wins, wherever the shuffle put it.
+  std::map<unsigned, unsigned> first(pairs.begin(), pairs.end());
+  SkipList<unsigned, unsigned, NodeArena, HashedLevels<>> expected(
+      first.begin(), first.end());
+
+  for (unsigned threads : {1u, 4u, 0u}) {
+    SkipList<unsigned, unsigned, NodeArena, HashedLevels<>> sl;
+    sl.insert(1, 1);
+    EXPECT_EQ(sl.buildParallel(pairs.begin(), pairs.end(), threads),
+              expected.size());
+    EXPECT_EQ(sl.numLayers(), expected.numLayers());
+    EXPECT_EQ(sl.allKeysInOrder(), expected.allKeysInOrder());
+    for (auto it = expected.begin(); it != expected.end(); ++it) {
+      ASSERT_EQ(sl.find(it.key()), it.value());
+      ASSERT_EQ(sl.height(it.key()), expected.height(it.key()));
+    }
+    expectOrderStatistics(sl);
+
+    // It is an ordinary list afterwards.
+    EXPECT_TRUE(sl.insert(1, 1));
+    EXPECT_TRUE(sl.erase(3));
+    EXPECT_EQ(sl.rank(7), 3);
+  }
+}
+
+TEST(Parallel, ExportAndForEachCoverEveryKeyOnce) {
+  SkipList<unsigned, unsigned, NodeArena, RandomLevels> sl;
+  for (unsigned i = 0; i < 200000; i++) {
+    sl.insert(i * 2, 1);
+  }
+  std::vector<unsigned> keys = sl.allKeysInOrder();
+  for (unsigned threads : {1u, 3u, 8u, 0u}) {
+    EXPECT_EQ(sl.exportInOrder(threads), keys);
+
+    std::atomic<unsigned long long> sum(0);
+    std::atomic<unsigned> count(0);
+    sl.forEachParallel(
+        [&](const unsigned &k, unsigned &v) {
+          sum += k;
+          count++;
+          v++;
+        },
+        threads);
+    EXPECT_EQ(count, keys.size());
+    EXPECT_EQ(sum, 200000ull * 199999ull);
+  }
+  EXPECT_EQ(sl.find(10), 5);
+
+  const SkipList<unsigned, unsigned, NodeArena, RandomLevels> &view = sl;
+  std::atomic<unsigned> count(0);
+  view.forEachParallel([&](const unsigned &, const unsigned &) { count++; });
+  EXPECT_EQ(count, keys.size());
+
+  SkipList<unsigned, unsigned> empty;
+  EXPECT_TRUE(empty.exportInOrder(4).empty());
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+#include "FrozenSkipList.hpp"
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Checks every lookup of frozen against the list it was made from.
+template <typename Frozen, typename List>
+void expectSameLookups(const Frozen &frozen, const List &sl,
+                       const std::vector<unsigned> &probes) {
+  EXPECT_EQ(frozen.size(), sl.size());
+  EXPECT_EQ(frozen.allKeysInOrder(), sl.allKeysInOrder());
+  for (unsigned k : probes) {
+    EXPECT_EQ(frozen.contains(k), sl.contains(k));
+    const unsigned *value = frozen.tryFind(k);
+    const unsigned *expected = sl.tryFind(k);
+    ASSERT_EQ(value == nullptr, expected == nullptr);
+    if (!value) {
+      EXPECT_THROW(frozen.find(k), RuntimeException);
+      EXPECT_THROW(frozen.isSmallestKey(k), RuntimeException);
+      EXPECT_THROW(frozen.isLargestKey(k), RuntimeException);
+      EXPECT_EQ(frozen.tryNextKey(k), nullptr);
+      continue;
+    }
+    EXPECT_EQ(*value, *expected);
+    EXPECT_EQ(frozen.find(k), sl.find(k));
+    EXPECT_EQ(frozen.isSmallestKey(k), sl.isSmallestKey(k));
+    EXPECT_EQ(frozen.isLargestKey(k), sl.isLargestKey(k));
+    if (sl.isLargestKey(k)) {
+      EXPECT_THROW(frozen.nextKey(k), RuntimeException);
+    } else {
+      EXPECT_EQ(frozen.nextKey(k), sl.nextKey(k));
+    }
+    if (sl.isSmallestKey(k)) {
+      EXPECT_THROW(frozen.previousKey(k), RuntimeException);
+    } else {
+      EXPECT_EQ(frozen.previousKey(k), sl.previousKey(k));
+    }
+  }
+}
+
+TEST(Frozen, LookupsMatchTheSkipListAtEverySize) {
+  for (unsigned n : {0u, 1u, 2u, 3u, 7u, 8u, 100u, 1023u, 1024u, 3000u}) {
+    SkipList<unsigned, unsigned> sl;
+    for (unsigned i = 0; i < n; i++) {
+      sl.insert(i * 3 + 1, i);
+    }
+    std::vector<unsigned> probes;
+    for (unsigned k = 0; k <= n * 3 + 2; k++) {
+      probes.push_back(k);
+    }
+
+    FrozenSkipList<unsigned, unsigned> frozen(sl);
+    expectSameLookups(frozen, sl, probes);
+    if (n == 0) {
+      EXPECT_TRUE(frozen.isEmpty());
+      EXPECT_EQ(frozen.smallestKey(), nullptr);
+      EXPECT_EQ(frozen.largestKey(), nullptr);
+    } else {
+      EXPECT_EQ(*frozen.smallestKey(), 1);
+      EXPECT_EQ(*frozen.largestKey(), n * 3 - 2);
+    }
+  }
+}
+
+TEST(Frozen, FreezeMovesTheValuesAndShrinksTheFootprint) {
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 100000; i++) {
+    sl.insert(i, i + 1);
+  }
+  std::size_t before = sl.memoryUsage();
+  EXPECT_GT(before, 100000 * (SkipNode<unsigned, unsigned>::bytes(1)));
+
+  FrozenSkipList<unsigned, unsigned> frozen = freeze(std::move(sl));
+  EXPECT_TRUE(sl.isEmpty());
+  EXPECT_EQ(frozen.size(), 100000);
+  EXPECT_EQ(frozen.find(77777), 77778);
+  EXPECT_LT(frozen.memoryUsage() * 4, before);
+
+  unsigned visited = 0;
+  frozen.forEach([&visited](const unsigned &k, const unsigned &v) {
+    EXPECT_EQ(k, visited);
+    EXPECT_EQ(v, k + 1);
+    visited++;
+  });
+  EXPECT_EQ(visited, 100000);
+}
+
+TEST(Frozen, StringsAndComparators) {
+  SkipList<std::string, std::string, NodeArena, FlipCoinLevels,
+           std::greater<std::string>>
+      sl;
+  for (const char *word : {"fig", "apple", "kiwi", "date", "mango"}) {
+    sl.insert(word, std::string(30, word[0]));
+  }
+  auto frozen = freeze(std::move(sl));
+  EXPECT_EQ(frozen.allKeysInOrder(),
+            (std::vector<std::string>{"mango", "kiwi", "fig", "date",
+                                      "apple"}));
+  EXPECT_EQ(frozen.find("kiwi"), std::string(30, 'k'));
+  EXPECT_EQ(frozen.nextKey("kiwi"), "fig");
+  EXPECT_EQ(frozen.previousKey("kiwi"), "mango");
+  EXPECT_TRUE(frozen.isSmallestKey("mango"));
+  EXPECT_TRUE(frozen.isLargestKey("apple"));
+  EXPECT_FALSE(frozen.contains("grape"));
+  EXPECT_THROW(frozen.nextKey("grape"), RuntimeException);
+}
+
+} // namespace
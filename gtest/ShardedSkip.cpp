@@ -0,0 +1,159 @@
+#include "ShardedSkipList.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template <std::size_t N>
+std::size_t largestShard(const ShardedSkipList<unsigned, unsigned, N> &ssl) {
+  auto sizes = ssl.shardSizes();
+  return *std::max_element(sizes.begin(), sizes.end());
+}
+
+TEST(Sharded, MatchesMapAndRebalancesEvenly) {
+  ShardedSkipList<unsigned, unsigned, 8> ssl;
+  std::map<unsigned, unsigned> expected;
+  std::mt19937 random(11);
+  for (unsigned i = 0; i < 30000; i++) {
+    unsigned key = random() % 40000;
+    if (i % 4 == 3) {
+      EXPECT_EQ(ssl.erase(key), expected.erase(key) == 1);
+    } else {
+      EXPECT_EQ(ssl.insert(key, i), expected.emplace(key, i).second);
+    }
+  }
+
+  EXPECT_EQ(ssl.size(), expected.size());
+  auto check = [&]() {
+    std::vector<unsigned> keys;
+    for (const auto &entry : expected) {
+      keys.push_back(entry.first);
+    }
+    EXPECT_EQ(ssl.allKeysInOrder(), keys);
+    for (unsigned key = 0; key < 40000; key += 7) {
+      unsigned value = 0;
+      auto it = expected.find(key);
+      EXPECT_EQ(ssl.contains(key), it != expected.end());
+      EXPECT_EQ(ssl.find(key, value), it != expected.end());
+      if (it != expected.end()) {
+        EXPECT_EQ(value, it->second);
+      }
+    }
+    auto sizes = ssl.shardSizes();
+    EXPECT_EQ(std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)),
+              expected.size());
+  };
+  check();
+
+  ssl.rebalance();
+  check();
+  std::vector<unsigned> splitters = ssl.splitters();
+  EXPECT_EQ(splitters.size(), 7);
+  EXPECT_TRUE(std::is_sorted(splitters.begin(), splitters.end()));
+  for (std::size_t keys : ssl.shardSizes()) {
+    EXPECT_LE(keys, expected.size() / 8 + 1);
+    EXPECT_GE(keys, expected.size() / 8 - 1);
+  }
+  EXPECT_THROW(ssl.find(40000), RuntimeException);
+}
+
+TEST(Sharded, HotRangesAreSplitAsTheyGrow) {
+  ShardedSkipList<unsigned, unsigned, 4> ssl;
+  const unsigned keys = 60000;
+  for (unsigned i = 0; i < keys; i++) {
+    ssl.insert(i, i + 1);
+  }
+
+  // Every key went to the last shard in use, which got split whenever it
+  // grew past HOT_FACTOR times its share.
+  EXPECT_GE(ssl.splitters().size(), 1);
+  EXPECT_LE(largestShard(ssl),
+            std::max(ssl.MIN_HOT_KEYS, ssl.HOT_FACTOR * (keys / 4 + 1)));
+  std::vector<unsigned> all = ssl.allKeysInOrder();
+  ASSERT_EQ(all.size(), keys);
+  for (unsigned i = 0; i < keys; i++) {
+    EXPECT_EQ(all[i], i);
+  }
+  EXPECT_EQ(ssl.find(12345), 12346);
+
+  unsigned visited = 0;
+  ssl.forEach([&visited](const unsigned &k, const unsigned &v) {
+    EXPECT_EQ(v, k + 1);
+    visited++;
+  });
+  EXPECT_EQ(visited, keys);
+}
+
+TEST(Sharded, FixedSplitters) {
+  using List = ShardedSkipList<std::string, unsigned, 3>;
+  EXPECT_THROW(List(std::vector<std::string>{"m"}), RuntimeException);
+  EXPECT_THROW((List(std::vector<std::string>{"m", "f"})), RuntimeException);
+
+  List ssl(std::vector<std::string>{"f", "m"});
+  for (const char *word : {"zebra", "apple", "mango", "fig", "kiwi", "date"}) {
+    EXPECT_TRUE(ssl.insert(word, 1));
+  }
+  EXPECT_FALSE(ssl.insert("fig", 2));
+  EXPECT_EQ(ssl.shardSizes()[0], 2);
+  EXPECT_EQ(ssl.shardSizes()[1], 2);
+  EXPECT_EQ(ssl.shardSizes()[2], 2);
+  EXPECT_EQ(ssl.allKeysInOrder(),
+            (std::vector<std::string>{"apple", "date", "fig", "kiwi", "mango",
+                                      "zebra"}));
+  EXPECT_TRUE(ssl.erase("mango"));
+  EXPECT_FALSE(ssl.contains("mango"));
+  EXPECT_EQ(ssl.size(), 5);
+}
+
+TEST(Sharded, ConcurrentWritersAndRebalancing) {
+  ShardedSkipList<unsigned, unsigned, 8> ssl;
+  const unsigned threads = 4;
+  const unsigned per_thread = 8000;
+  std::atomic<bool> done{false};
+
+  std::thread balancer([&]() {
+    while (!done) {
+      ssl.rebalance();
+      std::this_thread::yield();
+    }
+  });
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&ssl, t]() {
+      for (unsigned i = 0; i < per_thread; i++) {
+        unsigned key = i * threads + t;
+        EXPECT_TRUE(ssl.insert(key, key));
+        if (i % 2 == 1) {
+          EXPECT_TRUE(ssl.erase(key - threads));
+        }
+        unsigned value = 0;
+        EXPECT_TRUE(ssl.find(key, value));
+        EXPECT_EQ(value, key);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  done = true;
+  balancer.join();
+
+  // Every thread erased the even steps of its own keys.
+  const unsigned remaining = threads * per_thread / 2;
+  EXPECT_EQ(ssl.size(), remaining);
+  std::vector<unsigned> keys = ssl.allKeysInOrder();
+  ASSERT_EQ(keys.size(), remaining);
+  for (unsigned i = 0; i < remaining; i++) {
+    EXPECT_EQ(keys[i], (i / threads) * 2 * threads + threads + i % threads);
+  }
+}
+
+} // namespace
@@ -0,0 +1,141 @@
+#include "MappedSkipList.hpp"
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A snapshot file in the test temporary directory, removed afterwards.
+class SnapshotFile {
+public:
+  explicit SnapshotFile(const std::string &name)
+      : path(::testing::TempDir() + name) {}
+  ~SnapshotFile() { std::remove(path.c_str()); }
+
+  const std::string path;
+};
+
+TEST(Snapshot, SaveAndLoadRebuildTheSameList) {
+  SnapshotFile file("skiplist_roundtrip.snap");
+
+  SkipList<unsigned, double> original;
+  for (unsigned i = 0; i < 3000; i++) {
+    original.insert(i * 7 % 5003, i / 2.0);
+  }
+  original.insert(255, -1.0);
+  original.save(file.path);
+
+  SkipList<unsigned, double> loaded;
+  loaded.insert(1, 1.0);
+  loaded.load(file.path);
+
+  EXPECT_EQ(loaded.size(), original.size());
+  EXPECT_EQ(loaded.numLayers(), original.numLayers());
+  EXPECT_EQ(loaded.allKeysInOrder(), original.allKeysInOrder());
+  for (auto it = original.begin(); it != original.end(); ++it) {
+    EXPECT_EQ(loaded.find(it.key()), it.value());
+    EXPECT_EQ(loaded.height(it.key()), original.height(it.key()));
+  }
+  EXPECT_EQ(loaded.select(1000), original.select(1000));
+  EXPECT_EQ(loaded.rank(2500), original.rank(2500));
+
+  // The loaded list is an ordinary list.
+  EXPECT_TRUE(loaded.insert(6000, 0.5));
+  EXPECT_TRUE(loaded.erase(255));
+  EXPECT_EQ(loaded.size(), original.size());
+}
+
+TEST(Snapshot, EmptyListAndClear) {
+  SnapshotFile file("skiplist_empty.snap");
+  SkipList<std::uint64_t, std::uint64_t> sl;
+  sl.save(file.path);
+
+  for (std::uint64_t i = 0; i < 100; i++) {
+    sl.insert(i, i);
+  }
+  sl.clear();
+  EXPECT_TRUE(sl.isEmpty());
+  EXPECT_EQ(sl.numLayers(), 2);
+  EXPECT_TRUE(sl.begin() == sl.end());
+
+  sl.insert(5, 5);
+  sl.load(file.path);
+  EXPECT_TRUE(sl.isEmpty());
+
+  MappedSkipList<std::uint64_t, std::uint64_t> view(file.path);
+  EXPECT_TRUE(view.isEmpty());
+  EXPECT_FALSE(view.contains(5));
+}
+
+TEST(Snapshot, RejectsOtherTypesAndCorruptFiles) {
+  SnapshotFile file("skiplist_corrupt.snap");
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert(i, i);
+  }
+  sl.save(file.path);
+
+  SkipList<std::uint64_t, unsigned> wrong_key;
+  EXPECT_THROW(wrong_key.load(file.path), RuntimeException);
+  EXPECT_THROW((MappedSkipList<unsigned, std::uint64_t>(file.path)),
+               RuntimeException);
+
+  SkipList<unsigned, unsigned> missing;
+  EXPECT_THROW(missing.load(file.path + ".missing"), RuntimeException);
+  EXPECT_THROW((MappedSkipList<unsigned, unsigned>(file.path + ".missing")),
+               RuntimeException);
+
+  // Swap the first two keys, so that they are out of order.
+  {
+    std::fstream data(file.path,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    SnapshotHeader header;
+    data.read(reinterpret_cast<char *>(&header), sizeof(header));
+    unsigned keys[2] = {1, 0};
+    data.seekp(header.keys_offset);
+    data.write(reinterpret_cast<const char *>(keys), sizeof(keys));
+  }
+  SkipList<unsigned, unsigned> corrupt;
+  corrupt.insert(7, 7);
+  EXPECT_THROW(corrupt.load(file.path), RuntimeException);
+  EXPECT_TRUE(corrupt.isEmpty());
+
+  // A truncated file no longer matches its header.
+  {
+    std::ofstream truncated(file.path, std::ios::binary | std::ios::trunc);
+    truncated << "SKIPLIST";
+  }
+  EXPECT_THROW(corrupt.load(file.path), RuntimeException);
+  EXPECT_THROW((MappedSkipList<unsigned, unsigned>(file.path)),
+               RuntimeException);
+}
+
+TEST(Snapshot, MappedViewServesLookups) {
+  SnapshotFile file("skiplist_mapped.snap");
+  SkipList<unsigned, unsigned> sl;
+  for (unsigned i = 0; i < 5000; i += 2) {
+    sl.insert(i, i + 1);
+  }
+  sl.save(file.path);
+
+  MappedSkipList<unsigned, unsigned> view(file.path);
+  EXPECT_EQ(view.size(), sl.size());
+  EXPECT_EQ(view.allKeysInOrder(), sl.allKeysInOrder());
+  for (unsigned i = 0; i < 5000; i++) {
+    EXPECT_EQ(view.contains(i), i % 2 == 0);
+  }
+  EXPECT_EQ(view.find(1000), 1001);
+  EXPECT_EQ(*view.tryFind(0), 1);
+  EXPECT_EQ(view.tryFind(1), nullptr);
+  EXPECT_EQ(view.height(1000), sl.height(1000));
+  EXPECT_THROW(view.find(1), RuntimeException);
+  EXPECT_THROW(view.height(5000), RuntimeException);
+  EXPECT_EQ(view.keys()[10], 20);
+  EXPECT_EQ(view.values()[10], 21);
+}
+
+} // namespace
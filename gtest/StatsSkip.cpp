@@ -0,0 +1,173 @@
+// The counters only exist with SKIPLIST_STATS. Every list in this file has
+// a value type of its own, so that none of its instantiations are shared
+// with the other test files, which are built without the macro.
+#define SKIPLIST_STATS
+#include "SkipList.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Counted {
+  Counted() = default;
+  Counted(unsigned v) : value(v) {}
+  unsigned value = 0;
+};
+
+using StatsList = SkipList<unsigned, Counted>;
+
+TEST(Stats, TowerCountsFollowInsertEraseAndClear) {
+  StatsList sl;
+  for (unsigned i = 0; i < 1000; i++) {
+    sl.insert(i, i);
+  }
+  const StatsList::Stats &stats = sl.stats();
+  EXPECT_EQ(stats.towers, 1000);
+  EXPECT_EQ(stats.allocations, 1000);
+  EXPECT_EQ(stats.nodesInLayer(0), 1000);
+
+  std::uint64_t bytes = 0;
+  for (unsigned i = 0; i < 1000; i++) {
+    bytes += SkipNode<unsigned, Counted>::bytes(sl.height(i));
+  }
+  EXPECT_EQ(stats.tower_bytes, bytes);
+
+  // S_1 holds exactly the towers taller than 1, and no tower reaches the
+  // empty top layer.
+  std::uint64_t taller = 0;
+  for (unsigned i = 0; i < 1000; i++) {
+    taller += sl.height(i) > 1;
+  }
+  EXPECT_EQ(stats.nodesInLayer(1), taller);
+  EXPECT_EQ(stats.nodesInLayer(sl.numLayers() - 1), 0);
+  EXPECT_GT(stats.nodesInLayer(sl.numLayers() - 2), 0);
+
+  for (unsigned i = 0; i < 1000; i += 2) {
+    sl.erase(i);
+  }
+  EXPECT_EQ(stats.towers, 500);
+  EXPECT_EQ(stats.deallocations, 500);
+  EXPECT_EQ(stats.nodesInLayer(0), 500);
+
+  sl.clear();
+  EXPECT_EQ(stats.towers, 0);
+  EXPECT_EQ(stats.tower_bytes, 0);
+  EXPECT_EQ(stats.nodesInLayer(0), 0);
+  EXPECT_EQ(stats.allocations, stats.deallocations);
+}
+
+TEST(Stats, SearchStepsAndCappedHeights) {
+  StatsList sl;
+  // Key 255 grows as tall as the cap allows.
+  sl.insert(255, 0);
+  EXPECT_EQ(sl.height(255), maxFlipsFor(1));
+  EXPECT_EQ(sl.stats().inserts, 1);
+  EXPECT_EQ(sl.stats().capped_heights, 1);
+
+  for (unsigned i = 0; i < 100; i++) {
+    sl.insert(i, i);
+  }
+  sl.resetSearchStats();
+  EXPECT_EQ(sl.stats().lookups, 0);
+  EXPECT_EQ(sl.stats().capped_heights, 0);
+  EXPECT_EQ(sl.stats().towers, 101);
+
+  // A miss past the end walks every layer; the steps along them add up to
+  // at least the distance to the last key.
+  EXPECT_FALSE(sl.contains(1000));
+  EXPECT_EQ(sl.stats().lookups, 1);
+  EXPECT_EQ(sl.stats().lookup_down_steps, sl.numLayers());
+  EXPECT_GE(sl.stats().lookup_next_steps, 1);
+  EXPECT_LE(sl.stats().lookup_next_steps, 101);
+
+  // A duplicate insert searches but allocates nothing.
+  std::uint64_t allocations = sl.stats().allocations;
+  EXPECT_FALSE(sl.insert(50, 0));
+  EXPECT_EQ(sl.stats().inserts, 1);
+  EXPECT_GE(sl.stats().insert_down_steps, 1);
+  EXPECT_EQ(sl.stats().allocations, allocations);
+
+  const unsigned keys[] = {3, 1, 2, 1000};
+  const Counted *values[4];
+  sl.findBatch(keys, 4, values);
+  EXPECT_EQ(sl.stats().lookups, 5);
+}
+
+TEST(Stats, FingerScansTakeConstantStepsPerKey) {
+  const unsigned n = 1 << 16;
+  StatsList sl;
+  StatsList::Finger finger;
+  for (unsigned i = 0; i < n; i++) {
+    sl.insert(i, i, finger);
+  }
+  const StatsList::Stats &stats = sl.stats();
+  EXPECT_EQ(stats.lookups, n);
+  EXPECT_LT(stats.lookup_next_steps + stats.lookup_down_steps, 8 * n);
+
+  sl.resetSearchStats();
+  for (unsigned i = 0; i < n; i++) {
+    EXPECT_EQ(sl.find(i, finger).value, i);
+  }
+  std::uint64_t fingered = stats.lookup_next_steps + stats.lookup_down_steps;
+  EXPECT_LT(fingered, 8 * n);
+
+  // Without the finger, every lookup starts from the top layer.
+  sl.resetSearchStats();
+  for (unsigned i = 0; i < n; i++) {
+    EXPECT_TRUE(sl.contains(i));
+  }
+  EXPECT_GT(stats.lookup_next_steps + stats.lookup_down_steps, 3 * fingered);
+
+  // A change elsewhere makes the next hinted search check every layer of
+  // the finger, after which the scan is back to a few steps per key.
+  sl.resetSearchStats();
+  sl.find(1000, finger);
+  sl.erase(n - 1);
+  sl.resetSearchStats();
+  EXPECT_EQ(sl.find(1001, finger).value, 1001);
+  EXPECT_GE(stats.lookup_down_steps, sl.numLayers() - 1);
+  EXPECT_LE(stats.lookup_down_steps, 2 * sl.numLayers());
+  for (unsigned i = 1002; i < n - 1; i++) {
+    EXPECT_EQ(sl.find(i, finger).value, i);
+  }
+  EXPECT_LT(stats.lookup_next_steps + stats.lookup_down_steps, 8 * n);
+}
+
+TEST(Stats, ParallelBuildCountsItsTowers) {
+  std::vector<std::pair<unsigned, Counted>> pairs;
+  for (unsigned i = 0; i < 50000; i++) {
+    pairs.emplace_back(i, i);
+  }
+  StatsList sl;
+  sl.buildParallel(pairs.begin(), pairs.end(), 4);
+  EXPECT_EQ(sl.stats().towers, 50000);
+  EXPECT_EQ(sl.stats().allocations, 50000);
+  EXPECT_EQ(sl.stats().nodesInLayer(0), 50000);
+}
+
+TEST(Stats, MergeAndSplitMoveTowerCounts) {
+  StatsList sl;
+  StatsList right;
+  for (unsigned i = 0; i < 1000; i++) {
+    sl.insert(i, i);
+  }
+  std::uint64_t bytes = sl.stats().tower_bytes;
+  sl.split(600, right);
+  EXPECT_EQ(sl.stats().towers, 600);
+  EXPECT_EQ(right.stats().towers, 400);
+  EXPECT_EQ(right.stats().nodesInLayer(0), 400);
+  EXPECT_EQ(sl.stats().tower_bytes + right.stats().tower_bytes, bytes);
+
+  right.insert(5, 5);
+  sl.merge(std::move(right));
+  EXPECT_EQ(sl.stats().towers, 1000);
+  EXPECT_EQ(sl.stats().tower_bytes, bytes);
+  EXPECT_EQ(sl.stats().nodesInLayer(1),
+            sl.size() - sl.stats().towers_by_height[1]);
+  EXPECT_EQ(right.stats().towers, 0);
+  EXPECT_EQ(right.stats().tower_bytes, 0);
+}
+
+} // namespace
@@ -0,0 +1,141 @@
+#include "SkipList.hpp"
+#include "StringSkipList.hpp"
+#include "gtest/gtest.h"
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// flipCoinLevels picks the InlineStringKey overload over the generic
+// flip-by-flip loop, so this is what keeps the two in step.
+TEST(StringKeys, InlineKeysFlipLikeStrings) {
+  std::string s;
+  for (unsigned i = 0; i < 300; i++) {
+    InlineStringKey key(s.data(), s.size(), s.size() / 2);
+    for (unsigned flip = 0; flip < 16; flip++) {
+      ASSERT_EQ(flipCoin(key, flip), flipCoin(s, flip));
+    }
+    for (unsigned cap : {1u, 2u, 7u, 15u, 60u}) {
+      unsigned height = 0;
+      while (flipCoin(key, height) && height + 1 < cap) {
+        height++;
+      }
+      EXPECT_EQ(flipCoinLevels(key, cap), height + 1);
+      EXPECT_EQ(flipCoinLevels(key, cap), flipCoinLevels(s, cap));
+    }
+    s.push_back(static_cast<char>(i * 37 + 11));
+  }
+}
+
+TEST(StringKeys, MatchesSkipListOfStrings) {
+  StringSkipList<std::string> ssl;
+  SkipList<std::string, std::string> sl;
+  std::mt19937 random(5);
+  std::vector<std::string> keys;
+  for (unsigned i = 0; i < 3000; i++) {
+    keys.push_back("tenant/region/" + std::to_string(random() % 100000));
+  }
+
+  for (unsigned i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(ssl.insert(keys[i], keys[i] + "!"),
+              sl.insert(keys[i], keys[i] + "!"));
+    if (i % 3 == 2) {
+      EXPECT_EQ(ssl.erase(keys[i / 2]), sl.erase(keys[i / 2]));
+    }
+  }
+  EXPECT_EQ(ssl.sharedPrefix(), "tenant/region/");
+  EXPECT_EQ(ssl.size(), sl.size());
+  EXPECT_EQ(ssl.numLayers(), sl.numLayers());
+  EXPECT_EQ(ssl.allKeysInOrder(), sl.allKeysInOrder());
+  for (const std::string &key : keys) {
+    ASSERT_EQ(ssl.contains(key), sl.contains(key));
+    if (sl.contains(key)) {
+      EXPECT_EQ(ssl.find(key), key + "!");
+      EXPECT_EQ(ssl.height(key), sl.height(key));
+    } else {
+      EXPECT_EQ(ssl.tryFind(key), nullptr);
+      EXPECT_THROW(ssl.height(key), RuntimeException);
+    }
+  }
+  EXPECT_FALSE(ssl.contains("tenant/"));
+  EXPECT_FALSE(ssl.contains("other/region/1"));
+  EXPECT_THROW(ssl.find("tenant/region/"), RuntimeException);
+}
+
+TEST(StringKeys, SharedPrefixShrinksAsKeysArrive) {
+  StringSkipList<unsigned> ssl;
+  EXPECT_TRUE(ssl.insert("abcdefghijklmno1", 1));
+  EXPECT_EQ(ssl.sharedPrefix(), "abcdefghijklmno1");
+  EXPECT_TRUE(ssl.insert("abcdefghijklmno2", 2));
+  EXPECT_EQ(ssl.sharedPrefix(), "abcdefghijklmno");
+  EXPECT_TRUE(ssl.insert("abcd", 3));
+  EXPECT_EQ(ssl.sharedPrefix(), "abcd");
+  EXPECT_FALSE(ssl.insert("abcdefghijklmno1", 4));
+  const std::string with_zero("abcdefghijklmno1\0x", 18);
+  EXPECT_TRUE(ssl.insert(with_zero, 5));
+  EXPECT_TRUE(ssl.insert(std::string("abcd\0", 5), 6));
+  EXPECT_TRUE(ssl.insert("b", 7));
+  EXPECT_EQ(ssl.sharedPrefix(), "");
+  EXPECT_TRUE(ssl.insert("", 8));
+
+  std::map<std::string, unsigned> expected = {
+      {"abcdefghijklmno1", 1},
+      {"abcdefghijklmno2", 2},
+      {"abcd", 3},
+      {with_zero, 5},
+      {std::string("abcd\0", 5), 6},
+      {"b", 7},
+      {"", 8},
+  };
+  std::vector<std::string> keys;
+  for (const auto &entry : expected) {
+    keys.push_back(entry.first);
+    EXPECT_EQ(ssl.find(entry.first), entry.second);
+  }
+  EXPECT_EQ(ssl.allKeysInOrder(), keys);
+
+  // An empty list starts over with the next key.
+  for (const std::string &key : keys) {
+    EXPECT_TRUE(ssl.erase(key));
+  }
+  EXPECT_TRUE(ssl.isEmpty());
+  EXPECT_TRUE(ssl.insert("zzz", 9));
+  EXPECT_EQ(ssl.sharedPrefix(), "zzz");
+  EXPECT_EQ(ssl.find("zzz"), 9);
+}
+
+TEST(StringKeys, ErasedKeyBytesAreCompacted) {
+  StringSkipList<unsigned> ssl;
+  const std::string prefix(40, 'p');
+  for (unsigned i = 0; i < 20000; i++) {
+    ssl.insert(prefix + std::to_string(i), i);
+  }
+  std::size_t full = ssl.arenaBytes();
+  for (unsigned i = 0; i < 20000; i++) {
+    if (i % 100 != 0) {
+      EXPECT_TRUE(ssl.erase(prefix + std::to_string(i)));
+    }
+  }
+  EXPECT_EQ(ssl.size(), 200);
+  EXPECT_LT(ssl.arenaBytes(), full / 2);
+  for (unsigned i = 0; i < 20000; i += 100) {
+    EXPECT_EQ(ssl.find(prefix + std::to_string(i)), i);
+  }
+}
+
+TEST(StringKeys, HashedHeightsKeepTheListShallow) {
+  // Keys that differ only in their last digits XOR to few distinct bytes,
+  // so the flipCoin rule gives most of them the same tower.
+  StringSkipList<unsigned, HashedLevels<>> ssl;
+  for (unsigned i = 0; i < 4096; i++) {
+    EXPECT_TRUE(ssl.insert("key/" + std::to_string(100000 + i), i));
+  }
+  EXPECT_LT(ssl.numLayers(), 40);
+  for (unsigned i = 0; i < 4096; i++) {
+    EXPECT_EQ(ssl.find("key/" + std::to_string(100000 + i)), i);
+  }
+}
+
+} // namespace
@@ -0,0 +1,173 @@
+#include "WorkloadDriver.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+TEST(Workload, HistogramPercentilesStayWithinABucket) {
+  LatencyHistogram empty;
+  EXPECT_EQ(empty.count(), 0u);
+  EXPECT_EQ(empty.valueAt(99), 0u);
+  EXPECT_EQ(empty.min(), 0u);
+
+  LatencyHistogram latency;
+  for (std::uint64_t v = 1; v <= 100000; v++) {
+    latency.record(v);
+  }
+  EXPECT_EQ(latency.count(), 100000u);
+  EXPECT_EQ(latency.min(), 1u);
+  EXPECT_EQ(latency.max(), 100000u);
+  EXPECT_DOUBLE_EQ(latency.mean(), 50000.5);
+  for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9, 99.99}) {
+    // The exact answer is percentile * 1000; buckets are at most 1/32 wide.
+    double exact = percentile * 1000;
+    double reported = static_cast<double>(latency.valueAt(percentile));
+    EXPECT_GE(reported, exact) << percentile;
+    EXPECT_LE(reported, exact * (1 + 1.0 / 32)) << percentile;
+  }
+  EXPECT_EQ(latency.valueAt(100), 100000u);
+
+  // Small values are exact, and huge ones still have a bucket.
+  LatencyHistogram small;
+  for (std::uint64_t v : {0u, 3u, 3u, 63u}) {
+    small.record(v);
+  }
+  EXPECT_EQ(small.valueAt(25), 0u);
+  EXPECT_EQ(small.valueAt(50), 3u);
+  EXPECT_EQ(small.valueAt(100), 63u);
+  small.record(UINT64_MAX);
+  EXPECT_EQ(small.valueAt(100), UINT64_MAX);
+
+  LatencyHistogram merged;
+  merged.merge(latency);
+  merged.merge(small);
+  EXPECT_EQ(merged.count(), latency.count() + small.count());
+  EXPECT_EQ(merged.min(), 0u);
+  EXPECT_EQ(merged.max(), UINT64_MAX);
+  EXPECT_EQ(merged.valueAt(50), latency.valueAt(50));
+}
+
+TEST(Workload, TracesParseAndRejectBadLines) {
+  std::istringstream good("# a comment\n"
+                          "insert 5 50\n"
+                          "\n"
+                          "find 5\n"
+                          "  next 7\n"
+                          "prev 18446744073709551615\n");
+  std::vector<WorkloadStep> steps = readTrace(good);
+  ASSERT_EQ(steps.size(), 4u);
+  EXPECT_EQ(steps[0].op, WorkloadOp::Insert);
+  EXPECT_EQ(steps[0].key, 5u);
+  EXPECT_EQ(steps[0].value, 50u);
+  EXPECT_EQ(steps[1].op, WorkloadOp::Find);
+  EXPECT_EQ(steps[2].op, WorkloadOp::Next);
+  EXPECT_EQ(steps[2].key, 7u);
+  EXPECT_EQ(steps[3].op, WorkloadOp::Previous);
+  EXPECT_EQ(steps[3].key, UINT64_MAX);
+
+  for (const char *bad :
+       {"erase 5\n", "find\n", "insert 5\n", "find x\n", "find 5 6\n"}) {
+    std::istringstream in(std::string("find 1\n") + bad);
+    try {
+      readTrace(in);
+      ADD_FAILURE() << bad;
+    } catch (const RuntimeException &e) {
+      EXPECT_EQ(e.getMessage(), "Bad trace line 2") << bad;
+    }
+  }
+}
+
+TEST(Workload, GeneratedWorkloadsFollowTheMix) {
+  const WorkloadMix mix = {1, 2, 0, 1};
+  std::vector<WorkloadStep> uniform =
+      generateWorkload(KeyDistribution::Uniform, 1000, 40000, mix, 7);
+  ASSERT_EQ(uniform.size(), 40000u);
+  std::vector<std::size_t> ops(WORKLOAD_OPS, 0);
+  for (const WorkloadStep &step : uniform) {
+    EXPECT_LT(step.key, 1000u);
+    ops[static_cast<std::size_t>(step.op)]++;
+  }
+  EXPECT_NEAR(ops[0], 10000, 600);
+  EXPECT_NEAR(ops[1], 20000, 600);
+  EXPECT_EQ(ops[2], 0u);
+  EXPECT_NEAR(ops[3], 10000, 600);
+
+  std::vector<WorkloadStep> again =
+      generateWorkload(KeyDistribution::Uniform, 1000, 40000, mix, 7);
+  for (std::size_t i = 0; i < uniform.size(); i++) {
+    EXPECT_EQ(again[i].key, uniform[i].key);
+    EXPECT_EQ(again[i].op, uniform[i].op);
+  }
+
+  std::vector<WorkloadStep> sequential =
+      generateWorkload(KeyDistribution::Sequential, 10, 25, mix);
+  for (std::size_t i = 0; i < sequential.size(); i++) {
+    EXPECT_EQ(sequential[i].key, i % 10);
+  }
+
+  // Under theta = 0.99, rank 0 is drawn about 1 / zeta(1000) = 13% of the
+  // time, and the top tenth of the keys well over half of the time.
+  std::vector<WorkloadStep> zipfian =
+      generateWorkload(KeyDistribution::Zipfian, 1000, 40000, mix, 7);
+  std::size_t hottest = 0, top_tenth = 0;
+  for (const WorkloadStep &step : zipfian) {
+    EXPECT_LT(step.key, 1000u);
+    hottest += step.key == 0;
+    top_tenth += step.key < 100;
+  }
+  EXPECT_NEAR(hottest, 40000 * 0.133, 800);
+  EXPECT_GT(top_tenth, 40000u * 6 / 10);
+
+  EXPECT_THROW(generateWorkload(KeyDistribution::Uniform, 0, 1, mix),
+               RuntimeException);
+}
+
+template <typename Target> void replayAndCount(unsigned threads) {
+  std::vector<WorkloadStep> steps;
+  for (std::uint64_t k = 0; k < 2000; k++) {
+    steps.push_back(WorkloadStep{WorkloadOp::Insert, k * 2, k});
+  }
+  for (std::uint64_t k = 0; k < 4000; k++) {
+    steps.push_back(WorkloadStep{WorkloadOp::Find, k, 0});
+    steps.push_back(WorkloadStep{WorkloadOp::Next, k, 0});
+  }
+  Target target;
+  // The finds can overtake the inserts on other threads, so insert first.
+  std::vector<WorkloadStep> inserts(steps.begin(), steps.begin() + 2000);
+  std::vector<WorkloadStep> lookups(steps.begin() + 2000, steps.end());
+  WorkloadResult loaded = runWorkload(target, inserts, threads);
+  EXPECT_EQ(loaded.hits[0], 2000u);
+  WorkloadResult result = runWorkload(target, lookups, threads);
+
+  EXPECT_EQ(result.threads, threads);
+  EXPECT_GT(result.seconds, 0);
+  EXPECT_EQ(result.latency[1].count(), 4000u);
+  EXPECT_EQ(result.hits[1], 2000u);
+  if (Target::supports(WorkloadOp::Next)) {
+    EXPECT_EQ(result.latency[2].count(), 4000u);
+    // Every even key but the largest has a next key.
+    EXPECT_EQ(result.hits[2], 1999u);
+    EXPECT_EQ(result.skipped[2], 0u);
+  } else {
+    EXPECT_EQ(result.latency[2].count(), 0u);
+    EXPECT_EQ(result.skipped[2], 4000u);
+  }
+  EXPECT_EQ(result.overall().count(),
+            result.latency[1].count() + result.latency[2].count());
+}
+
+TEST(Workload, ReplaysAgainstEveryTarget) {
+  replayAndCount<SkipListTarget>(1);
+  replayAndCount<LockedSkipListTarget>(4);
+  replayAndCount<ConcurrentSkipListTarget>(4);
+  replayAndCount<ShardedSkipListTarget>(4);
+
+  SkipListTarget single;
+  std::vector<WorkloadStep> none;
+  EXPECT_THROW(runWorkload(single, none, 2), RuntimeException);
+  EXPECT_THROW(runWorkload(single, none, 0), RuntimeException);
+}
+
+} // namespace